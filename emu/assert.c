@@ -28,25 +28,51 @@ BPLONG free_record_count[MAX_FREE_RECORD_SIZE+1];
         }                                                               \
     }
 
+#define CLAUSE_RECORD_SIZE 7
+
 #define RELEASE_FREE_CLAUSE_RECORD(clause_record_ptr) {                 \
-        FOLLOW((BPLONG_PTR)clause_record_ptr) = (BPLONG)free_record[5]; \
-        free_record[5] = (BPLONG_PTR)clause_record_ptr;                 \
-        free_record_count[5]++;                                         \
+        FOLLOW((BPLONG_PTR)clause_record_ptr) = (BPLONG)free_record[CLAUSE_RECORD_SIZE]; \
+        free_record[CLAUSE_RECORD_SIZE] = (BPLONG_PTR)clause_record_ptr; \
+        free_record_count[CLAUSE_RECORD_SIZE]++;                        \
     }                                                                   \
 
-/* a clause record has the form struct(ClRef,Head,Body,Birth,Death) */
+/* a clause record has the form struct(ClRef,Head,Body,Birth,Death,BucketRef,ArgRefs) */
 #define ALLOCATE_CLAUSE_RECORD(clause_record_ptr) {             \
         BPLONG_PTR tmp_ptr;                                     \
-        if (free_record_count[5] > 0) {                         \
-            tmp_ptr = (BPLONG_PTR)free_record[5];               \
-            free_record[5] = (BPLONG_PTR)FOLLOW(tmp_ptr);       \
-            free_record_count[5]--;                             \
+        if (free_record_count[CLAUSE_RECORD_SIZE] > 0) {        \
+            tmp_ptr = (BPLONG_PTR)free_record[CLAUSE_RECORD_SIZE]; \
+            free_record[CLAUSE_RECORD_SIZE] = (BPLONG_PTR)FOLLOW(tmp_ptr); \
+            free_record_count[CLAUSE_RECORD_SIZE]--;            \
         } else {                                                \
-            ALLOCATE_FROM_PAREA(tmp_ptr, 5);                    \
+            ALLOCATE_FROM_PAREA(tmp_ptr, CLAUSE_RECORD_SIZE);   \
         }                                                       \
         clause_record_ptr = (InterpretedClausePtr)tmp_ptr;      \
     }
 
+/* the indexes reserve hash value 0 for variables, but BP_HASH_CODE1 also gives 0 to
+   some other terms, such as the integer 0 */
+#define NONVAR_HASH_CODE(op, hashcode)                                  \
+    if ((hashcode) == 0 && ISNONVAR(op) && !IS_SUSP_VAR(op) && !IsNumberedVar(op)) (hashcode) = 1
+
+/* the bucket of the first-argument index for a non-zero hash value */
+#define FIRST_ARG_BUCKET(pred_ptr, hashval)                             \
+    ((InterpretedPredBucketPtr)FOLLOW((pred_ptr)->hashtable+(hashval)%(pred_ptr)->bucket_size))
+
+/* the bucket of an argument index for a non-zero hash value */
+#define ARG_INDEX_BUCKET(index_ptr, hashval)                            \
+    ((index_ptr)->buckets+(hashval)%(index_ptr)->size)
+
+/* the number of cells in the buckets of an argument index */
+#define ARG_INDEX_CELLS(index_ptr)                                      \
+    ((index_ptr)->count+(index_ptr)->var_count*((index_ptr)->size-1))
+
+/* a change to an incremental predicate invalidates the tabled subgoals that called it */
+#define INVALIDATE_TABLE_DEPENDENTS(pred_ptr)                           \
+    if ((pred_ptr)->table_dependents != NULL) invalidate_table_dependents(pred_ptr)
+
+/* predicates with fewer clauses are not worth indexing on other arguments */
+#define ARG_INDEX_MIN_CLAUSES 8
+
 #define ALLOCATE_RECORD_IN_ASSERT(record_ptr, record_size) {            \
         if (record_size <= MAX_FREE_RECORD_SIZE && free_record_count[record_size] > 0) { \
             record_ptr = free_record[record_size];                      \
@@ -61,8 +87,20 @@ BPLONG free_record_count[MAX_FREE_RECORD_SIZE+1];
 #define INTERPRETED_PRED_PTR(pred) (InterpretedPredPtr)UNTAGGED_ADDR(FOLLOW((BPLONG_PTR)UNTAGGED_ADDR(pred)+1))
 #define IS_INTERPRETED_PRED(pred) (ISSTRUCT(pred) && GET_STR_SYM_REC(pred) == c_object_ref_sym)
 
-BPLONG_PTR picat_global_maps[NUM_PICAT_GLOBAL_MAPS];
-BPLONG picat_global_map_ids[NUM_PICAT_GLOBAL_MAPS];
+/* Global maps are numbered 0,1,... in the order they are created. The number of a
+   map is its index in picat_global_maps and picat_global_map_ids, which grow on
+   demand, so a map keeps its number for the whole session. picat_global_map_index
+   is an open-addressing table that maps an id to the number of its map plus 1
+   (0 for an empty slot); it is rebuilt larger when it becomes half full.
+   The maps are shared by all engines without synchronization of their own:
+   only one engine runs at a time, and threads take turns through the engine
+   lock (see PlockEngine in kapi.c). */
+BPLONG_PTR *picat_global_maps = NULL;
+BPLONG *picat_global_map_ids = NULL;
+static BPLONG num_picat_global_maps = 0;
+static BPLONG picat_global_maps_capacity = 0;
+static BPLONG *picat_global_map_index = NULL;
+static BPLONG picat_global_map_index_size = 0;
 
 /***************************************************************************/
 /* actually slots indexed 0 and 1 are never used */
@@ -199,6 +237,7 @@ void abolish_pred(pred_ptr)
     int i;
     InterpretedPredBucketPtr bucket_ptr;
 
+    INVALIDATE_TABLE_DEPENDENTS(pred_ptr);
     pred_ptr->cl_count = 0;
     hashtable = pred_ptr->hashtable;
     bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(hashtable+pred_ptr->bucket_size);
@@ -217,23 +256,36 @@ void abolish_pred(pred_ptr)
 
     for (i = 0; i < pred_ptr->bucket_size; i++) {
         bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(hashtable+i);
-        list = bucket_ptr->list;
-        while (ISLIST(list)) {
-            cell_ptr = (BPLONG_PTR)UNTAGGED_ADDR(list);
-            list = FOLLOW(cell_ptr+1);
-            if (pred_ptr->ref_count == 0 && pred_ptr->retr_count == 0) {
-                RELEASE_FREE_RECORD(cell_ptr, 3);  /* a list cell has three fields: clause_record, next, and prev */
-            }
+        release_bucket_cells(pred_ptr, bucket_ptr);
+    }
+    free_arg_indexes(pred_ptr);
+}
+
+/* release the cells of the chain, unless the predicate is being accessed */
+void release_bucket_cells(InterpretedPredPtr pred_ptr, InterpretedPredBucketPtr bucket_ptr) {
+    BPLONG_PTR cell_ptr;
+    BPLONG list;
+
+    list = bucket_ptr->list;
+    while (ISLIST(list)) {
+        cell_ptr = (BPLONG_PTR)UNTAGGED_ADDR(list);
+        list = FOLLOW(cell_ptr+1);
+        if (pred_ptr->ref_count == 0 && pred_ptr->retr_count == 0) {
+            RELEASE_FREE_RECORD(cell_ptr, 3);  /* a list cell has three fields: clause_record, next, and prev */
         }
-        bucket_ptr->tail = NULL;
-        bucket_ptr->list = nil_sym;
     }
+    bucket_ptr->tail = NULL;
+    bucket_ptr->list = nil_sym;
 }
 
 /* a clause record takes form struct(CellRef,Head,Body,Birth,Death) where CellRef refers to the cell that
    wrapes this record on the last chain of the predicate
 */
 void release_clause_record_space(InterpretedClausePtr clause_record_ptr) {
+    if (clause_record_ptr->arg_refs != NULL) {
+        BPLONG arity = GET_ARITY(GET_STR_SYM_REC(clause_record_ptr->head));
+        RELEASE_FREE_RECORD(clause_record_ptr->arg_refs, arity+1);
+    }
     release_term_space(clause_record_ptr->head);
     release_term_space(clause_record_ptr->body);
     RELEASE_FREE_CLAUSE_RECORD(clause_record_ptr);
@@ -285,6 +337,7 @@ int b_REMOVE_CLAUSE_c(clause_record)
     pred = (BPLONG)GET_EP(sym_ptr);
     pred_ptr = INTERPRETED_PRED_PTR(pred);
 
+    INVALIDATE_TABLE_DEPENDENTS(pred_ptr);
     pred_ptr->cl_count--;
     if (pred_ptr->ref_count != 0 || pred_ptr->retr_count > 1) {
         pred_ptr->time_stamp++;
@@ -299,7 +352,7 @@ void locate_and_free_clause_record(pred_ptr, clause_record)
     InterpretedPredPtr pred_ptr;
     BPLONG clause_record;
 {
-    int hashval, i;
+    BPLONG hashval, i;
     BPLONG_PTR cell_ptr, hashtable;
     InterpretedClausePtr clause_record_ptr;
     InterpretedPredBucketPtr bucket_ptr;
@@ -310,15 +363,32 @@ void locate_and_free_clause_record(pred_ptr, clause_record)
     cell_ptr = (BPLONG_PTR)UNTAGGED_ADDR(clause_record_ptr->cl_ref);  /* clause_record_ptr points to struct(CellRef,Head,Body,Birth,Death) */
     disconnect_cell_of_removed_clause(bucket_ptr, cell_ptr);
 
-    hashval = hashval_in_assert(clause_record_ptr);
-    if (hashval == 0) { /* consider buckets 0-size-1 */
+    if (clause_record_ptr->bucket_ref != NULL) {
+        hashval = hashval_in_assert(clause_record_ptr);
+        bucket_ptr = FIRST_ARG_BUCKET(pred_ptr, hashval);
+        free_cell_of_removed_in_bucket(pred_ptr, bucket_ptr, clause_record_ptr->bucket_ref);
+        clause_record_ptr->bucket_ref = NULL;
+    } else {  /* the first argument is a variable, so the clause is in every bucket */
         for (i = 0; i < pred_ptr->bucket_size; i++) {
-            bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(hashtable+i);
-            free_cell_of_removed_in_bucket(pred_ptr, bucket_ptr, clause_record);
+            free_clause_cell_in_bucket(pred_ptr, (InterpretedPredBucketPtr)FOLLOW(hashtable+i), clause_record);
+        }
+    }
+    if (pred_ptr->arg_indexes != NULL) {
+        for (i = 2; i <= pred_ptr->arity; i++) {
+            InterpretedArgIndexPtr index_ptr = (InterpretedArgIndexPtr)FOLLOW(pred_ptr->arg_indexes+i);
+            BPLONG j;
+            if (index_ptr == NULL) continue;
+            hashval = hashval_of_clause_arg(clause_record_ptr, i);
+            if (hashval != 0) {
+                free_cell_of_removed_in_bucket(pred_ptr, ARG_INDEX_BUCKET(index_ptr, hashval), (BPLONG_PTR)FOLLOW(clause_record_ptr->arg_refs+i));
+            } else {
+                for (j = 0; j < index_ptr->size; j++) {
+                    free_clause_cell_in_bucket(pred_ptr, index_ptr->buckets+j, clause_record);
+                }
+                index_ptr->var_count--;
+            }
+            index_ptr->count--;
         }
-    } else {
-        bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(hashtable+hashval%pred_ptr->bucket_size);
-        free_cell_of_removed_in_bucket(pred_ptr, bucket_ptr, clause_record);
     }
 
     if (pred_ptr->ref_count == 0 && pred_ptr->retr_count <= 1) {  /* this pred is being accessed only by this retract call */
@@ -327,30 +397,34 @@ void locate_and_free_clause_record(pred_ptr, clause_record)
     }
 }
 
-/* locate the wrapper cell of the clause record and then disconnect it */
-void free_cell_of_removed_in_bucket(pred_ptr, bucket_ptr, removed_clause_record)
-    InterpretedPredPtr pred_ptr;
-    InterpretedPredBucketPtr bucket_ptr;
-    BPLONG removed_clause_record;
-{
-    BPLONG clause_record, list;
+/* find the wrapper cell of a removed clause record in the chain, and free it */
+void free_clause_cell_in_bucket(InterpretedPredPtr pred_ptr, InterpretedPredBucketPtr bucket_ptr, BPLONG clause_record) {
     BPLONG_PTR cell_ptr;
+    BPLONG list;
 
     list = bucket_ptr->list;
     while (ISLIST(list)) {
         cell_ptr = (BPLONG_PTR)UNTAGGED_ADDR(list);
-        clause_record = FOLLOW(cell_ptr);
-        if (clause_record == removed_clause_record) {
-            disconnect_cell_of_removed_clause(bucket_ptr, cell_ptr);
-            if (pred_ptr->ref_count == 0 && pred_ptr->retr_count <= 1) {
-                RELEASE_FREE_RECORD(cell_ptr, 3);
-            }
+        if (FOLLOW(cell_ptr) == clause_record) {
+            free_cell_of_removed_in_bucket(pred_ptr, bucket_ptr, cell_ptr);
             return;
         }
         list = FOLLOW(cell_ptr+1);
     }
 }
 
+/* disconnect the wrapper cell of a removed clause record from the chain, and then free it */
+void free_cell_of_removed_in_bucket(pred_ptr, bucket_ptr, cell_ptr)
+    InterpretedPredPtr pred_ptr;
+    InterpretedPredBucketPtr bucket_ptr;
+    BPLONG_PTR cell_ptr;
+{
+    disconnect_cell_of_removed_clause(bucket_ptr, cell_ptr);
+    if (pred_ptr->ref_count == 0 && pred_ptr->retr_count <= 1) {
+        RELEASE_FREE_RECORD(cell_ptr, 3);
+    }
+}
+
 /* disconnect the wrapper cell of the clause record from the chain */
 void disconnect_cell_of_removed_clause(bucket_ptr, cell_ptr)
     InterpretedPredBucketPtr bucket_ptr;
@@ -386,6 +460,135 @@ void disconnect_cell_of_removed_clause(bucket_ptr, cell_ptr)
     }
 }
 
+/***************************************************************************/
+/* check if the head of a clause unifies with a head whose arguments are distinct
+   variables or atomic constants */
+static int clause_head_matches(BPLONG_PTR head_ptr, BPLONG arity, InterpretedClausePtr clause_record_ptr) {
+    BPLONG_PTR cl_head_ptr, top;
+    BPLONG i, j, arg, arg0, cl_arg;
+
+    if (arity == 0) return 1;
+    cl_head_ptr = (BPLONG_PTR)UNTAGGED_ADDR(clause_record_ptr->head);
+    for (i = 1; i <= arity; i++) {
+        arg = FOLLOW(head_ptr+i);
+        DEREF(arg);
+        if (ISREF(arg)) continue;
+        cl_arg = FOLLOW(cl_head_ptr+i);
+        if (IsNumberedVar(cl_arg)) {  /* the variable may also occur at another constant position */
+            for (j = 1; j < i; j++) {
+                if (FOLLOW(cl_head_ptr+j) != cl_arg) continue;
+                arg0 = FOLLOW(head_ptr+j);
+                DEREF(arg0);
+                if (!ISREF(arg0) && arg0 != arg) return 0;
+            }
+        } else if (cl_arg != arg) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* remove the matching clauses on the chain, and return the number of removed clauses */
+static BPLONG retract_matching_clauses(InterpretedPredPtr pred_ptr, BPLONG list, BPLONG_PTR head_ptr, BPLONG arity) {
+    BPLONG_PTR cell_ptr;
+    BPLONG clause_record, count;
+    InterpretedClausePtr clause_record_ptr;
+
+    count = 0;
+    while (ISLIST(list)) {
+        cell_ptr = (BPLONG_PTR)UNTAGGED_ADDR(list);
+        list = FOLLOW(cell_ptr+1);  /* the cell may be freed below */
+        clause_record = FOLLOW(cell_ptr);
+        clause_record_ptr = (InterpretedClausePtr)UNTAGGED_ADDR(clause_record);
+        if (clause_record_ptr->death_time_stamp != BP_MAXINT_1W) continue;  /* has been removed already */
+        if (!clause_head_matches(head_ptr, arity, clause_record_ptr)) continue;
+        count++;
+        INVALIDATE_TABLE_DEPENDENTS(pred_ptr);
+        pred_ptr->cl_count--;
+        if (pred_ptr->ref_count != 0 || pred_ptr->retr_count != 0) {
+            clause_record_ptr->death_time_stamp = pred_ptr->time_stamp;
+        } else {
+            locate_and_free_clause_record(pred_ptr, clause_record);
+        }
+    }
+    return count;
+}
+
+/* c_RETRACTALL_cf(Head,Count): remove all the clauses whose heads unify with Head,
+   and let Count be the number of removed clauses. Only heads whose arguments are
+   distinct variables or atomic constants are handled; the call fails for the other
+   heads, which are left to retractall/1. If all the arguments are variables and no
+   call is accessing the predicate, the chains are dropped as a whole.
+*/
+int c_RETRACTALL_cf() {
+    BPLONG Head, Count;
+    SYM_REC_PTR sym_ptr;
+    InterpretedPredPtr pred_ptr;
+    InterpretedArgIndexPtr index_ptr;
+    InterpretedPredBucketPtr bucket_ptr;
+    BPLONG_PTR head_ptr, top;
+    BPLONG pred, arg, arg0, arity, i, j, key_arg_no, hashval, count;
+
+    Head = ARG(1, 2);
+    Count = ARG(2, 2);
+    DEREF(Head);
+    if (b_ASSERTABLE_c(Head) != BP_TRUE) return BP_FALSE;
+    sym_ptr = GET_SYM_REC(Head);
+    pred = (BPLONG)GET_EP(sym_ptr);
+    if (!IS_INTERPRETED_PRED(pred)) return BP_FALSE;
+    pred_ptr = INTERPRETED_PRED_PTR(pred);
+
+    arity = GET_ARITY(sym_ptr);
+    head_ptr = (ISSTRUCT(Head)) ? (BPLONG_PTR)UNTAGGED_ADDR(Head) : NULL;
+    key_arg_no = 0;
+    hashval = 0;
+    for (i = 1; i <= arity; i++) {
+        arg = FOLLOW(head_ptr+i);
+        DEREF(arg);
+        if (ISREF(arg)) {
+            for (j = 1; j < i; j++) {
+                arg0 = FOLLOW(head_ptr+j);
+                DEREF(arg0);
+                if (arg0 == arg) return BP_FALSE;
+            }
+        } else if (ISATOM(arg) || ISINT(arg)) {
+            if (key_arg_no == 0) {
+                key_arg_no = i;
+                BP_HASH_CODE1(arg, hashval, lab_key);
+                NONVAR_HASH_CODE(arg, hashval);
+            }
+        } else {
+            return BP_FALSE;
+        }
+    }
+
+    if (key_arg_no == 0 && pred_ptr->ref_count == 0 && pred_ptr->retr_count == 0) {
+        count = pred_ptr->cl_count;
+        abolish_pred(pred_ptr);
+        return unify(Count, MAKEINT(count));
+    }
+
+    /* the chain that contains all the candidate clauses */
+    bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(pred_ptr->hashtable+pred_ptr->bucket_size);
+    if (hashval != 0) {
+        if (key_arg_no == 1) {
+            if (pred_ptr->bucket_size != 0) {
+                bucket_ptr = FIRST_ARG_BUCKET(pred_ptr, hashval);
+            }
+        } else if (pred_ptr->cl_count >= ARG_INDEX_MIN_CLAUSES) {
+            index_ptr = get_arg_index(pred_ptr, key_arg_no, arity);
+            if (index_ptr != NULL) {
+                bucket_ptr = ARG_INDEX_BUCKET(index_ptr, hashval);
+            }
+        }
+    }
+    if (pred_ptr->ref_count != 0 || pred_ptr->retr_count != 0) {
+        pred_ptr->time_stamp++;
+    }
+    count = retract_matching_clauses(pred_ptr, bucket_ptr->list, head_ptr, arity);
+    return unify(Count, MAKEINT(count));
+}
+
 /** top level, called by Prolog **/
 int c_initialize_interpreted_pred()
 {
@@ -402,6 +605,37 @@ int c_initialize_interpreted_pred()
     return (initialize_interpreted_pred(sym_ptr, type, size) == NULL) ? BP_ERROR : BP_TRUE;
 }
 
+/* c_INCREMENTAL_DYNAMIC_cc(F,N): declare F/N an incremental dynamic predicate,
+   whose changes remove the tabled subgoals that depend on it */
+int c_INCREMENTAL_DYNAMIC_cc()
+{
+    SYM_REC_PTR sym_ptr;
+    InterpretedPredPtr pred_ptr;
+    BPLONG f, n, pred;
+
+    f = ARG(1, 2); DEREF(f);
+    n = ARG(2, 2); DEREF(n);
+    if (!ISATOM(f) || !ISINT(n)) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    GET_GLOBAL_SYM(f, n, sym_ptr);
+    pred = (BPLONG)GET_EP(sym_ptr);
+    if (IS_INTERPRETED_PRED(pred)) {
+        if (GET_ETYPE(sym_ptr) == T_ORDI) {
+            GET_ETYPE(sym_ptr) = T_DYNA;
+        }
+        pred_ptr = INTERPRETED_PRED_PTR(pred);
+    } else if (GET_ETYPE(sym_ptr) == T_ORDI) {
+        pred_ptr = initialize_interpreted_pred(sym_ptr, T_DYNA, dyn_hashtable_size);
+        if (pred_ptr == NULL) return BP_ERROR;
+    } else {
+        bp_exception = c_permission_error(et_MODIFY, et_STATIC_PROCEDURE, c_error_src(GET_NAME(sym_ptr), INTVAL(n)));
+        return BP_ERROR;
+    }
+    return register_incremental_pred(pred_ptr);
+}
+
 /***************************************************************************/
 int b_ASSERTA_cc(BPLONG Head, BPLONG Body)
 {
@@ -543,6 +777,10 @@ InterpretedPredPtr new_interpreted_pred_record(size)
     pred_ptr->cl_count = 0;
     pred_ptr->time_stamp = 0;
     pred_ptr->bucket_size = size;
+    pred_ptr->arity = 0;
+    pred_ptr->arg_indexes = NULL;
+    pred_ptr->incremental = 0;
+    pred_ptr->table_dependents = NULL;
     pred_ptr->hashtable = new_interpreted_pred_hashtable(size);
     if (pred_ptr->hashtable == NULL) return NULL;
     return pred_ptr;
@@ -578,16 +816,15 @@ BPLONG type, size;
 
 
 /*
-  extend the hashtable when the number of clauses exceeds 2*(the hashtable size),
+  extend the hashtable when the number of clauses exceeds the hashtable size,
   reusing the old hashtable as possible:
 
-  1. Move all the clauses list to the new hashtable as it is.
-  2. Move all bucket records to the new hashtable. add (newsize-oldsize) bucket records.
-  3. Move the last chain (hashtable+oldsize) to the new hashtable. For each clause whose hash value is 0,
-  add a list cell to each of the newly added chains (oldsize+1,oldsize+2,...,newsize)
-  4. Move the other chains to the new hashtable.
-  5. The list structures are kept the same. Let (C1,C2) be a list. If C1 is deleted,
-  C2 is the next clause after C1 after copy.
+  1. Move the chain of all clauses (old_size) to the new hashtable as it is.
+  2. Release the cells of the other chains and reuse their bucket records. Add
+  (newsize-oldsize) bucket records.
+  3. Re-insert the clauses, following the chain of all clauses, so that every chain
+  keeps the order of the clauses. A clause whose first argument is a variable is
+  added to every chain.
 */
 int rehash_interpreted_pred(pred_ptr)
     InterpretedPredPtr pred_ptr;
@@ -611,8 +848,8 @@ int rehash_interpreted_pred(pred_ptr)
     pred_ptr->hashtable = new_hashtable;
     pred_ptr->bucket_size = new_size;
 
-    FOLLOW(new_hashtable+new_size) = FOLLOW(old_hashtable+old_size);  /* the last chain is the same */
-    /* release cells in the old table except the last chain*/
+    FOLLOW(new_hashtable+new_size) = FOLLOW(old_hashtable+old_size);  /* the chain of all clauses is the same */
+    /* release cells in the old table except the chain of all clauses */
     for (i = 0; i < old_size; i++) {
         bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(old_hashtable+i);
         list = bucket_ptr->list;
@@ -632,7 +869,7 @@ int rehash_interpreted_pred(pred_ptr)
         }
     }
 
-    /* re-assert all the clauses on the chain (old_size) */
+    /* re-assert all the clauses on the chain of all clauses */
     bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(new_hashtable+new_size);
     list = bucket_ptr->list;
     while (ISLIST(list)) {
@@ -648,15 +885,223 @@ int rehash_interpreted_pred(pred_ptr)
             }
         } else {
             bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(new_hashtable+(hashval%new_size));
-            if (assertz_clause_record(bucket_ptr, clause_record) == NULL) return BP_ERROR;
+            clause_record_ptr->bucket_ref = assertz_clause_record(bucket_ptr, clause_record);
+            if (clause_record_ptr->bucket_ref == NULL) return BP_ERROR;
         }
     }
     free(old_hashtable);
     return BP_TRUE;
 }
 
+/***************************************************************************/
+/* Indexes on the 2nd, 3rd, ... arguments. An index on an argument is built the first
+   time a call that binds the argument needs it, and is then maintained by assert and
+   retract. As in the first-argument index, a clause whose argument is a variable is in
+   every bucket, so the index has fewer buckets when there are many such clauses. An
+   index whose buckets have grown too large is dropped, and a new one is built by the
+   next call that needs it.
+*/
+BPLONG hashval_of_clause_arg(InterpretedClausePtr clause_record_ptr, BPLONG arg_no) {
+    BPLONG head, arg, hashcode;
+
+    head = clause_record_ptr->head;
+    if (ISATOM(head)) return 0;
+    arg = FOLLOW((BPLONG_PTR)UNTAGGED_ADDR(head)+arg_no);  /* arg(ArgNo,Head,Arg) */
+
+    BP_HASH_CODE1(arg, hashcode, lab);
+    NONVAR_HASH_CODE(arg, hashcode);
+    return hashcode;
+}
+
+void free_arg_index(InterpretedPredPtr pred_ptr, BPLONG arg_no) {
+    InterpretedArgIndexPtr index_ptr;
+    BPLONG i;
+
+    index_ptr = (InterpretedArgIndexPtr)FOLLOW(pred_ptr->arg_indexes+arg_no);
+    for (i = 0; i < index_ptr->size; i++) {
+        release_bucket_cells(pred_ptr, index_ptr->buckets+i);
+    }
+    free(index_ptr->buckets);
+    free(index_ptr);
+    FOLLOW(pred_ptr->arg_indexes+arg_no) = (BPLONG)NULL;
+}
+
+void free_arg_indexes(InterpretedPredPtr pred_ptr) {
+    BPLONG i;
+
+    if (pred_ptr->arg_indexes == NULL) return;
+    for (i = 2; i <= pred_ptr->arity; i++) {
+        if (FOLLOW(pred_ptr->arg_indexes+i) != (BPLONG)NULL) {
+            free_arg_index(pred_ptr, i);
+        }
+    }
+    free(pred_ptr->arg_indexes);
+    pred_ptr->arg_indexes = NULL;
+    pred_ptr->arity = 0;
+}
+
+/* remember the containing cell of the clause record in the index on argument arg_no */
+static int set_clause_arg_ref(InterpretedPredPtr pred_ptr, InterpretedClausePtr clause_record_ptr, BPLONG arg_no, BPLONG_PTR cell_ptr) {
+    BPLONG_PTR ptr;
+    BPLONG i;
+
+    if (cell_ptr == NULL) return BP_ERROR;
+    if (clause_record_ptr->arg_refs == NULL) {
+        ALLOCATE_RECORD_IN_ASSERT(ptr, pred_ptr->arity+1);
+        if (ptr == NULL) {
+            bp_exception = et_OUT_OF_MEMORY;
+            return BP_ERROR;
+        }
+        for (i = 0; i <= pred_ptr->arity; i++) {
+            FOLLOW(ptr+i) = (BPLONG)NULL;
+        }
+        clause_record_ptr->arg_refs = ptr;
+    }
+    FOLLOW(clause_record_ptr->arg_refs+arg_no) = (BPLONG)cell_ptr;
+    return BP_TRUE;
+}
+
+/* add a clause to an argument index, at the front or at the end of the chains */
+static int add_clause_to_arg_index(InterpretedPredPtr pred_ptr, InterpretedArgIndexPtr index_ptr, BPLONG arg_no, BPLONG clause_record, int at_front) {
+    InterpretedClausePtr clause_record_ptr;
+    InterpretedPredBucketPtr bucket_ptr;
+    BPLONG_PTR cell_ptr;
+    BPLONG i, hashval;
+
+    clause_record_ptr = (InterpretedClausePtr)UNTAGGED_ADDR(clause_record);
+    hashval = hashval_of_clause_arg(clause_record_ptr, arg_no);
+    index_ptr->count++;
+    if (hashval == 0) {
+        index_ptr->var_count++;
+        for (i = 0; i < index_ptr->size; i++) {
+            bucket_ptr = index_ptr->buckets+i;
+            cell_ptr = at_front ? asserta_clause_record(bucket_ptr, clause_record) : assertz_clause_record(bucket_ptr, clause_record);
+            if (cell_ptr == NULL) return BP_ERROR;
+        }
+        return BP_TRUE;
+    }
+    bucket_ptr = ARG_INDEX_BUCKET(index_ptr, hashval);
+    cell_ptr = at_front ? asserta_clause_record(bucket_ptr, clause_record) : assertz_clause_record(bucket_ptr, clause_record);
+    return set_clause_arg_ref(pred_ptr, clause_record_ptr, arg_no, cell_ptr);
+}
 
-/* Recall that a clause record is a Prolog structure in the form struct(CellRef,Head,Body,Birth,Death)
+/* return the index on argument arg_no, building it from the chain of all clauses if
+   it does not exist yet; return NULL if no memory is available for the index */
+InterpretedArgIndexPtr get_arg_index(InterpretedPredPtr pred_ptr, BPLONG arg_no, BPLONG arity) {
+    InterpretedArgIndexPtr index_ptr;
+    InterpretedPredBucketPtr bucket_ptr;
+    BPLONG_PTR cell_ptr;
+    BPLONG i, size, list, var_count;
+
+    if (pred_ptr->arg_indexes == NULL) {
+        pred_ptr->arg_indexes = (BPLONG_PTR)malloc(sizeof(BPLONG)*(arity+1));
+        if (pred_ptr->arg_indexes == NULL) return NULL;
+        for (i = 0; i <= arity; i++) {
+            FOLLOW(pred_ptr->arg_indexes+i) = (BPLONG)NULL;
+        }
+        pred_ptr->arity = arity;
+    }
+    index_ptr = (InterpretedArgIndexPtr)FOLLOW(pred_ptr->arg_indexes+arg_no);
+    if (index_ptr != NULL) return index_ptr;
+
+    bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(pred_ptr->hashtable+pred_ptr->bucket_size);
+    var_count = 0;
+    for (list = bucket_ptr->list; ISLIST(list); list = FOLLOW(cell_ptr+1)) {
+        cell_ptr = (BPLONG_PTR)UNTAGGED_ADDR(list);
+        if (hashval_of_clause_arg((InterpretedClausePtr)UNTAGGED_ADDR(FOLLOW(cell_ptr)), arg_no) == 0) var_count++;
+    }
+
+    index_ptr = (InterpretedArgIndexPtr)malloc(sizeof(InterpretedArgIndex));
+    if (index_ptr == NULL) return NULL;
+    /* the clauses whose argument is a variable are copied into every bucket, so the
+       buckets hold at most twice as many cells as there are clauses */
+    size = bp_hsize(pred_ptr->cl_count/(var_count+1));
+    index_ptr->buckets = (InterpretedPredBucketPtr)malloc(sizeof(InterpretedPredBucket)*size);
+    if (index_ptr->buckets == NULL) {
+        free(index_ptr);
+        return NULL;
+    }
+    index_ptr->size = size;
+    index_ptr->count = 0;
+    index_ptr->var_count = 0;
+    index_ptr->limit = 4*((pred_ptr->cl_count > ARG_INDEX_MIN_CLAUSES) ? pred_ptr->cl_count : ARG_INDEX_MIN_CLAUSES);
+    for (i = 0; i < size; i++) {
+        index_ptr->buckets[i].tail = NULL;
+        index_ptr->buckets[i].list = nil_sym;
+    }
+    FOLLOW(pred_ptr->arg_indexes+arg_no) = (BPLONG)index_ptr;
+
+    list = bucket_ptr->list;
+    while (ISLIST(list)) {
+        cell_ptr = (BPLONG_PTR)UNTAGGED_ADDR(list);
+        list = FOLLOW(cell_ptr+1);
+        if (add_clause_to_arg_index(pred_ptr, index_ptr, arg_no, FOLLOW(cell_ptr), 0) == BP_ERROR) {
+            bp_exception = (BPLONG)NULL;
+            free_arg_index(pred_ptr, arg_no);
+            return NULL;
+        }
+    }
+    return index_ptr;
+}
+
+/* add a newly asserted clause to the existing indexes on the other arguments */
+int add_clause_to_arg_indexes(InterpretedPredPtr pred_ptr, BPLONG clause_record, int at_front) {
+    InterpretedArgIndexPtr index_ptr;
+    BPLONG i;
+
+    for (i = 2; i <= pred_ptr->arity; i++) {
+        index_ptr = (InterpretedArgIndexPtr)FOLLOW(pred_ptr->arg_indexes+i);
+        if (index_ptr == NULL) continue;
+        if (ARG_INDEX_CELLS(index_ptr) >= index_ptr->limit) {
+            free_arg_index(pred_ptr, i);
+            continue;
+        }
+        if (add_clause_to_arg_index(pred_ptr, index_ptr, i, clause_record, at_front) == BP_ERROR) return BP_ERROR;
+    }
+    return BP_TRUE;
+}
+
+/* the length of the chain, or max if the chain has max or more cells */
+static BPLONG chain_length(BPLONG list, BPLONG max) {
+    BPLONG len = 0;
+
+    while (ISLIST(list) && len < max) {
+        len++;
+        list = FOLLOW((BPLONG_PTR)UNTAGGED_ADDR(list)+1);
+    }
+    return len;
+}
+
+/* Return the clauses for a call with arity arguments. list is the chain given by the
+   first argument, which is the chain of all clauses if the argument is a variable. If
+   that chain is long, the chains for the other bound arguments are looked up in their
+   indexes, and the shortest one is returned. */
+static BPLONG clauses_by_arg_index(InterpretedPredPtr pred_ptr, BPLONG_PTR head_ptr, BPLONG arity, BPLONG list) {
+    InterpretedArgIndexPtr index_ptr;
+    BPLONG arg, hashval, best_list, best_len, len;
+    BPLONG j;
+
+    if (chain_length(list, ARG_INDEX_MIN_CLAUSES) < ARG_INDEX_MIN_CLAUSES) return list;
+    best_list = list;
+    best_len = BP_MAXINT_1W;
+    for (j = 2; j <= arity; j++) {
+        arg = FOLLOW(head_ptr+j);
+        BP_HASH_CODE1(arg, hashval, lab_argj);
+        NONVAR_HASH_CODE(arg, hashval);
+        if (hashval == 0) continue;
+        index_ptr = get_arg_index(pred_ptr, j, arity);
+        if (index_ptr == NULL) continue;
+        len = chain_length(ARG_INDEX_BUCKET(index_ptr, hashval)->list, best_len);
+        if (len < best_len) {
+            best_list = ARG_INDEX_BUCKET(index_ptr, hashval)->list;
+            best_len = len;
+        }
+    }
+    if (best_list != list && chain_length(list, best_len+1) <= best_len) return list;
+    return best_list;
+}
+
+/* Recall that a clause record is a Prolog structure in the form struct(CellRef,Head,Body,Birth,Death,BucketRef,ArgRefs)
    where CellRef is used to reference the enclosing d-list cell */
 BPLONG create_clause_record(pred_ptr, head, body)
     InterpretedPredPtr pred_ptr;
@@ -680,6 +1125,8 @@ BPLONG head, body;
     clause_record_ptr->body = tmp;
     clause_record_ptr->birth_time_stamp = pred_ptr->time_stamp;
     clause_record_ptr->death_time_stamp = BP_MAXINT_1W;
+    clause_record_ptr->bucket_ref = NULL;
+    clause_record_ptr->arg_refs = NULL;
     return clause_record;
 }
 
@@ -718,32 +1165,34 @@ BPLONG head, body;
     BPLONG clause_record;
     BPLONG_PTR hashtable, cell_ptr;
     InterpretedPredBucketPtr bucket_ptr;
-    int i, hashval;
+    BPLONG hashval, i;
     InterpretedClausePtr clause_record_ptr;
 
+    INVALIDATE_TABLE_DEPENDENTS(pred_ptr);
     hashtable = pred_ptr->hashtable;
     pred_ptr->cl_count++;
     clause_record = create_clause_record(pred_ptr, head, body);
     if (clause_record == BP_ERROR) return BP_ERROR;
     clause_record_ptr = (InterpretedClausePtr)UNTAGGED_ADDR(clause_record);
 
-    hashval = hashval_in_assert(clause_record_ptr);
-    if (hashval == 0) {  /* no arg or first arg is var */
-        for (i = 0; i < pred_ptr->bucket_size; i++) {
-            bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(hashtable+i);
-            if (asserta_clause_record(bucket_ptr, clause_record) == NULL) return BP_ERROR;
-        }
-    } else {
-        if (pred_ptr->bucket_size != 0) {  /* how can pred_ptr->bucket_size be 0? */
-            i = hashval%pred_ptr->bucket_size;
-            bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(hashtable+i);
-            if (asserta_clause_record(bucket_ptr, clause_record) == NULL) return BP_ERROR;
+    if (pred_ptr->bucket_size != 0) {  /* how can pred_ptr->bucket_size be 0? */
+        hashval = hashval_in_assert(clause_record_ptr);  /* 0 if no arg or first arg is var */
+        if (hashval == 0) {
+            for (i = 0; i < pred_ptr->bucket_size; i++) {
+                bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(hashtable+i);
+                if (asserta_clause_record(bucket_ptr, clause_record) == NULL) return BP_ERROR;
+            }
+        } else {
+            bucket_ptr = FIRST_ARG_BUCKET(pred_ptr, hashval);
+            clause_record_ptr->bucket_ref = asserta_clause_record(bucket_ptr, clause_record);
+            if (clause_record_ptr->bucket_ref == NULL) return BP_ERROR;
         }
     }
     bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(hashtable+pred_ptr->bucket_size);
     cell_ptr = asserta_clause_record(bucket_ptr, clause_record);
     if (cell_ptr == NULL) return BP_ERROR;
-    clause_record_ptr->cl_ref = ADDTAG((BPLONG)cell_ptr, INT_TAG);  /* struct(CellRef,Head,Body,Birth,Death) */
+    clause_record_ptr->cl_ref = ADDTAG((BPLONG)cell_ptr, INT_TAG);  /* struct(CellRef,Head,Body,Birth,Death,Seq) */
+    if (pred_ptr->arg_indexes != NULL) return add_clause_to_arg_indexes(pred_ptr, clause_record, 1);
     return BP_TRUE;
 }
 
@@ -783,49 +1232,45 @@ BPLONG head, body;
     BPLONG clause_record;
     BPLONG_PTR hashtable;
     InterpretedPredBucketPtr bucket_ptr;
-    int i, hashval;
+    BPLONG hashval, i;
     BPLONG_PTR cell_ptr;
     InterpretedClausePtr clause_record_ptr;
 
     //  printf("=>assertz_interpreted_pred pred_ptr=%x",pred_ptr); write_term(head); write_term(body); printf("\n");
 
+    INVALIDATE_TABLE_DEPENDENTS(pred_ptr);
     hashtable = pred_ptr->hashtable;
     pred_ptr->cl_count++;
     clause_record = create_clause_record(pred_ptr, head, body);
     if (clause_record == BP_ERROR) return BP_ERROR;
 
     clause_record_ptr = (InterpretedClausePtr)UNTAGGED_ADDR(clause_record);
-    hashval = hashval_in_assert(clause_record_ptr);
-    if (hashval == 0) {  /* no arg or first arg is var */
-        for (i = 0; i < pred_ptr->bucket_size; i++) {
-            bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(hashtable+i);
-            if (assertz_clause_record(bucket_ptr, clause_record) == NULL) return BP_ERROR;
-        }
-    } else {
-        if (pred_ptr->bucket_size != 0) {
-            i = hashval%pred_ptr->bucket_size;
-            bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(hashtable+i);
-            if (assertz_clause_record(bucket_ptr, clause_record) == NULL) return BP_ERROR;
+
+    if (pred_ptr->bucket_size != 0) {
+        hashval = hashval_in_assert(clause_record_ptr);  /* 0 if no arg or first arg is var */
+        if (hashval == 0) {
+            for (i = 0; i < pred_ptr->bucket_size; i++) {
+                bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(hashtable+i);
+                if (assertz_clause_record(bucket_ptr, clause_record) == NULL) return BP_ERROR;
+            }
+        } else {
+            bucket_ptr = FIRST_ARG_BUCKET(pred_ptr, hashval);
+            clause_record_ptr->bucket_ref = assertz_clause_record(bucket_ptr, clause_record);
+            if (clause_record_ptr->bucket_ref == NULL) return BP_ERROR;
         }
     }
     bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(hashtable+pred_ptr->bucket_size);
     cell_ptr = assertz_clause_record(bucket_ptr, clause_record);
     if (cell_ptr == NULL) return BP_ERROR;
-    clause_record_ptr->cl_ref = ADDTAG((BPLONG)cell_ptr, INT_TAG);  /* struct(CellRef,Head,Body,Birth,Death) */
+    clause_record_ptr->cl_ref = ADDTAG((BPLONG)cell_ptr, INT_TAG);  /* struct(CellRef,Head,Body,Birth,Death,Seq) */
+    if (pred_ptr->arg_indexes != NULL) return add_clause_to_arg_indexes(pred_ptr, clause_record, 0);
     return BP_TRUE;
 }
 
 BPLONG hashval_in_assert(clause_record_ptr)
     InterpretedClausePtr clause_record_ptr;
 {
-    BPLONG head, arg1, hashcode;
-
-    head = clause_record_ptr->head;
-    if (ISATOM(head)) return 0;
-    arg1 = FOLLOW((BPLONG_PTR)UNTAGGED_ADDR(head)+1);  /* arg(1,Head,Arg1) */
-
-    BP_HASH_CODE1(arg1, hashcode, lab);
-    return hashcode;
+    return hashval_of_clause_arg(clause_record_ptr, 1);
 }
 
 int b_ASSERTABLE_c(Head)
@@ -917,26 +1362,31 @@ int b_GET_CLAUSES_cfff(Head, Clauses, Key, TimeStamp)
     SYM_REC_PTR sym_ptr;
     BPLONG_PTR top;
     InterpretedPredPtr pred_ptr;
-    BPLONG pred, arg1, arg1_key;
+    BPLONG pred, arg1, arg1_key, hashval, list;
     InterpretedPredBucketPtr bucket_ptr;
-    int i;
 
     DEREF(Head);
     sym_ptr = GET_SYM_REC(Head);
     pred = (BPLONG)GET_EP(sym_ptr);
     pred_ptr = INTERPRETED_PRED_PTR(pred);
+    if (pred_ptr->incremental) table_note_dynamic_call(pred_ptr);
+    bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(pred_ptr->hashtable+pred_ptr->bucket_size);
+    list = bucket_ptr->list;  /* all the clauses */
+    arg1_key = BP_ZERO;
     if (pred_ptr->bucket_size != 0 && ISSTRUCT(Head)) {
         arg1 = FOLLOW((BPLONG_PTR)UNTAGGED_ADDR(Head)+1);  /* arg(1,Head,Arg1) */
-        BP_HASH_KEY1_CODE1(arg1, arg1_key, i, lab1);
-        ASSIGN_f_atom(Key, arg1_key);
-        if (i == 0) i = pred_ptr->bucket_size; else i = i%pred_ptr->bucket_size;
-    } else {
-        i = pred_ptr->bucket_size;
-        ASSIGN_f_atom(Key, BP_ZERO);
+        BP_HASH_KEY1_CODE1(arg1, arg1_key, hashval, lab1);
+        NONVAR_HASH_CODE(arg1, hashval);
+        if (hashval != 0) {
+            list = FIRST_ARG_BUCKET(pred_ptr, hashval)->list;
+        }
+        if (pred_ptr->cl_count >= ARG_INDEX_MIN_CLAUSES) {
+            list = clauses_by_arg_index(pred_ptr, (BPLONG_PTR)UNTAGGED_ADDR(Head), GET_ARITY(sym_ptr), list);
+        }
     }
-    bucket_ptr = (InterpretedPredBucketPtr)FOLLOW(pred_ptr->hashtable+i);
+    ASSIGN_f_atom(Key, arg1_key);
     ASSIGN_f_atom(TimeStamp, MAKEINT(pred_ptr->time_stamp));
-    ASSIGN_sv_heap_term(Clauses, bucket_ptr->list);
+    ASSIGN_sv_heap_term(Clauses, list);
     return BP_TRUE;
 }
 
@@ -945,6 +1395,8 @@ void Cboot_assert() {
     insert_cpred("c_initialize_interpred", 4, c_initialize_interpreted_pred);
     insert_cpred("c_set_dyn_hashtable_size", 1, c_set_dyn_hashtable_size);
     insert_cpred("c_print_pred_ref_count", 2, c_print_pred_ref_count);
+    insert_cpred("c_RETRACTALL_cf", 2, c_RETRACTALL_cf);
+    insert_cpred("c_INCREMENTAL_DYNAMIC_cc", 2, c_INCREMENTAL_DYNAMIC_cc);
 }
 
 /***************************************************************************/
@@ -1082,37 +1534,72 @@ BPLONG numberVarCopyCommaToParea(term, varno)
 void init_picat_global_maps() {
     BPLONG i;
 
-    for (i = 0; i < NUM_PICAT_GLOBAL_MAPS; i++) {
-        picat_global_maps[i] = NULL;
+    if (picat_global_maps == NULL) {
+        picat_global_maps_capacity = NUM_PICAT_GLOBAL_MAPS;
+        picat_global_maps = (BPLONG_PTR *)malloc(sizeof(BPLONG_PTR)*picat_global_maps_capacity);
+        picat_global_map_ids = (BPLONG *)malloc(sizeof(BPLONG)*picat_global_maps_capacity);
+        picat_global_map_index_size = NUM_PICAT_GLOBAL_MAPS;
+        picat_global_map_index = (BPLONG *)malloc(sizeof(BPLONG)*picat_global_map_index_size);
+        if (picat_global_maps == NULL || picat_global_map_ids == NULL || picat_global_map_index == NULL)
+            myquit(OUT_OF_MEMORY, "global_maps");
+    }
+    num_picat_global_maps = 0;
+    for (i = 0; i < picat_global_map_index_size; i++) {
+        picat_global_map_index[i] = 0;
+    }
+}
+
+/* Rebuild the id index with about three times as many slots */
+static void expand_picat_global_map_index() {
+    BPLONG new_size, i, slot_i, this_hcode;
+    BPLONG *new_index;
+
+    new_size = bp_hsize(3*picat_global_map_index_size);
+    new_index = (BPLONG *)malloc(sizeof(BPLONG)*new_size);
+    if (new_index == NULL) myquit(OUT_OF_MEMORY, "global_maps");
+    for (i = 0; i < new_size; i++) {
+        new_index[i] = 0;
+    }
+    for (i = 0; i < num_picat_global_maps; i++) {
+        this_hcode = bp_hashval(picat_global_map_ids[i]);
+        slot_i = this_hcode % new_size;
+        while (new_index[slot_i] != 0) {
+            slot_i++;
+            if (slot_i == new_size) slot_i = 0;
+        }
+        new_index[slot_i] = i+1;
     }
+    free(picat_global_map_index);
+    picat_global_map_index = new_index;
+    picat_global_map_index_size = new_size;
 }
 
 /* Return the number of the map with map_id. If no map with the id was found,
    then create a new map and register it into global_maps. Linear prob is used
-   to look for the map with map_id.
+   to look for the map with map_id in the id index.
 
    Each entry in global_maps is a pointer to a MAP_RECORD, which stores the
    information about the map, including the size of the bucket table, the number
    of key-value pairs (count), and a pointer to the bucket table (htable).
 */
 int b_GET_PICAT_GLOBAL_MAP_cf(BPLONG map_id, BPLONG map_num) {
-    BPLONG slot_i0, slot_i, i, map_id_cp, this_hcode, varno;
+    BPLONG slot_i, i, map_id_cp, this_hcode, varno, num;
     BPLONG_PTR tmp_ptr;
     MAP_RECORD_PTR map_ptr;
 
     this_hcode = bp_hashval(map_id);
-    slot_i0 = slot_i = (this_hcode % NUM_PICAT_GLOBAL_MAPS);
+    slot_i = (this_hcode % picat_global_map_index_size);
 
     // linear prob
-    while ((BPLONG_PTR)picat_global_maps[slot_i] != NULL) {
-        if (key_identical(picat_global_map_ids[slot_i], map_id)) {
-            return unify(map_num, MAKEINT(slot_i));
+    while (picat_global_map_index[slot_i] != 0) {
+        num = picat_global_map_index[slot_i]-1;
+        if (key_identical(picat_global_map_ids[num], map_id)) {
+            return unify(map_num, MAKEINT(num));
         }
         slot_i++;
-        if (slot_i == NUM_PICAT_GLOBAL_MAPS) slot_i = 0;
-        if (slot_i == slot_i0) quit("GLOBAL MAPS OVERFLOW");
+        if (slot_i == picat_global_map_index_size) slot_i = 0;
     }
-    // Come here if map_id was not found. Register a map in slot i
+    // Come here if map_id was not found. Register a new map
     varno = 0;
     map_id_cp = numberVarCopyToParea(map_id, &varno);
     if (map_id_cp == BP_ERROR) return BP_ERROR;
@@ -1121,6 +1608,20 @@ int b_GET_PICAT_GLOBAL_MAP_cf(BPLONG map_id, BPLONG map_num) {
         return BP_ERROR;
     }
 
+    if (num_picat_global_maps == picat_global_maps_capacity) {
+        BPLONG new_capacity = 2*picat_global_maps_capacity;
+        BPLONG_PTR *new_maps;
+        BPLONG *new_ids;
+
+        new_maps = (BPLONG_PTR *)realloc(picat_global_maps, sizeof(BPLONG_PTR)*new_capacity);
+        if (new_maps == NULL) myquit(OUT_OF_MEMORY, "global_maps");
+        picat_global_maps = new_maps;
+        new_ids = (BPLONG *)realloc(picat_global_map_ids, sizeof(BPLONG)*new_capacity);
+        if (new_ids == NULL) myquit(OUT_OF_MEMORY, "global_maps");
+        picat_global_map_ids = new_ids;
+        picat_global_maps_capacity = new_capacity;
+    }
+
     ALLOCATE_FROM_PAREA(tmp_ptr, sizeof(MAP_RECORD)/sizeof(BPLONG));
     if (tmp_ptr == NULL) myquit(OUT_OF_MEMORY, "global_maps");
     map_ptr = (MAP_RECORD_PTR)tmp_ptr;
@@ -1131,10 +1632,13 @@ int b_GET_PICAT_GLOBAL_MAP_cf(BPLONG map_id, BPLONG map_num) {
     for (i = 0; i < 7; i++)
         FOLLOW(tmp_ptr+i) = (BPLONG)NULL;
 
-    picat_global_maps[slot_i] = (BPLONG_PTR)map_ptr;
-
-    picat_global_map_ids[slot_i] = map_id_cp;
-    return unify(map_num, MAKEINT(slot_i));
+    num = num_picat_global_maps++;
+    picat_global_maps[num] = (BPLONG_PTR)map_ptr;
+    picat_global_map_ids[num] = map_id_cp;
+    picat_global_map_index[slot_i] = num+1;
+    if (2*num_picat_global_maps > picat_global_map_index_size)
+        expand_picat_global_map_index();
+    return unify(map_num, MAKEINT(num));
 }
 
 void expand_picat_global_map(MAP_RECORD_PTR mr_ptr) {
@@ -1214,7 +1718,7 @@ int b_PICAT_GLOBAL_MAP_PUT_ccc(BPLONG map_num, BPLONG key, BPLONG val) {
     key_cp = numberVarCopyToParea(key, &varno);
     if (key_cp == BP_ERROR) return BP_ERROR;
 
-    ALLOCATE_FROM_PAREA(tmp_ptr, sizeof(KEY_VAL_PAIR)/sizeof(BPLONG));
+    ALLOCATE_RECORD_IN_ASSERT(tmp_ptr, sizeof(KEY_VAL_PAIR)/sizeof(BPLONG));
     if (tmp_ptr == NULL) myquit(OUT_OF_MEMORY, "global_maps");
     kvp_ptr = (KEY_VAL_PAIR_PTR)tmp_ptr;
     kvp_ptr->key = key_cp;
@@ -1285,11 +1789,15 @@ int b_PICAT_GLOBAL_MAP_CLEAR_c(BPLONG map_num) {
     mr_ptr-> count = 0;
     htable = mr_ptr->htable;
     for (i = 0; i < mr_ptr->size; i++) {
-        BPLONG term = FOLLOW(htable+i);
-        if (term != (BPLONG)NULL) {
-            release_term_space(term);
-            FOLLOW(htable+i) = (BPLONG)NULL;
+        KEY_VAL_PAIR_PTR kvp_ptr = (KEY_VAL_PAIR_PTR)FOLLOW(htable+i);
+        while (kvp_ptr != NULL) {
+            KEY_VAL_PAIR_PTR next_kvp_ptr = (KEY_VAL_PAIR_PTR)kvp_ptr->next;
+            release_term_space(kvp_ptr->key);
+            release_term_space(kvp_ptr->val);
+            RELEASE_FREE_RECORD((BPLONG_PTR)kvp_ptr, sizeof(KEY_VAL_PAIR)/sizeof(BPLONG));
+            kvp_ptr = next_kvp_ptr;
         }
+        FOLLOW(htable+i) = (BPLONG)NULL;
     }
     return BP_TRUE;
 }
@@ -58,6 +58,9 @@
 #define C_PRED 3  /* c function */
 #define T_INTP 4  /* interpreted */
 #define T_TEMP_PRED 15  /* psc entry for predicate containing offset entry point */
+#define SYM_SPY 0x1  /* flag: a spy point */
+#define SYM_SEMI_NAIVE 0x2  /* flag: a tabled predicate evaluated semi-naively, see table.c */
+#define SYM_SHARED 0x4  /* flag: a tabled predicate shared through the table store, see table.c */
 #define STACK_OVERFLOW 1
 #define TRAIL_OVERFLOW 2
 #define PAREA_OVERFLOW 3
@@ -118,7 +121,7 @@ typedef struct sym_rec *SYM_REC_PTR;
 
 typedef struct sym_rec {
     BYTE etype;
-    BYTE spy;
+    BYTE flags;  /* SYM_SPY, SYM_SEMI_NAIVE, SYM_SHARED */
     UW16 length;
     UW32 arity;
     CHAR_PTR nameptr;
@@ -138,7 +141,16 @@ typedef struct event_func_data {
    cl_count :    Number of clauses in the predicate
    bucket_size : Hashtable size. Initial value = number of clauses if static; 3 if dynamic
    Hashtable size is doubled automatically if the count is greater than bucket_size.
-   hashtable:    Pointer to the hashtable
+   hashtable:    Pointer to the hashtable. Buckets 0..bucket_size-1 hold the clauses by the hash
+                 value of the first argument, and bucket bucket_size holds all the clauses. A clause
+                 whose first argument is a variable is in every bucket, so each chain holds all
+                 the candidates for a call in the order of the clauses.
+   arity:        Number of slots in arg_indexes minus one.
+   arg_indexes:  NULL, or an array of pointers to the indexes on the 2nd, 3rd, ... arguments,
+                 which are built on demand when a call binds the argument (InterpretedArgIndex).
+   incremental:  1 if a change to the predicate invalidates the tabled subgoals that called it.
+   table_dependents: cells [subgoal,next] in the table area of the tabled subgoals that called
+                 the predicate, if it is incremental.
 */
 typedef struct {
     BPLONG ref_count;
@@ -147,6 +159,10 @@ typedef struct {
     BPLONG time_stamp;
     BPLONG bucket_size;
     BPLONG_PTR hashtable;
+    BPLONG arity;
+    BPLONG_PTR arg_indexes;
+    BPLONG incremental;
+    BPLONG_PTR table_dependents;
 } InterpretedPred;
 
 typedef InterpretedPred *InterpretedPredPtr;
@@ -162,12 +178,33 @@ typedef struct {
 
 typedef InterpretedPredBucket *InterpretedPredBucketPtr;
 
+/* an index on an argument other than the first one:
+   size:      number of buckets
+   count:     number of clauses in the index
+   var_count: number of the clauses whose argument is a variable, which are in every bucket
+   limit:     the index is dropped when its buckets hold more cells than this
+   buckets:   buckets 0..size-1 hold the clauses by the hash value of the argument
+*/
+typedef struct {
+    BPLONG size;
+    BPLONG count;
+    BPLONG var_count;
+    BPLONG limit;
+    InterpretedPredBucketPtr buckets;
+} InterpretedArgIndex;
+
+typedef InterpretedArgIndex *InterpretedArgIndexPtr;
+
 /* each clause record contains the following fields:
    cl_ref:           reference to the containing cell of the record
    head:             head of the clause
    body:             body of the clause
    birth_time_stamp: time it was asserted
    death_time_stamp: time it was retracted
+   bucket_ref:       the containing cell of the record in the first-argument index, or NULL if
+                     the first argument is a variable
+   arg_refs:         NULL, or a record of the containing cells in the indexes on the other
+                     arguments (NULL for an argument that is a variable)
 */
 typedef struct {
     BPLONG cl_ref;
@@ -175,6 +212,8 @@ typedef struct {
     BPLONG body;
     BPLONG birth_time_stamp;
     BPLONG death_time_stamp;
+    BPLONG_PTR bucket_ref;
+    BPLONG_PTR arg_refs;
 } InterpretedClause;
 typedef InterpretedClause *InterpretedClausePtr;
 
@@ -199,7 +238,7 @@ typedef NUMBERED_TERM_AREA_RECORD *NUMBERED_TERM_AREA_RECORD_PTR;
 /* for global and table maps */
 
 #define NUM_PICAT_TABLE_MAPS 97
-#define NUM_PICAT_GLOBAL_MAPS 97
+#define NUM_PICAT_GLOBAL_MAPS 97  /* initial size of the directory of global maps, which grows */
 
 typedef struct {
     BPLONG key;
@@ -209,10 +248,26 @@ typedef struct {
 
 typedef KEY_VAL_PAIR *KEY_VAL_PAIR_PTR;
 
+typedef struct {
+    BPLONG key;
+    BPLONG val;
+    BPLONG_PTR next;
+    BPLONG ref;     /* set by a lookup, cleared by the clock hand */
+} CLOCK_KEY_VAL_PAIR;
+
+typedef CLOCK_KEY_VAL_PAIR *CLOCK_KEY_VAL_PAIR_PTR;
+
+/* the fields after htable are used by table maps only */
 typedef struct {
     BPLONG size;
     BPLONG count;
     BPLONG_PTR htable;
+    BPLONG capacity;    /* 0 if the map is unbounded */
+    BPLONG in_parea;    /* entries are CLOCK_KEY_VAL_PAIRs whose terms are in the program area */
+    BPLONG hand;        /* the bucket the clock hand points to */
+    BPLONG hits;
+    BPLONG misses;
+    BPLONG evictions;
 } MAP_RECORD;
 
 typedef MAP_RECORD *MAP_RECORD_PTR;
@@ -272,6 +327,30 @@ typedef int (*Builtins)();
 #define EXECUTE_BUILTIN4(res, index, op1, op2, op3, op4) res = (*builtins[index])(op1, op2, op3, op4)
 #endif
 
+/* The state of an engine: its stack/heap area, its trail, and its registers.
+   The engine that runs keeps this state in the global registers; the other
+   engines keep it in their records (see bp_switch_engine in init.c). All
+   engines share the program area, the symbol table, the table area, and the
+   global maps. */
+typedef struct {
+    BPLONG_PTR stack_low_addr, stack_up_addr;
+    BPLONG stack_size;
+    BPLONG_PTR trail_low_addr, trail_up_addr;
+    BPLONG trail_size;
+    BPLONG_PTR trail_water_mark, trail_water_mark0;
+    BPLONG_PTR stack_reserve_low, trail_reserve_low;  /* used only with BP_RESERVE_AREAS */
+    BPLONG stack_reserve_size, trail_reserve_size;
+    BPLONG_PTR arreg, breg, breg0, local_top, heap_top, trail_top, hbreg, sfreg, gc_b, sreg;
+    BPLONG_PTR inst_begin;
+    BPULONG toam_signal_vec;
+    int in_critical_region;
+    int curr_toam_status;
+    BPLONG bp_exception;
+    BPLONG trigger_no;
+} BP_ENGINE, *BP_ENGINE_PTR;
+
+typedef struct bp_engine_pool BP_ENGINE_POOL, *BP_ENGINE_POOL_PTR;  /* see kapi.c */
+
 extern int curr_toam_status;
 
 #ifdef NOINLINE
@@ -284,6 +363,19 @@ extern int curr_toam_status;
 #endif
 #endif
 
+/*
+  Streams are read without stdio locking as long as the process runs the
+  engine from its main thread only.  Once the engine API for threads in
+  kapi.c is initialized (PinitP), the host program's threads may read the
+  same FILEs, so streams_locked is set and every read takes the stream lock.
+*/
+extern int streams_locked;
+#ifdef WIN32
+#define GETC_UNLOCKED(fp) getc(fp)
+#else
+#define GETC_UNLOCKED(fp) (streams_locked ? getc(fp) : getc_unlocked(fp))
+#endif
+
 #include "extern_decl.h"
 
 #define TOAM_NOTSET 0
@@ -306,6 +398,10 @@ extern int confirm_copy_right;
 extern BPLONG n_backtracks;
 extern int use_tabling;
 extern BPLONG_PTR subgoalTable;
+extern NUMBERED_TERM_AREA_RECORD_PTR ta_record_ptr;
+extern BPLONG table_area_gc_limit;
+extern int semi_naive_tabling;
+extern int table_profiling;
 extern BPLONG subgoalTableBucketSize;
 extern BPLONG subgoalTableEntriesCount;
 extern BPLONG InitAnswerTableBucketSize;
@@ -332,6 +428,7 @@ extern BPLONG_PTR cpreg;
 extern CHAR_PTR curr_fence;  /* ptr to next free byte in perm space */
 extern BPLONG_PTR parea_up_addr;  /* ptr to last+1 free byte in perm space */
 extern BPLONG_PTR inst_begin;  /* ptr to the beginning of inst. array */
+extern BPLONG_PTR lib_code_low_addr, lib_code_up_addr;  /* the byte code of the library, loaded from the bytecode image */
 extern BPLONG_PTR addr_halt;
 extern BPLONG_PTR addr_halt0;
 extern BPLONG_PTR addr_fail;
@@ -405,6 +502,7 @@ extern SYM_REC_PTR float_psc;
 extern SYM_REC_PTR address_psc;
 extern SYM_REC_PTR socket_psc;
 extern SYM_REC_PTR stream_psc;
+extern SYM_REC_PTR mmap_psc;
 extern SYM_REC_PTR bigint_psc;
 #ifdef XCSP_PICAT
 extern SYM_REC_PTR xcsp_vx_psc;
@@ -550,6 +648,18 @@ extern BPLONG addr_top_bit;
 
 #define BP_MALLOC(ptr, size) BP_MALLOC_AUX(ptr, size, 0)
 
+/* grow the stack/heap area and the trail in place inside reserved address space (expand.c) */
+#if defined(M64BITS) && (defined(LINUX) || defined(DARWIN)) && !defined(CYGWIN)
+#define BP_RESERVE_AREAS
+#endif
+
+#ifdef BP_RESERVE_AREAS
+extern BPLONG_PTR stack_reserve_low;
+extern BPLONG stack_reserve_size;
+extern BPLONG_PTR trail_reserve_low;
+extern BPLONG trail_reserve_size;
+#endif
+
 extern BPLONG use_gl_getline;
 extern BPLONG num_stack_expansions;
 extern BPLONG num_trail_expansions;
@@ -53,6 +53,7 @@ BPLONG_PTR cpreg;
 CHAR_PTR curr_fence;  /* ptr to next free byte in perm space */
 BPLONG_PTR parea_up_addr;  /* ptr to last+1 free byte in perm space */
 BPLONG_PTR inst_begin;  /* ptr to the beginning of inst. array */
+BPLONG_PTR lib_code_low_addr, lib_code_up_addr;  /* the byte code of the library, loaded from the bytecode image */
 BPLONG_PTR addr_halt;
 BPLONG_PTR addr_halt0;
 BPLONG_PTR addr_fail;
@@ -125,6 +126,7 @@ SYM_REC_PTR float_psc;
 SYM_REC_PTR address_psc;
 SYM_REC_PTR socket_psc;
 SYM_REC_PTR stream_psc;
+SYM_REC_PTR mmap_psc;
 SYM_REC_PTR bigint_psc;
 #ifdef XCSP_PICAT
 SYM_REC_PTR xcsp_vx_psc;
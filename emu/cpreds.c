@@ -1169,6 +1169,46 @@ void Cboot() {
 
     insert_cpred("c_table_cardinality_limit", 3, c_table_cardinality_limit);
     insert_cpred("c_set_all_table_cardinality_limit", 1, c_set_all_table_cardinality_limit);
+    insert_cpred("c_PICAT_TABLE_MAP_SET_CAPACITY_cc", 2, c_PICAT_TABLE_MAP_SET_CAPACITY_cc);
+    insert_cpred("c_PICAT_TABLE_MAP_STATISTICS_cf", 2, c_PICAT_TABLE_MAP_STATISTICS_cf);
+    insert_cpred("c_ABOLISH_TABLE_cc", 2, c_ABOLISH_TABLE_cc);
+    insert_cpred("c_TABLE_AREA_GC", 0, c_TABLE_AREA_GC);
+    insert_cpred("c_SET_SEMI_NAIVE_TABLING_ccc", 3, c_SET_SEMI_NAIVE_TABLING_ccc);
+    insert_cpred("c_TABLE_STORE_OPEN_cc", 2, c_TABLE_STORE_OPEN_cc);
+    insert_cpred("c_TABLE_STORE_CLOSE", 0, c_TABLE_STORE_CLOSE);
+    insert_cpred("c_SHARE_TABLE_cc", 2, c_SHARE_TABLE_cc);
+    insert_cpred("c_SET_TABLE_PROFILING_c", 1, c_SET_TABLE_PROFILING_c);
+    insert_cpred("c_TABLE_PROFILE_f", 1, c_TABLE_PROFILE_f);
+    insert_cpred("c_PRINT_TABLE_PROFILE", 0, c_PRINT_TABLE_PROFILE);
+    insert_cpred("c_PLANNER_SEARCH_NEW_cf", 2, c_PLANNER_SEARCH_NEW_cf);
+    insert_cpred("c_PLANNER_SEARCH_FREE_c", 1, c_PLANNER_SEARCH_FREE_c);
+    insert_cpred("c_PLANNER_SEARCH_RESET_c", 1, c_PLANNER_SEARCH_RESET_c);
+    insert_cpred("c_PLANNER_SEARCH_ADD_cccccf", 6, c_PLANNER_SEARCH_ADD_cccccf);
+    insert_cpred("c_PLANNER_SEARCH_VISIT_ccc", 3, c_PLANNER_SEARCH_VISIT_ccc);
+    insert_cpred("c_PLANNER_SEARCH_QUEUE_ccc", 3, c_PLANNER_SEARCH_QUEUE_ccc);
+    insert_cpred("c_PLANNER_SEARCH_POP_cfff", 4, c_PLANNER_SEARCH_POP_cfff);
+    insert_cpred("c_PLANNER_SEARCH_PLAN_ccf", 3, c_PLANNER_SEARCH_PLAN_ccf);
+    insert_cpred("c_PLANNER_SEARCH_BOUND_cc", 2, c_PLANNER_SEARCH_BOUND_cc);
+    insert_cpred("c_PLANNER_SEARCH_NEXT_BOUND_cf", 2, c_PLANNER_SEARCH_NEXT_BOUND_cf);
+    insert_cpred("c_PLANNER_SEARCH_STATISTICS_cf", 2, c_PLANNER_SEARCH_STATISTICS_cf);
+    insert_cpred("c_PLANNER_PARALLEL_CPUS_f", 1, c_PLANNER_PARALLEL_CPUS_f);
+    insert_cpred("c_PLANNER_PARALLEL_NEW_cccf", 4, c_PLANNER_PARALLEL_NEW_cccf);
+    insert_cpred("c_PLANNER_PARALLEL_FREE_c", 1, c_PLANNER_PARALLEL_FREE_c);
+    insert_cpred("c_PLANNER_PARALLEL_FORK_cf", 2, c_PLANNER_PARALLEL_FORK_cf);
+    insert_cpred("c_PLANNER_PARALLEL_EXIT_c", 1, c_PLANNER_PARALLEL_EXIT_c);
+    insert_cpred("c_PLANNER_PARALLEL_WAIT_c", 1, c_PLANNER_PARALLEL_WAIT_c);
+    insert_cpred("c_PLANNER_PARALLEL_TAKE_cf", 2, c_PLANNER_PARALLEL_TAKE_cf);
+    insert_cpred("c_PLANNER_PARALLEL_BOUND_cf", 2, c_PLANNER_PARALLEL_BOUND_cf);
+    insert_cpred("c_PLANNER_PARALLEL_REPORT_ccc", 3, c_PLANNER_PARALLEL_REPORT_ccc);
+    insert_cpred("c_PLANNER_PARALLEL_ABORT_cc", 2, c_PLANNER_PARALLEL_ABORT_cc);
+    insert_cpred("c_PLANNER_PARALLEL_RESULT_cfff", 4, c_PLANNER_PARALLEL_RESULT_cfff);
+    insert_cpred("c_PLANNER_EXTERNAL_NEW_cccf", 4, c_PLANNER_EXTERNAL_NEW_cccf);
+    insert_cpred("c_PLANNER_EXTERNAL_FREE_c", 1, c_PLANNER_EXTERNAL_FREE_c);
+    insert_cpred("c_PLANNER_EXTERNAL_LAYER_cf", 2, c_PLANNER_EXTERNAL_LAYER_cf);
+    insert_cpred("c_PLANNER_EXTERNAL_NEXT_cf", 2, c_PLANNER_EXTERNAL_NEXT_cf);
+    insert_cpred("c_PLANNER_EXTERNAL_ADD_cccc", 4, c_PLANNER_EXTERNAL_ADD_cccc);
+    insert_cpred("c_PLANNER_EXTERNAL_PLAN_cf", 2, c_PLANNER_EXTERNAL_PLAN_cf);
+    insert_cpred("c_PLANNER_EXTERNAL_STATISTICS_cf", 2, c_PLANNER_EXTERNAL_STATISTICS_cf);
     insert_cpred("c_init_global_each_session", 0, c_init_global_each_session);
     insert_cpred("c_GET_GC_TIME", 1, c_GET_GC_TIME);
 
@@ -1196,6 +1236,14 @@ void Cboot() {
 
     insert_cpred("c_CP_FILE_cc", 2, c_CP_FILE_cc);
 
+    insert_cpred("c_MMAP_OPEN_cf", 2, c_MMAP_OPEN_cf);
+    insert_cpred("c_MMAP_CLOSE_c", 1, c_MMAP_CLOSE_c);
+    insert_cpred("c_MMAP_AT_EOF_c", 1, c_MMAP_AT_EOF_c);
+    insert_cpred("c_MMAP_READ_LINE_cf", 2, c_MMAP_READ_LINE_cf);
+    insert_cpred("c_MMAP_READ_CHARS_ccf", 3, c_MMAP_READ_CHARS_ccf);
+    insert_cpred("c_LOAD_DELIMITED_FACTS_cccccccccf", 9, c_LOAD_DELIMITED_FACTS_cccccccccf);
+    insert_cpred("c_WRITE_INT_LIST_ccc", 3, c_WRITE_INT_LIST_ccc);
+
     insert_cpred("c_MAXINT_f", 1, c_MAXINT_f);
     insert_cpred("c_MININT_f", 1, c_MININT_f);
     insert_cpred("c_IS_SMALL_INT_c", 1, c_IS_SMALL_INT_c);
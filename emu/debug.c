@@ -73,8 +73,8 @@ int c_remove_spy_point() {
     name = ARG(1, 2);
     arity = ARG(2, 2);
     GET_GLOBAL_SYM(name, arity, sym_ptr);
-    if (GET_SPY(sym_ptr) == 1) {
-        GET_SPY(sym_ptr) = 0;
+    if (GET_SPY(sym_ptr)) {
+        GET_FLAGS(sym_ptr) &= ~SYM_SPY;
         number_of_spy_points--;
         if (number_of_spy_points == 0) {
             dg_flag_word &= ~((UW16)DG_FLAG_SPY);
@@ -91,7 +91,7 @@ int c_is_spy_point() {
 
     call = ARG(1, 1); DEREF(call);
     sym_ptr = GET_SYM_REC(call);
-    return (GET_SPY(sym_ptr) == 1) ? BP_TRUE : BP_FALSE;
+    return GET_SPY(sym_ptr) ? BP_TRUE : BP_FALSE;
 }
 
 int c_add_spy_point() {
@@ -107,8 +107,8 @@ int c_add_spy_point() {
 	  return BP_FALSE;
 	} else {
 	  dg_flag_word = DG_FLAG_SPY;
-	  if (GET_SPY(sym_ptr) == 0) {
-        GET_SPY(sym_ptr) = 1;
+	  if (!GET_SPY(sym_ptr)) {
+        GET_FLAGS(sym_ptr) |= SYM_SPY;
         number_of_spy_points++;
         return BP_TRUE;
 	  } else
@@ -127,7 +127,7 @@ int c_get_spy_points() {
     for (i = 0; i < BUCKET_CHAIN; ++i) {
         sym_ptr = hash_table[i];
         while (sym_ptr != NULL) {
-            if (GET_SPY(sym_ptr) == 1) {
+            if (GET_SPY(sym_ptr)) {
                 cell = ADDTAG(insert_sym(GET_NAME(sym_ptr), GET_LENGTH(sym_ptr), 0), ATM);
                 cell = make_struct2("/", cell, MAKEINT(GET_ARITY(sym_ptr)));
                 temp0 = ADDTAG((BPLONG)heap_top, LST);
@@ -150,7 +150,7 @@ int c_remove_spy_points() {
     for (i = 0; i < BUCKET_CHAIN; ++i) {
         sym_ptr = hash_table[i];
         while (sym_ptr != NULL) {
-            if (GET_SPY(sym_ptr) == 1) GET_SPY(sym_ptr) = 0;
+            if (GET_SPY(sym_ptr)) GET_FLAGS(sym_ptr) &= ~SYM_SPY;
             sym_ptr = GET_NEXT(sym_ptr);
         }
     }
@@ -8541,6 +8541,7 @@ lab_table_allocate:
     AR_SUBGOAL_TABLE(AR) = (BPLONG)NULL;
     AR_CURR_ANSWER(AR) = (BPLONG)NULL;
     INVOKE_GC_NONDET;
+    INVOKE_TABLE_GC;
 
     SAVE_AR;
     mode_bits = *(P+1);  /* the CallMode word */
@@ -8556,6 +8557,7 @@ lab_table_allocate:
     }
 
     SET_AR_SUBGOAL_TABLE(AR, (BPLONG)subgoal_entry);
+    AR_ANSWER_MARK(AR) = (semi_naive_tabling) ? semi_naive_answer_mark(AR, subgoal_entry) : (BPLONG)NULL;
 
     answer_table = GT_ANSWER_TABLE(subgoal_entry);
     if (answer_table == (BPLONG)NULL) {
@@ -8581,7 +8583,9 @@ lab_table_allocate:
         }
         GT_TOP_AR(subgoal_entry) = (BPLONG)AR;
         //    AR_TABLE_NEW_BITS(AR) = 0x1L;
+        if (table_profiling) table_profile_start(subgoal_entry);
 
+        START_SUBGOAL_EVALUATION(subgoal_entry, 1);
         SUBGOAL_START_NORMAL(subgoal_entry);
         CONTCASE;
     } else if ((BPLONG)master_ar == SUBGOAL_TEMP_COMPLETE) {  /* has been evaluated at least once overall */
@@ -8591,6 +8595,7 @@ lab_table_allocate:
         }
         GT_TOP_AR(subgoal_entry) = (BPLONG)AR;
 
+        START_SUBGOAL_EVALUATION(subgoal_entry, 0);
         SUBGOAL_START_ITERATION(subgoal_entry);
         CONTCASE;
     } else {  /* descendent of master_ar */
@@ -8612,6 +8617,8 @@ check_plan_resource_limit:
         GT_TOP_AR(subgoal_entry) = (BPLONG)AR;
         GT_SCC_ELMS(subgoal_entry) = (BPLONG)NULL;
         GT_SCC_ROOT(subgoal_entry) = (BPLONG)subgoal_entry;
+        if (table_profiling) table_profile_start(subgoal_entry);
+        START_SUBGOAL_EVALUATION(subgoal_entry, 1);  /* the limit has changed, so all answers are consumed */
         SUBGOAL_START_NORMAL(subgoal_entry);
         CONTCASE;
     } else {
@@ -8650,6 +8657,7 @@ lab_table_produce:
     arity = GET_ARITY(sym_ptr);
     answer_table = (BPLONG_PTR)GT_ANSWER_TABLE(subgoal_entry);
     stack_arg_ptr = AR+arity;
+    if (table_profiling) table_profile_begin(sym_ptr);
 
     loc_p = (BPLONG_PTR)GET_EP(sym_ptr);
     opt_arg_index = FOLLOW(loc_p+7);
@@ -8762,6 +8770,10 @@ lab_table_consume:
 
     subgoal_entry = (BPLONG_PTR)GET_AR_SUBGOAL_TABLE(AR);
     answer = (BPLONG_PTR)AR_CURR_ANSWER(AR);
+    if (AR_ANSWER_MARK(AR) != (BPLONG)NULL) {  /* skip the answers consumed in the previous evaluation */
+        answer = (BPLONG_PTR)ANSWER_NEXT_IN_TABLE(AR_ANSWER_MARK(AR));
+        AR_ANSWER_MARK(AR) = (BPLONG)NULL;
+    }
     if (answer == NULL) goto table_consume_fail;
 
     sym_ptr = (SYM_REC_PTR)GT_SYM(subgoal_entry);
@@ -8818,13 +8830,16 @@ lab_table_check_completion:
               if (SUBGOAL_IS_LOOPING(subgoal_entry)) printf("LOOPING"); else printf("NOLOOPING");printf("\n");
             */
             complete_scc_elms(subgoal_entry);
+            if (table_profiling) table_profile_complete(subgoal_entry);
             AR_CPF(AR) = (BPLONG)addr_table_consume;
 
             goto lab_table_consume;
         } else {  /* needs to be iterated */
             //    AR_TABLE_NEW_BITS(AR) = 0;
             initialize_scc_elms(subgoal_entry);
+            if (table_profiling) table_profile_iterate(subgoal_entry);
 
+            START_SUBGOAL_EVALUATION(subgoal_entry, 0);
             SUBGOAL_START_ITERATION(subgoal_entry);
             // printf("recompute =%lx\n",subgoal_entry);  print_subgoal_entry_only(subgoal_entry);printf("\n");
             P = (BPLONG_PTR)*P;
@@ -20,6 +20,24 @@ extern BPLONG gc_time;
 #define VALIDATE_HEAP_PTR(ptr)
 #define VALIDATE_STACK_PTR(ptr)
 
+#ifdef BP_RESERVE_AREAS
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define STACK_RESERVE_WORDS ((BPLONG)1 << 32)  /* 32GB of address space for the stack/heap area */
+#define TRAIL_RESERVE_WORDS ((BPLONG)1 << 29)  /* 4GB of address space for the trail */
+#define RELEASE_MIN_WORDS ((BPLONG)1 << 23)    /* do not give back less than 64MB */
+
+BPLONG_PTR stack_reserve_low = NULL;  /* reservation holding the stack/heap area, NULL if it was malloced */
+BPLONG stack_reserve_size = 0;       /* in words */
+BPLONG_PTR trail_reserve_low = NULL;  /* reservation holding the trail, which sits at its top end */
+BPLONG trail_reserve_size = 0;
+static BPULONG page_bytes = 0;
+
+#define PAGE_DOWN(p) ((BPLONG_PTR)((BPULONG)(p) & ~(page_bytes-1)))
+#define PAGE_UP(p) ((BPLONG_PTR)(((BPULONG)(p)+page_bytes-1) & ~(page_bytes-1)))
+#endif
+
 /*
   #define VALIDATE_HEAP_PTR(ptr) if (ptr<stack_low_addr || ptr >= heap_top){printf("ptr=%x\n",ptr); quit("STRANGE HEAP PTR\n");}
 
@@ -32,6 +50,139 @@ extern BPLONG gc_time;
    2. update global variables (parea_low_addr,parea_up_addr) and predicates (statistics).
 ***********************************************************************************/
 
+/***********************************************************************************
+   allocate the global/local stack area and the trail
+   1. on 64-bit Unix systems, each area is placed in a large reservation of address
+      space that is made accessible (committed) only up to the current size, so that
+      the area can later grow in place. Untouched pages never take physical memory.
+   2. otherwise, or if the reservation fails, the area is malloced as before.
+***********************************************************************************/
+#ifdef BP_RESERVE_AREAS
+/* reserve address space for size words without committing any memory */
+static BPLONG_PTR reserve_area(BPLONG size)
+{
+    void *p;
+
+    if (page_bytes == 0) page_bytes = (BPULONG)sysconf(_SC_PAGESIZE);
+    p = mmap(NULL, size*sizeof(BPLONG), PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+#ifdef LINUX
+    if (addr_top_bit == BP_NEG_1) {
+        addr_top_bit = (BPLONG)((BPULONG)p & TOP_BIT);
+    } else if (addr_top_bit != (BPLONG)((BPULONG)p & TOP_BIT)) {
+        munmap(p, size*sizeof(BPLONG));
+        return NULL;
+    }
+#else
+    if ((BPLONG)p & TOP_BIT) {
+        munmap(p, size*sizeof(BPLONG));
+        return NULL;
+    }
+#endif
+    return (BPLONG_PTR)p;
+}
+
+/* make the words in [from,to) accessible */
+static int commit_area(BPLONG_PTR from, BPLONG_PTR to)
+{
+    from = PAGE_DOWN(from);
+    to = PAGE_UP(to);
+    return mprotect((void *)from, (BPULONG)to-(BPULONG)from, PROT_READ | PROT_WRITE) == 0;
+}
+#endif
+
+BPLONG_PTR allocate_stack_area(BPLONG size)
+{
+    BPLONG_PTR low;
+#ifdef BP_RESERVE_AREAS
+    BPLONG reserve_size;
+
+    reserve_size = (4*size > STACK_RESERVE_WORDS) ? 4*size : STACK_RESERVE_WORDS;
+    low = reserve_area(reserve_size);
+    if (low != NULL) {
+        if (commit_area(low, low+size)) {
+            stack_reserve_low = low;
+            stack_reserve_size = reserve_size;
+            return low;
+        }
+        munmap((void *)low, reserve_size*sizeof(BPLONG));
+    }
+    stack_reserve_low = NULL;
+#endif
+    BP_MALLOC(low, size);
+    return low;
+}
+
+#ifdef BP_RESERVE_AREAS
+/* free a stack/heap area; reserve_low is the reservation that was current when it was allocated */
+static void free_stack_area(BPLONG_PTR low, BPLONG_PTR reserve_low, BPLONG reserve_size)
+{
+    if (low == reserve_low) {
+        munmap((void *)low, reserve_size*sizeof(BPLONG));
+    } else {
+        free(low);
+    }
+}
+#endif
+
+/* return the low end of a trail of size words; the trail grows down from low+size-1 */
+BPLONG_PTR allocate_trail_area(BPLONG size)
+{
+#ifdef BP_RESERVE_AREAS
+    BPLONG_PTR low;
+    BPLONG reserve_size;
+
+    reserve_size = (4*size > TRAIL_RESERVE_WORDS) ? 4*size : TRAIL_RESERVE_WORDS;
+    low = reserve_area(reserve_size);
+    if (low != NULL) {
+        if (commit_area(low+reserve_size-size, low+reserve_size)) {
+            trail_reserve_low = low;
+            trail_reserve_size = reserve_size;
+            return low+reserve_size-size;
+        }
+        munmap((void *)low, reserve_size*sizeof(BPLONG));
+    }
+    trail_reserve_low = NULL;
+#endif
+    return (BPLONG_PTR)malloc(size*sizeof(BPLONG));
+}
+
+/* free the stack/heap area and the trail that are installed in the global registers */
+void free_stack_and_trail_areas()
+{
+#ifdef BP_RESERVE_AREAS
+    if (stack_low_addr != NULL) free_stack_area(stack_low_addr, stack_reserve_low, stack_reserve_size);
+    if (trail_reserve_low != NULL) {
+        munmap((void *)trail_reserve_low, trail_reserve_size*sizeof(BPLONG));
+    } else {
+        free(trail_low_addr);
+    }
+#else
+    free(stack_low_addr);
+    free(trail_low_addr);
+#endif
+}
+
+/*
+  Give the pages of the heap that were freed by a GC back to the system. This is
+  done only after a peak, when at least RELEASE_MIN_WORDS and at least half of the
+  heap used before the GC were freed, so that a heap that is refilled after every GC
+  does not keep faulting in fresh pages. The pages stay committed, and the system
+  supplies new ones when they are touched again.
+*/
+void release_unused_heap_pages(BPLONG_PTR peak)
+{
+#ifdef BP_RESERVE_AREAS
+    BPLONG_PTR from, to;
+
+    if (stack_reserve_low != stack_low_addr) return;
+    from = PAGE_UP(heap_top+LARGE_MARGIN);
+    to = PAGE_DOWN((peak < local_top) ? peak : local_top);
+    if (to-from < RELEASE_MIN_WORDS || to-from < (peak-stack_low_addr)/2) return;
+    madvise((void *)from, (BPULONG)to-(BPULONG)from, MADV_DONTNEED);
+#endif
+}
+
 /***********************************************************************************
  expand the trail stack, and return the new trail_top
    1. the trail stack is expanded after the available space is below a threshold  (trail_water_mark)
@@ -45,6 +196,10 @@ BPLONG_PTR expand_trail(trail_top, breg)
     BPLONG_PTR new_trail_low_addr, new_trail_up_addr, my_breg, top;
     BPLONG diff, new_trail_size;
     BPLONG msec0;
+#ifdef BP_RESERVE_AREAS
+    BPLONG_PTR old_reserve_low = NULL;
+    BPLONG old_reserve_size = 0;
+#endif
 
     msec0 = cputime();
 
@@ -52,10 +207,27 @@ BPLONG_PTR expand_trail(trail_top, breg)
 
     new_trail_size = 2*trail_size;
 
-    new_trail_low_addr = (BPLONG_PTR)malloc(sizeof(BPLONG)*new_trail_size);
+#ifdef BP_RESERVE_AREAS
+    /* grow down in place: no frame or trail entry needs to be changed */
+    if (trail_reserve_low != NULL && new_trail_size <= trail_reserve_size) {
+        new_trail_low_addr = trail_up_addr-new_trail_size+1;
+        if (commit_area(new_trail_low_addr, trail_low_addr)) {
+            num_trail_expansions++;
+            trail_low_addr = new_trail_low_addr;
+            trail_size = new_trail_size;
+            trail_water_mark = trail_low_addr+LARGE_MARGIN;
+            trail_water_mark0 = trail_low_addr+2;
+            gc_time += (cputime()-msec0);
+            return trail_top;
+        }
+    }
+    old_reserve_low = trail_reserve_low;
+    old_reserve_size = trail_reserve_size;
+#endif
+    new_trail_low_addr = allocate_trail_area(new_trail_size);
     if (new_trail_low_addr == NULL) {
         new_trail_size = trail_size+1000000L;
-        new_trail_low_addr = (BPLONG_PTR)malloc(sizeof(BPLONG)*new_trail_size);
+        new_trail_low_addr = allocate_trail_area(new_trail_size);
         if (new_trail_low_addr == NULL) {
             myquit(OUT_OF_MEMORY, "te");
         }
@@ -77,7 +249,12 @@ BPLONG_PTR expand_trail(trail_top, breg)
     diff = (BPULONG)trail_up_addr-(BPULONG)trail_top;
     trail_up_addr = new_trail_up_addr;
     trail_size = new_trail_size;
-    free(trail_low_addr);
+#ifdef BP_RESERVE_AREAS
+    if (old_reserve_low != NULL) {
+        munmap((void *)old_reserve_low, old_reserve_size*sizeof(BPLONG));
+    } else
+#endif
+        free(trail_low_addr);
     trail_low_addr = new_trail_low_addr;
     trail_water_mark = trail_low_addr+LARGE_MARGIN;
     trail_water_mark0 = trail_low_addr+2;
@@ -147,11 +324,19 @@ void unmark_sf_chain(sf)
   3'. adjust pointers to the stack in the table area
   4. reset the pointers in the copied stack and heap to point to the new area.
   5. reset global registers (local_top,heap_top, breg, hbreg, arreg, and sfreg)
+  If the area lies in a reservation that can hold the new size, the area is grown
+  in place: the heap stays where it is (diff_h=0), and only the local stack is moved
+  to the new top end.
 ***********************************************************************************/
 int expand_local_global_stacks(BPLONG preferred_size) {
     BPLONG_PTR new_stack_low_addr, new_stack_up_addr;
     BPLONG new_stack_size, diff_h, diff_s;
     BPLONG msec0, maxs;
+    int in_place = 0;
+#ifdef BP_RESERVE_AREAS
+    BPLONG_PTR old_reserve_low = stack_reserve_low;
+    BPLONG old_reserve_size = stack_reserve_size;
+#endif
 
 
     /* precondition (toam_signal_vec == 0) so no need to consider TriggeredCs[..] */
@@ -176,13 +361,24 @@ int expand_local_global_stacks(BPLONG preferred_size) {
 
     /*  if (new_stack_size>stack_size_limit) return;  */
 
-    BP_MALLOC(new_stack_low_addr, new_stack_size);
-    if (new_stack_low_addr == NULL) {
-        if (preferred_size != 0) return BP_ERROR;
-        new_stack_size = stack_size+1000000L;
-        BP_MALLOC(new_stack_low_addr, new_stack_size);
+#ifdef BP_RESERVE_AREAS
+    /* the moved local stack must not overlap its old place */
+    if (stack_reserve_low == stack_low_addr && new_stack_size <= stack_reserve_size &&
+        new_stack_size-stack_size > stack_up_addr-local_top &&
+        commit_area(stack_low_addr+stack_size, stack_low_addr+new_stack_size)) {
+        new_stack_low_addr = stack_low_addr;
+        in_place = 1;
+    } else
+#endif
+    {
+        new_stack_low_addr = allocate_stack_area(new_stack_size);
         if (new_stack_low_addr == NULL) {
-            return BP_ERROR;
+            if (preferred_size != 0) return BP_ERROR;
+            new_stack_size = stack_size+1000000L;
+            new_stack_low_addr = allocate_stack_area(new_stack_size);
+            if (new_stack_low_addr == NULL) {
+                return BP_ERROR;
+            }
         }
     }
 
@@ -195,14 +391,19 @@ int expand_local_global_stacks(BPLONG preferred_size) {
     diff_h = (BPULONG)new_stack_low_addr-(BPULONG)stack_low_addr;  /* add this to heap pointers */
     diff_s = (BPULONG)new_stack_up_addr-(BPULONG)stack_up_addr;  /* add this to stack pointers */
 
-    my_memcpy_btm_up(new_stack_low_addr, stack_low_addr, ((BPULONG)heap_top-(BPULONG)stack_low_addr)/sizeof(BPLONG));
+    if (!in_place)
+        my_memcpy_btm_up(new_stack_low_addr, stack_low_addr, ((BPULONG)heap_top-(BPULONG)stack_low_addr)/sizeof(BPLONG));
     my_memcpy_btm_up((BPLONG_PTR)((BPULONG)local_top+diff_s)+1, local_top+1, ((BPULONG)stack_up_addr-(BPULONG)local_top)/sizeof(BPLONG));
 
     if (expandStackNullifyUntaggedCells(diff_s) == BP_ERROR) return BP_ERROR;
     /* reset pointers */
     expandStackResetPointers(diff_h, diff_s);
 
+#ifdef BP_RESERVE_AREAS
+    if (!in_place) free_stack_area(stack_low_addr, old_reserve_low, old_reserve_size);
+#else
     free(stack_low_addr);
+#endif
     stack_low_addr = new_stack_low_addr;
     stack_up_addr = new_stack_up_addr;
     stack_size = new_stack_size;
@@ -364,7 +565,7 @@ void expandStackNullifyUntaggedCellsFrame(ar, diff_s)
             }
             AR_SUBGOAL_TABLE(ar) = 0;
             AR_CURR_ANSWER(ar) = 0;
-            AR_TABLE_NEW_BITS(ar) = 0;  /* nullify it, so its content is copied in verbatim */
+            AR_ANSWER_MARK(ar) = 0;  /* nullify it, so its content is copied in verbatim */
         }
     } else if (IS_SUSP_FRAME(ar)) {
         AR_STATUS(ar) = 0;
@@ -521,6 +722,7 @@ void expandStackResetHeap(diff_h)
     BPLONG_PTR ptr, new_ptr, addr;
     BPLONG op;
 
+    if (diff_h == 0) return;  /* the heap was not moved */
     for (ptr = stack_low_addr; ptr < heap_top; ptr++) {
         op = FOLLOW(ptr);
         if (op != 0 && TAG(op) != ATM) {
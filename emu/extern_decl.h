@@ -145,12 +145,16 @@ extern int b_INC_PRED_RETR_COUNT_c(BPLONG PredPtr);
 extern int b_DEC_PRED_RETR_COUNT_c(BPLONG PredPtr);
 extern int b_ABOLISH_cc(BPLONG f, BPLONG n);
 extern void abolish_pred(InterpretedPredPtr pred_ptr);
+extern void release_bucket_cells(InterpretedPredPtr pred_ptr, InterpretedPredBucketPtr bucket_ptr);
 extern void release_clause_record_space(InterpretedClausePtr clause_record_ptr);
 extern void release_term_space(BPLONG term);
 extern int b_REMOVE_CLAUSE_c(BPLONG clause_record);
 extern void locate_and_free_clause_record(InterpretedPredPtr pred_ptr, BPLONG clause_record);
-extern void free_cell_of_removed_in_bucket(InterpretedPredPtr pred_ptr, InterpretedPredBucketPtr bucket_ptr, BPLONG removed_clause_record);
+extern void free_clause_cell_in_bucket(InterpretedPredPtr pred_ptr, InterpretedPredBucketPtr bucket_ptr, BPLONG clause_record);
+extern void free_cell_of_removed_in_bucket(InterpretedPredPtr pred_ptr, InterpretedPredBucketPtr bucket_ptr, BPLONG_PTR cell_ptr);
 extern void disconnect_cell_of_removed_clause(InterpretedPredBucketPtr bucket_ptr, BPLONG_PTR cell_ptr);
+extern int c_RETRACTALL_cf(void);
+extern int c_INCREMENTAL_DYNAMIC_cc(void);
 extern int c_initialize_interpreted_pred(void);
 extern int b_ASSERTA_cc(BPLONG Head, BPLONG Body);
 extern int b_ASSERTZ_cc(BPLONG Head, BPLONG Body);
@@ -165,6 +169,11 @@ extern int asserta_interpreted_pred(InterpretedPredPtr pred_ptr, BPLONG head, BP
 extern BPLONG_PTR assertz_clause_record(InterpretedPredBucketPtr bucket_ptr, BPLONG clause_record);
 extern int assertz_interpreted_pred(InterpretedPredPtr pred_ptr, BPLONG head, BPLONG body);
 extern BPLONG hashval_in_assert(InterpretedClausePtr clause_record_ptr);
+extern BPLONG hashval_of_clause_arg(InterpretedClausePtr clause_record_ptr, BPLONG arg_no);
+extern void free_arg_index(InterpretedPredPtr pred_ptr, BPLONG arg_no);
+extern void free_arg_indexes(InterpretedPredPtr pred_ptr);
+extern InterpretedArgIndexPtr get_arg_index(InterpretedPredPtr pred_ptr, BPLONG arg_no, BPLONG arity);
+extern int add_clause_to_arg_indexes(InterpretedPredPtr pred_ptr, BPLONG clause_record, int at_front);
 extern int b_ASSERTABLE_c(BPLONG Head);
 extern int b_RETRACTABLE_c(BPLONG Head);
 extern int b_GET_PRED_PTR_cff(BPLONG Head, BPLONG PredPtr, BPLONG IsDynamic);
@@ -702,6 +711,10 @@ extern int c_in_critical_region(void);
 //[]
 //      expand.c prototypes
 //[]
+extern BPLONG_PTR allocate_stack_area(BPLONG size);
+extern BPLONG_PTR allocate_trail_area(BPLONG size);
+extern void release_unused_heap_pages(BPLONG_PTR peak);
+extern void free_stack_and_trail_areas(void);
 extern BPLONG_PTR expand_trail(BPLONG_PTR trail_top, BPLONG_PTR breg);
 extern void my_memcpy_top_down(BPLONG_PTR des, BPLONG_PTR src, BPLONG size);
 extern void my_memcpy_btm_up(BPLONG_PTR des, BPLONG_PTR src, BPLONG size);
@@ -726,6 +739,8 @@ extern void expandStackResetTrail(BPLONG diff_h, BPLONG diff_s);
 //[]
 //      file.c prototypes
 //[]
+extern void note_loaded_file(CHAR_PTR name);
+extern CHAR_PTR loaded_file_path(CHAR_PTR module, BPLONG len);
 extern int b_STREAM_IS_OPEN_c(BPLONG Index);
 extern int b_STREAM_SET_TYPE_cc(BPLONG Index, BPLONG Type);
 extern int b_STREAM_SET_EOF_ACTION_cc(BPLONG Index, BPLONG Action);
@@ -863,6 +878,13 @@ extern int b_READ_FILE_BYTES_cf(BPLONG FDIndex, BPLONG Lst);
 extern int b_READ_FILE_CHARS_cf(BPLONG FDIndex, BPLONG Lst);
 extern int b_READ_FILE_CODES_cf(BPLONG FDIndex, BPLONG Lst);
 extern int b_READ_LINE_cf(BPLONG FDIndex, BPLONG Lst);
+extern int c_MMAP_OPEN_cf();
+extern int c_MMAP_CLOSE_c();
+extern int c_MMAP_AT_EOF_c();
+extern int c_MMAP_READ_LINE_cf();
+extern int c_MMAP_READ_CHARS_ccf();
+extern void mmap_release_engine(BP_ENGINE_PTR e);
+extern int c_LOAD_DELIMITED_FACTS_cccccccccf();
 extern int b_WRITE_BYTE_cc(BPLONG FDIndex, BPLONG Byt);
 extern int b_PICAT_PRINT_STRING_cc(BPLONG FDIndex, BPLONG Lst);
 extern int b_PICAT_PRINT_PRIMITIVE_cc(BPLONG FDIndex, BPLONG Term);
@@ -882,6 +904,12 @@ extern void b_put_char_code(FILE *tmp_curr_out, BPLONG op);
 extern int b_WRITE_CHAR_CODE_cc(BPLONG FDIndex, BPLONG op);
 extern int c_CP_FILE_cc();
 extern void print_cnf_header(int sat_nvars, int num_cls);
+extern void start_cnf_dump();
+extern int cnf_dump_closed(BPLONG i);
+extern void print_cnf_clause(BPLONG_PTR lit_ptr0, BPLONG_PTR lit_ptr);
+extern int bp_itoa(BPLONG i, CHAR_PTR buf);
+extern void bp_write_int(BPLONG i);
+extern int c_WRITE_INT_LIST_ccc();
 extern int c_module_glb_pred_name();
 extern int c_module_glb_func_name();
 extern int c_module_qualified_pred_name();
@@ -999,6 +1027,12 @@ extern int c_UNNUMBER_VARS(void);
 //[]
 extern void init_toam(int argc, char **argv);
 extern void init_stack(BPLONG bsize);
+extern BP_ENGINE_PTR bp_new_engine(BPLONG new_stack_size, BPLONG new_trail_size);
+extern void bp_reset_engine(void);
+extern BP_ENGINE_PTR bp_current_engine(void);
+extern int bp_num_engines(void);
+extern int bp_switch_engine(BP_ENGINE_PTR engine);
+extern int bp_free_engine(BP_ENGINE_PTR engine);
 extern int init_loading(int argc, char **argv);
 extern int load_bp_out(void);
 extern int is_bc_file(CHAR_PTR main_arg);
@@ -1037,6 +1071,7 @@ extern int c_LOAD_BYTE_CODE_FROM_BPLISTS();
 extern int c_GET_MODULE_SIGNATURE_cf();
 extern int load_byte_code_from_c_array();
 extern BPLONG bp_prime(BPLONG numentry);
+extern BPLONG default_module_name(CHAR_PTR name, BPLONG length);
 extern SYM_REC_PTR look_for_sym_with_entrance(BPLONG_PTR p);
 extern int c_LOAD_BYTE_CODE_FROM_BPLISTS();
 extern int c_GET_MODULE_SIGNATURE_cf();
@@ -1053,6 +1088,7 @@ extern int c_UNDERSCORE_NAME(void);
 extern BPLONG time_t_2_prolog(time_t *t);
 extern int c_confirm_copy_right(void);
 extern BPLONG cputime(void);
+extern BPLONG cputime_usec(void);
 extern int c_WDAY_f(void);
 extern int c_TIME_ffffff(void);
 extern int c_GETENV_cf(void);
@@ -1293,6 +1329,30 @@ extern int c_TABLE_GET_ALL_ANSWERS();
 extern int table_subsume(BPLONG Call, SYM_REC_PTR sym_ptr, BPLONG_PTR arg_ptr);
 extern BPLONG answer_table_entry_2_struct(SYM_REC_PTR sym_ptr, BPLONG_PTR ptr0);
 extern int c_table_cardinality_limit();
+extern int c_PICAT_TABLE_MAP_SET_CAPACITY_cc();
+extern int c_PICAT_TABLE_MAP_STATISTICS_cf();
+extern int c_ABOLISH_TABLE_cc();
+extern int table_area_num_gcs();
+extern int table_area_gc(BPLONG_PTR ar, BPLONG_PTR b);
+extern void table_area_gc_at_call(BPLONG_PTR ar);
+extern int c_TABLE_AREA_GC();
+extern BPLONG semi_naive_answer_mark(BPLONG_PTR ar, BPLONG_PTR subgoal_entry);
+extern void semi_naive_start_evaluation(BPLONG_PTR subgoal_entry, int first);
+extern int c_SET_SEMI_NAIVE_TABLING_ccc();
+extern int c_TABLE_STORE_OPEN_cc();
+extern int c_TABLE_STORE_CLOSE();
+extern int c_SHARE_TABLE_cc();
+extern void table_profile_begin(SYM_REC_PTR sym_ptr);
+extern void table_profile_add_bytes(BPLONG bytes);
+extern void table_profile_start(BPLONG_PTR subgoal_entry);
+extern void table_profile_iterate(BPLONG_PTR subgoal_entry);
+extern void table_profile_complete(BPLONG_PTR subgoal_entry);
+extern int c_SET_TABLE_PROFILING_c();
+extern int c_TABLE_PROFILE_f();
+extern int c_PRINT_TABLE_PROFILE();
+extern void table_note_dynamic_call(InterpretedPredPtr pred_ptr);
+extern void invalidate_table_dependents(InterpretedPredPtr pred_ptr);
+extern int register_incremental_pred(InterpretedPredPtr pred_ptr);
 extern int c_set_all_table_cardinality_limit();
 extern int table_statistics();
 extern int b_PLANNER_CURR_RPC_fff(BPLONG, BPLONG, BPLONG);
@@ -1313,6 +1373,39 @@ extern BPLONG table_maps_buckets_size();
 extern void reset_temp_complete_subgoal_entries();
 void reset_temp_complete_scc_elms(BPLONG_PTR subgoal_entry);
 
+//[]
+//      planner.c prototypes
+//[]
+extern int c_PLANNER_SEARCH_NEW_cf();
+extern int c_PLANNER_SEARCH_FREE_c();
+extern int c_PLANNER_SEARCH_RESET_c();
+extern int c_PLANNER_SEARCH_ADD_cccccf();
+extern int c_PLANNER_SEARCH_VISIT_ccc();
+extern int c_PLANNER_SEARCH_QUEUE_ccc();
+extern int c_PLANNER_SEARCH_POP_cfff();
+extern int c_PLANNER_SEARCH_PLAN_ccf();
+extern int c_PLANNER_SEARCH_BOUND_cc();
+extern int c_PLANNER_SEARCH_NEXT_BOUND_cf();
+extern int c_PLANNER_SEARCH_STATISTICS_cf();
+extern int c_PLANNER_PARALLEL_CPUS_f();
+extern int c_PLANNER_PARALLEL_NEW_cccf();
+extern int c_PLANNER_PARALLEL_FREE_c();
+extern int c_PLANNER_PARALLEL_FORK_cf();
+extern int c_PLANNER_PARALLEL_EXIT_c();
+extern int c_PLANNER_PARALLEL_WAIT_c();
+extern int c_PLANNER_PARALLEL_TAKE_cf();
+extern int c_PLANNER_PARALLEL_BOUND_cf();
+extern int c_PLANNER_PARALLEL_REPORT_ccc();
+extern int c_PLANNER_PARALLEL_ABORT_cc();
+extern int c_PLANNER_PARALLEL_RESULT_cfff();
+extern int c_PLANNER_EXTERNAL_NEW_cccf();
+extern int c_PLANNER_EXTERNAL_FREE_c();
+extern int c_PLANNER_EXTERNAL_LAYER_cf();
+extern int c_PLANNER_EXTERNAL_NEXT_cf();
+extern int c_PLANNER_EXTERNAL_ADD_cccc();
+extern int c_PLANNER_EXTERNAL_PLAN_cf();
+extern int c_PLANNER_EXTERNAL_STATISTICS_cf();
+
 //[]
 //      toam.c prototypes
 //[]
@@ -1430,6 +1523,15 @@ extern int PcallX(BPLONG command);
 extern int PexecP(char *cmd);
 extern int Pexecute(char *cmd);
 extern int PinitP(int argc, char **argv);
+extern int PlockEngine(BP_ENGINE_PTR e);
+extern void PunlockEngine(void);
+extern BP_ENGINE_PTR PnewEngine(BPLONG stack_size, BPLONG trail_size);
+extern int PfreeEngine(BP_ENGINE_PTR e);
+extern int PcallTimeout(BPLONG goal, BPLONG msecs);
+extern BP_ENGINE_POOL_PTR PnewEnginePool(BPLONG n, BPLONG stack_size, BPLONG trail_size);
+extern BP_ENGINE_PTR PacquireEngine(BP_ENGINE_POOL_PTR pool);
+extern void PreleaseEngine(BP_ENGINE_POOL_PTR pool, BP_ENGINE_PTR e);
+extern int PfreeEnginePool(BP_ENGINE_POOL_PTR pool);
 extern void jni_interface();
 extern void plc_sup();
 
@@ -34,6 +34,9 @@ extern char *string_in;
 #include <sys/times.h>
 #endif
 #include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
 #endif
 
 #ifdef __MINGW32__
@@ -69,6 +72,19 @@ extern char *string_in;
 #define CDR 0
 #define MAXFILES 40
 
+/* sizes of the stdio buffers given to files opened for input and output */
+#define IN_BUF_SIZE 65536
+#define OUT_BUF_SIZE 65536
+
+/* Flush policy: output to a terminal is flushed after every item, so that prompts
+   show up; stdout and stderr are flushed after every line, so that a process reading
+   the output sees complete lines; other streams are flushed only when their buffers
+   are full, when they are closed, or when flush/1 is called.
+*/
+static int stdout_is_tty = 1;
+#define FLUSH_IF_TTY(fp) {if (fp == stdout && stdout_is_tty) fflush(fp);}
+#define FLUSH_IF_CONSOLE(fp) {if (fp == stdout || fp == stderr) fflush(fp);}
+
 #define EMIT4(op) {                                                     \
         b4 = (BYTE)(op & 0xff);                                         \
         op >>= 8;                                                       \
@@ -92,6 +108,7 @@ static char bp_buf[MAX_STR_LEN];
 static BPLONG user_word, user_input_word, user_output_word, user_error_word;
 
 int format_output_dest = 0;
+int streams_locked = 0;  /* take the stdio lock on reads, see GETC_UNLOCKED in basic.h */
 extern char chars_pool[MAX_CHARS_IN_POOL];
 extern int chars_pool_index;
 
@@ -142,6 +159,32 @@ struct ftab_ent
 static struct ftab_ent file_table[MAXFILES];
 static BPLONG file_tab_end = 0;  /* last used entry in file_table */
 
+/* a memory-mapped input file, materialized into the heap line by line or chunk by chunk */
+struct mmap_ent
+{
+    CHAR_PTR base;  /* start of the mapping, NULL if the entry is free */
+    BPLONG size;  /* size of the file in bytes */
+    BPLONG pos;  /* offset of the next byte to be consumed */
+    BP_ENGINE_PTR engine;  /* the engine that opened the mapping */
+};
+
+static struct mmap_ent mmap_table[MAXFILES];
+static BPLONG mmap_num_open = 0;
+
+/* a mapping is referenced by '$mmap'(Index); set index to Index, or raise an error */
+#define GET_MMAP_INDEX(MFD, index) {                                    \
+        BPLONG_PTR mfd_ptr;                                             \
+        if (!ISSTRUCT(MFD) || FOLLOW(mfd_ptr = (BPLONG_PTR)UNTAGGED_ADDR(MFD)) != (BPLONG)mmap_psc) { \
+            bp_exception = c_domain_error(et_STREAM_OR_ALIAS, MFD);     \
+            return BP_ERROR;                                            \
+        }                                                               \
+        index = FOLLOW(mfd_ptr+1); DEREF(index); index = INTVAL(index); \
+        if (index < 0 || index >= MAXFILES || mmap_table[index].base == NULL) { \
+            bp_exception = c_existence_error(et_STREAM, MFD);           \
+            return BP_ERROR;                                            \
+        }                                                               \
+    }
+
 /* index of current input (output) stream in file_table */
 static BPLONG in_file_i, out_file_i;
 
@@ -270,7 +313,7 @@ int b_STREAM_GET_EOS_cf(Index, Eos)
     if (file_table[Index].mode != READ_MODE && file_table[Index].mode != SOCKET) return BP_FALSE;
 
     if (file_table[Index].eos == STREAM_NOT_EOS) {
-        BPLONG n = getc(file_table[Index].fdes);
+        BPLONG n = GETC_UNLOCKED(file_table[Index].fdes);
         if (n == EOF) {
             res = STREAM_AT_EOS;
         } else {
@@ -372,6 +415,34 @@ void bp_write_insert_dot_zero_if_needed(loc_bp_buf)
     }
 }
 
+/* write the decimal representation of i into buf, which must have room for 21 chars,
+   and return its length; this is much cheaper than sprintf */
+int bp_itoa(BPLONG i, CHAR_PTR buf) {
+    CHAR tmp[24];
+    CHAR_PTR p = tmp+sizeof(tmp);
+    BPULONG u;
+    int len;
+
+    u = (i < 0) ? (BPULONG)0-(BPULONG)i : (BPULONG)i;
+    do {
+        *--p = (CHAR)('0'+u%10);
+        u /= 10;
+    } while (u != 0);
+    if (i < 0) *--p = '-';
+    len = (int)(tmp+sizeof(tmp)-p);
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+    return len;
+}
+
+void bp_write_int(BPLONG i) {
+    CHAR buf[24];
+    int len;
+
+    len = bp_itoa(i, buf);
+    fwrite(buf, 1, len, curr_out);
+}
+
 void bp_write_double(op)
     BPLONG op;
 {
@@ -404,7 +475,7 @@ int bp_write_double_update_pos(op)
     line_position += len;
     if (format_output_dest == 0) {
         fputs(bp_buf, curr_out);
-        fflush(curr_out);
+        FLUSH_IF_TTY(curr_out);
     } else {
         CHECK_CHARS_POOL_OVERFLOW(len);
         strcpy((chars_pool+chars_pool_index), bp_buf);
@@ -434,7 +505,7 @@ int bp_write_bigint_update_pos(op)
     line_position += len;
     if (format_output_dest == 0) {
         fputs(bp_buf+i, curr_out);
-        fflush(curr_out);
+        FLUSH_IF_TTY(curr_out);
     } else {
         CHECK_CHARS_POOL_OVERFLOW(len);
         strcpy((chars_pool+chars_pool_index), bp_buf+i);
@@ -528,7 +599,7 @@ void bp_write_pname(name_ptr)
     CHAR_PTR name_ptr;
 {
     fputs(name_ptr, curr_out);
-    fflush(curr_out);
+    FLUSH_IF_TTY(curr_out);
 }
 
 int bp_write_pname_update_pos(name_ptr, length)
@@ -538,7 +609,7 @@ int bp_write_pname_update_pos(name_ptr, length)
     line_position += length;
     if (format_output_dest == 0) {
         fputs(name_ptr, curr_out);
-        fflush(curr_out);
+        FLUSH_IF_TTY(curr_out);
     } else {
         CHECK_CHARS_POOL_OVERFLOW(length);
         strcpy((chars_pool+chars_pool_index), name_ptr);
@@ -666,7 +737,7 @@ void bp_write_qname(name_ptr, length)
 {
     bp_write_qname_to_bp_buf(name_ptr, length);
     fputs(bp_buf, curr_out);
-    fflush(curr_out);
+    FLUSH_IF_TTY(curr_out);
 }
 
 int bp_write_qname_update_pos(name_ptr, length)
@@ -787,11 +858,10 @@ int bp_write_int_update_pos(op)
 {
     BPLONG len;
 
-    sprintf(bp_buf, BPLONG_FMT_STR, op);
-    len = strlen(bp_buf);
+    len = bp_itoa(op, bp_buf);
     line_position += len;
     if (format_output_dest == 0) {
-        fprintf(curr_out, BPLONG_FMT_STR, op);
+        fwrite(bp_buf, 1, len, curr_out);
     } else {
         CHECK_CHARS_POOL_OVERFLOW(len);
         strcpy((chars_pool+chars_pool_index), bp_buf);
@@ -964,8 +1034,7 @@ int b_WRITENAME_c(op)
                       sym_ptr = GET_ATM_SYM_REC(op);
                       bp_write_pname(GET_NAME(sym_ptr));
                   } else {
-                      op = INTVAL(op);
-                      fprintf(curr_out, BPLONG_FMT_STR, op);
+                      bp_write_int(INTVAL(op));
                   }
               },
               {fprintf(curr_out, ".");},
@@ -1081,8 +1150,7 @@ int b_WRITE_QUICK_c(op)
                       sym_ptr = GET_ATM_SYM_REC(op);
                       bp_write_pname(GET_NAME(sym_ptr));
                   } else {
-                      op = INTVAL(op);
-                      fprintf(curr_out, BPLONG_FMT_STR, op);
+                      bp_write_int(INTVAL(op));
                   }
               },
               {return BP_FALSE;},
@@ -1150,8 +1218,7 @@ int b_WRITEQNAME_c(op)
                       sym_ptr = GET_ATM_SYM_REC(op);
                       bp_write_qname(GET_NAME(sym_ptr), GET_LENGTH(sym_ptr));
                   } else {
-                      op = INTVAL(op);
-                      fprintf(curr_out, BPLONG_FMT_STR, op);
+                      bp_write_int(INTVAL(op));
                   }
               },
               {fprintf(curr_out, ".");},
@@ -1212,8 +1279,7 @@ int b_WRITEQ_QUICK_c(op)
                       sym_ptr = GET_ATM_SYM_REC(op);
                       bp_write_qname(GET_NAME(sym_ptr), GET_LENGTH(sym_ptr));
                   } else {
-                      op = INTVAL(op);
-                      fprintf(curr_out, BPLONG_FMT_STR, op);
+                      bp_write_int(INTVAL(op));
                   }
               },
               {return BP_FALSE;},
@@ -1263,7 +1329,7 @@ int c_fmt_nl() {
     out_line_no++; line_position = 0;
     if (format_output_dest == 0) {
         putc('\n', curr_out);
-        fflush(curr_out);
+        FLUSH_IF_CONSOLE(curr_out);
     } else {
         CHECK_CHARS_POOL_OVERFLOW(1);
         chars_pool[chars_pool_index++] = '\n';
@@ -1274,7 +1340,7 @@ int c_fmt_nl() {
 int b_NL()
 {
     putc('\n', curr_out);
-    fflush(curr_out);
+    FLUSH_IF_CONSOLE(curr_out);
     return BP_TRUE;
 }
 
@@ -1436,7 +1502,7 @@ int b_GET_BYTE_f(op)
         bp_exception = c_permission_error(et_INPUT, et_TEXT_STREAM, c_stream_struct(in_file_i));
         return BP_ERROR;
     }
-    n = getc(curr_in);
+    n = GETC_UNLOCKED(curr_in);
 
     if (n == EOF) {
         clearerr(curr_in);
@@ -1464,7 +1530,7 @@ int b_GET_CODE_f(op)
         bp_exception = c_permission_error(et_INPUT, et_BINARY_STREAM, c_stream_struct(in_file_i));
         return BP_ERROR;
     }
-    n = getc(curr_in);
+    n = GETC_UNLOCKED(curr_in);
 
     if (n == 0) {
         bp_exception = c_representation_error(et_CHARACTER);
@@ -1492,7 +1558,7 @@ int b_GET0_f(op)
 {
     BPLONG n;
 
-    n = getc(curr_in);
+    n = GETC_UNLOCKED(curr_in);
 
     if (n == EOF)
         clearerr(curr_in);
@@ -1517,7 +1583,7 @@ int b_PEEK_BYTE_f(op)
         return BP_ERROR;
     }
 
-    n = getc(curr_in);
+    n = GETC_UNLOCKED(curr_in);
 
     if (n == EOF)
         clearerr(curr_in);
@@ -1544,7 +1610,7 @@ int b_PEEK_CODE_f(op)
         return BP_ERROR;
     }
 
-    n = getc(curr_in);
+    n = GETC_UNLOCKED(curr_in);
 
     if (n == EOF) {
         clearerr(curr_in);
@@ -1586,7 +1652,7 @@ int b_GET_f(op)
     BPLONG n;
 
     do {
-        n = getc(curr_in);
+        n = GETC_UNLOCKED(curr_in);
     } while (n != EOF && (n <= 32 || n >= 127));
     if (n == EOF) {
         clearerr(curr_in);
@@ -1655,10 +1721,10 @@ int c_CP_FILE_cc() {
         bp_exception = output_stream_expected;
         return BP_ERROR;
     }
-    b = getc(in_fptr);
+    b = GETC_UNLOCKED(in_fptr);
     while (b != EOF) {
         putc(b, out_fptr);
-        b = getc(in_fptr);
+        b = GETC_UNLOCKED(in_fptr);
     }
     return BP_TRUE;
 }
@@ -1774,6 +1840,7 @@ int b_TELL_cc(fop, mode)
             bp_exception = c_permission_error(et_OPEN, et_SOURCE_SINK, fop);
             return BP_ERROR;
         }
+        setvbuf(tempfile, NULL, _IOFBF, OUT_BUF_SIZE);
         temp_out_file_i = next_file_index();
         if (temp_out_file_i < 0) {
             bp_exception = out_of_range; return BP_ERROR;
@@ -1802,8 +1869,13 @@ int b_TELL_cc(fop, mode)
 int b_TOLD()
 {
     if (out_file_i >= 3) {
+        int res;
         fclose(file_table[out_file_i].fdes);
+        res = cnf_dump_closed(out_file_i);
         release_file_index(out_file_i);
+        out_file_i = 1;  /* reset to user */
+        curr_out = file_table[out_file_i].fdes;
+        return res;
     }
     out_file_i = 1;  /* reset to user */
     curr_out = file_table[out_file_i].fdes;
@@ -1866,6 +1938,8 @@ int b_OPEN_ccf(fop, sop, Index)
         bp_exception = c_permission_error(et_OPEN, et_SOURCE_SINK, fop);
         return BP_ERROR;
     }
+    setvbuf(tempfile, NULL, _IOFBF, (mode == READ_MODE) ? IN_BUF_SIZE : OUT_BUF_SIZE);
+    if (mode == READ_MODE) note_loaded_file(full_file_name);
     index = next_file_index();
     if (index < 0) {
         bp_exception = out_of_range; return BP_ERROR;
@@ -1889,6 +1963,66 @@ int b_OPEN_ccf(fop, sop, Index)
     return 1;
 }
 
+/* The source (.pi) and byte-code (.qi) files read so far, by module name, so that the
+   table store can key on the files a program was actually loaded from. A module that
+   is read again is remembered by its latest file. */
+typedef struct loaded_file {
+    struct loaded_file *next;
+    CHAR_PTR module;
+    CHAR_PTR path;
+} LOADED_FILE, *LOADED_FILE_PTR;
+
+static LOADED_FILE_PTR loaded_files = NULL;
+
+void note_loaded_file(CHAR_PTR name) {
+    LOADED_FILE_PTR lf;
+    CHAR_PTR base, ext, path;
+    size_t len;
+
+    base = strrchr(name, '/');
+#ifdef WIN32
+    if (strrchr(name, '\\') > base) base = strrchr(name, '\\');
+#endif
+    base = (base == NULL) ? name : base+1;
+    ext = strrchr(base, '.');
+    if (ext == NULL || ext == base || (strcmp(ext, ".pi") != 0 && strcmp(ext, ".qi") != 0)) return;
+    len = ext-base;
+#ifdef WIN32
+    path = _fullpath(NULL, name, 0);
+#else
+    path = realpath(name, NULL);  /* the program may change its working directory */
+#endif
+    if (path == NULL) return;
+    for (lf = loaded_files; lf != NULL; lf = lf->next) {
+        if (strlen(lf->module) == len && strncmp(lf->module, base, len) == 0) {
+            free(lf->path);
+            lf->path = path;
+            return;
+        }
+    }
+    lf = (LOADED_FILE_PTR)malloc(sizeof(LOADED_FILE));
+    if (lf == NULL || (lf->module = (CHAR_PTR)malloc(len+1)) == NULL) {
+        if (lf != NULL) free(lf);
+        free(path);
+        return;
+    }
+    memcpy(lf->module, base, len);
+    lf->module[len] = '\0';
+    lf->path = path;
+    lf->next = loaded_files;
+    loaded_files = lf;
+}
+
+/* the full path of the file the module was last read from, or NULL */
+CHAR_PTR loaded_file_path(CHAR_PTR module, BPLONG len) {
+    LOADED_FILE_PTR lf;
+
+    for (lf = loaded_files; lf != NULL; lf = lf->next) {
+        if ((BPLONG)strlen(lf->module) == len && strncmp(lf->module, module, len) == 0) return lf->path;
+    }
+    return NULL;
+}
+
 /* this function is by Steve Branch */
 int get_socket_fd(int index) {
 #ifdef WIN32
@@ -1948,7 +2082,9 @@ int b_CLOSE_c(Index)
         if (i >= MAXFILES || file_table[i].fdes == NULL) {
             return BP_FALSE;
         }
+        int res;
         fclose(file_table[i].fdes);
+        res = cnf_dump_closed(i);
         release_file_index(i);
         if (in_file_i == i) {
             in_file_i = 0;  /* reset to user */
@@ -1957,7 +2093,7 @@ int b_CLOSE_c(Index)
             out_file_i = 1;  /* reset to user */
             curr_out = file_table[out_file_i].fdes;
         }
-        return 1;
+        return res;
     }
     return 1;
 }
@@ -1995,6 +2131,8 @@ void file_init() {
     in_file_i = 0;
     curr_in = stdin;
 
+    stdout_is_tty = isatty(fileno(stdout));
+
     file_table[1].mode = APPEND_MODE;
     file_table[1].name_atom = user_output_word;
     file_table[1].fdes = stdout;
@@ -2491,10 +2629,10 @@ lab_start:
         fprintf(curr_out, "|");
         write_term(op);
         fprintf(curr_out, "]");
-        fflush(curr_out);
+        FLUSH_IF_TTY(curr_out);
     } else{
         fprintf(curr_out, "]");
-        fflush(curr_out);
+        FLUSH_IF_TTY(curr_out);
     }
 }
 
@@ -2514,7 +2652,7 @@ int write_term(op)
                       sym_ptr = GET_ATM_SYM_REC(op);
                       bp_write_pname(GET_NAME(sym_ptr));
                   }
-                  else fprintf(curr_out, BPLONG_FMT_STR, INTVAL(op));},
+                  else bp_write_int(INTVAL(op));},
 
               {if (IsNumberedVar(op)) {fprintf(curr_out, "$V(" BPULONG_FMT_STR ")", INTVAL(op));} else { fprintf(curr_out, "["); write_list(op);}},
 
@@ -3101,10 +3239,10 @@ int b_ATOM_CONCAT_ccf(BPLONG a1, BPLONG a2, BPLONG a3) {
 }
 
 /*
-  matm = "e$$glb$$" ++ atm
+  matm = "e$$glb$$" ++ atm, or "e$$M$$" ++ atm if a default module M defines atm
 */
 int c_module_glb_pred_name() {
-    BPLONG atm, matm;
+    BPLONG atm, matm, default_atm;
     SYM_REC_PTR sym_ptr;
     CHAR_PTR char_ptr;
     int len;
@@ -3126,15 +3264,20 @@ int c_module_glb_pred_name() {
     *char_ptr = '\0';
     len = char_ptr - bp_buf;
 
+    default_atm = default_module_name(bp_buf+8, len-8);
+    if (default_atm != 0) {
+        unify(matm, default_atm);
+        return BP_TRUE;
+    }
     unify(matm, ADDTAG(insert_sym(bp_buf, len, 0), ATM));
     return BP_TRUE;
 }
 
 /*
-  matm = "e$$glb$$f$$" ++ atm
+  matm = "e$$glb$$f$$" ++ atm, or "e$$M$$f$$" ++ atm if a default module M defines atm
 */
 int c_module_glb_func_name() {
-    BPLONG atm, matm;
+    BPLONG atm, matm, default_atm;
     SYM_REC_PTR sym_ptr;
     CHAR_PTR char_ptr;
     int len;
@@ -3157,6 +3300,11 @@ int c_module_glb_func_name() {
     *char_ptr = '\0';
     len = char_ptr - bp_buf;
 
+    default_atm = default_module_name(bp_buf+8, len-8);
+    if (default_atm != 0) {
+        unify(matm, default_atm);
+        return BP_TRUE;
+    }
     unify(matm, ADDTAG(insert_sym(bp_buf, len, 0), ATM));
     return BP_TRUE;
 }
@@ -3241,7 +3389,7 @@ int print_term_to_buf(BPLONG term) {
     if (ISREF(term)) {
         sprintf(bp_buf, "_" BPULONG_FMT_STR, (BPULONG)term-(BPULONG)stack_low_addr);
     } else if (ISINT(term)) {
-        sprintf(bp_buf, BPLONG_FMT_STR, INTVAL(term));
+        bp_itoa(INTVAL(term), bp_buf);
     } else if (ISATOM(term)) {
         SYM_REC_PTR sym_ptr;
         sym_ptr = (SYM_REC_PTR)GET_ATM_SYM_REC(term);
@@ -3525,7 +3673,7 @@ int b_READ_BYTE_cf(BPLONG FDIndex, BPLONG Byt) {
         return BP_ERROR;
     }
     in_fptr = file_table[FDIndex].fdes;
-    b = getc(in_fptr);
+    b = GETC_UNLOCKED(in_fptr);
     if (b == EOF) clearerr(in_fptr);
     ASSIGN_f_atom(Byt, MAKEINT(b));
 
@@ -3544,7 +3692,7 @@ int b_PEEK_BYTE_cf(BPLONG FDIndex, BPLONG Byt) {
         return BP_ERROR;
     }
     in_fptr = file_table[FDIndex].fdes;
-    b = getc(in_fptr);
+    b = GETC_UNLOCKED(in_fptr);
     if (b == EOF) {
         clearerr(in_fptr);
     } else {
@@ -3571,7 +3719,7 @@ int b_READ_BYTE_ccf(BPLONG FDIndex, BPLONG N, BPLONG Lst) {
     in_fptr = file_table[FDIndex].fdes;
 
     DEREF(N); N = INTVAL(N);
-    b = getc(in_fptr);
+    b = GETC_UNLOCKED(in_fptr);
     ret_lst_ptr = &ret_lst;
     while (b != EOF && N > 0) {
         FOLLOW(heap_top) = MAKEINT(b);
@@ -3579,7 +3727,7 @@ int b_READ_BYTE_ccf(BPLONG FDIndex, BPLONG N, BPLONG Lst) {
         heap_top++;
         ret_lst_ptr = heap_top++;
         LOCAL_OVERFLOW_CHECK("read_byte");
-        b = getc(in_fptr);
+        b = GETC_UNLOCKED(in_fptr);
         N--;
     }
     if (b == EOF) {
@@ -3608,7 +3756,7 @@ int b_READ_CHAR_cf(BPLONG FDIndex, BPLONG Ch) {
     in_fptr = file_table[FDIndex].fdes;
     file_table[FDIndex].lastc = ' ';
 
-    b = getc(in_fptr);
+    b = GETC_UNLOCKED(in_fptr);
     if (b == EOF) {
         clearerr(in_fptr);
         b = eof_atom;
@@ -3639,7 +3787,7 @@ int b_PEEK_CHAR_cf(BPLONG FDIndex, BPLONG Ch) {
     }
     in_fptr = file_table[FDIndex].fdes;
 
-    b = getc(in_fptr);
+    b = GETC_UNLOCKED(in_fptr);
     if (b == EOF) {
         clearerr(in_fptr);
         b = eof_atom;
@@ -3679,7 +3827,7 @@ int b_READ_CHAR_ccf(BPLONG FDIndex, BPLONG N, BPLONG Lst) {
     file_table[FDIndex].lastc = ' ';
     in_fptr = file_table[FDIndex].fdes;
     DEREF(N); N = INTVAL(N);
-    b = getc(in_fptr);
+    b = GETC_UNLOCKED(in_fptr);
     ret_lst_ptr = &ret_lst;
     while (b != EOF && N > 0) {
         if (b & 0x80) {  /* leading byte of a utf8 char? */
@@ -3696,7 +3844,7 @@ int b_READ_CHAR_ccf(BPLONG FDIndex, BPLONG N, BPLONG Lst) {
         heap_top++;
         ret_lst_ptr = heap_top++;
         LOCAL_OVERFLOW_CHECK("read_char");
-        b = getc(in_fptr);
+        b = GETC_UNLOCKED(in_fptr);
         N--;
     }
     if (b == EOF) {
@@ -3725,7 +3873,7 @@ int b_READ_CHAR_CODE_cf(BPLONG FDIndex, BPLONG Ch) {
     file_table[FDIndex].lastc = ' ';
     in_fptr = file_table[FDIndex].fdes;
 
-    b = getc(in_fptr);
+    b = GETC_UNLOCKED(in_fptr);
     if (b == EOF) {
         clearerr(in_fptr);
         b = -1;
@@ -3750,7 +3898,7 @@ int b_PEEK_CHAR_CODE_cf(BPLONG FDIndex, BPLONG Ch) {
     }
     in_fptr = file_table[FDIndex].fdes;
 
-    b = getc(in_fptr);
+    b = GETC_UNLOCKED(in_fptr);
     if (b == EOF) {
         clearerr(in_fptr);
         b = -1;
@@ -3787,7 +3935,7 @@ int b_READ_CHAR_CODE_ccf(BPLONG FDIndex, BPLONG N, BPLONG Lst) {
     file_table[FDIndex].lastc = ' ';
     in_fptr = file_table[FDIndex].fdes;
     DEREF(N); N = INTVAL(N);
-    b = getc(in_fptr);
+    b = GETC_UNLOCKED(in_fptr);
     ret_lst_ptr = &ret_lst;
     while (b != EOF && N > 0) {
         if (b & 0x80) {  /* leading byte of a utf8 char? */
@@ -3798,7 +3946,7 @@ int b_READ_CHAR_CODE_ccf(BPLONG FDIndex, BPLONG N, BPLONG Lst) {
         heap_top++;
         ret_lst_ptr = heap_top++;
         LOCAL_OVERFLOW_CHECK("read_char_code");
-        b = getc(in_fptr);
+        b = GETC_UNLOCKED(in_fptr);
         N--;
     }
     if (b == EOF) {
@@ -3824,14 +3972,14 @@ int b_READ_FILE_BYTES_cf(BPLONG FDIndex, BPLONG Lst) {
     in_fptr = file_table[FDIndex].fdes;
     file_table[FDIndex].lastc = ' ';
 
-    b = getc(in_fptr);
+    b = GETC_UNLOCKED(in_fptr);
     ret_lst_ptr = &ret_lst;
     while (b != EOF) {
         FOLLOW(heap_top) = MAKEINT(b);
         FOLLOW(ret_lst_ptr) = ADDTAG(heap_top, LST);
         heap_top++;
         ret_lst_ptr = heap_top++;
-        b = getc(in_fptr);
+        b = GETC_UNLOCKED(in_fptr);
     }
     clearerr(in_fptr);
     FOLLOW(ret_lst_ptr) = nil_sym;
@@ -3852,7 +4000,7 @@ int b_READ_FILE_CHARS_cf(BPLONG FDIndex, BPLONG Lst) {
     in_fptr = file_table[FDIndex].fdes;
     file_table[FDIndex].lastc = ' ';
 
-    b = getc(in_fptr);
+    b = GETC_UNLOCKED(in_fptr);
     ret_lst_ptr = &ret_lst;
     while (b != EOF) {
         if (b & 0x80) {  /* leading byte of a utf8 char? */
@@ -3868,7 +4016,7 @@ int b_READ_FILE_CHARS_cf(BPLONG FDIndex, BPLONG Lst) {
         FOLLOW(ret_lst_ptr) = ADDTAG(heap_top, LST);
         heap_top++;
         ret_lst_ptr = heap_top++;
-        b = getc(in_fptr);
+        b = GETC_UNLOCKED(in_fptr);
     }
     clearerr(in_fptr);
     FOLLOW(ret_lst_ptr) = nil_sym;
@@ -3889,7 +4037,7 @@ int b_READ_FILE_CODES_cf(BPLONG FDIndex, BPLONG Lst) {
     file_table[FDIndex].lastc = ' ';
     in_fptr = file_table[FDIndex].fdes;
 
-    b = getc(in_fptr);
+    b = GETC_UNLOCKED(in_fptr);
     ret_lst_ptr = &ret_lst;
     while (b != EOF) {
         if (b & 0x80) {  /* leading byte of a utf8 char? */
@@ -3899,7 +4047,7 @@ int b_READ_FILE_CODES_cf(BPLONG FDIndex, BPLONG Lst) {
         FOLLOW(ret_lst_ptr) = ADDTAG(heap_top, LST);
         heap_top++;
         ret_lst_ptr = heap_top++;
-        b = getc(in_fptr);
+        b = GETC_UNLOCKED(in_fptr);
     }
     clearerr(in_fptr);
     FOLLOW(ret_lst_ptr) = nil_sym;
@@ -3924,12 +4072,12 @@ int b_READ_LINE_cf(BPLONG FDIndex, BPLONG Lst) {
     file_table[FDIndex].lastc = ' ';
     in_fptr = file_table[FDIndex].fdes;
 
-    b = getc(in_fptr);
+    b = GETC_UNLOCKED(in_fptr);
     ret_lst_ptr = &ret_lst;
     while (b != EOF && b != '\n') {
         unsigned char c = (unsigned char)b;
         if (c == '\r'){
-            b = getc(in_fptr);
+            b = GETC_UNLOCKED(in_fptr);
             continue;
         }
         if (b & 0x80) {  /* leading byte of a utf8 char? */
@@ -3946,7 +4094,7 @@ int b_READ_LINE_cf(BPLONG FDIndex, BPLONG Lst) {
         heap_top++;
         LOCAL_OVERFLOW_CHECK("read_line");
         ret_lst_ptr = heap_top++;
-        b = getc(in_fptr);
+        b = GETC_UNLOCKED(in_fptr);
     }
     if (b == EOF) {
         clearerr(in_fptr);
@@ -3961,6 +4109,551 @@ int b_READ_LINE_cf(BPLONG FDIndex, BPLONG Lst) {
     return BP_TRUE;
 }
 
+/***********************************************/
+/* Memory-mapped input files. The file is mapped as a whole, but its
+   contents are converted into heap terms only as the consumer asks for
+   them, so the heap space used is bounded by the line or chunk size
+   rather than the file size.
+*/
+static CHAR mmap_empty_file[1];
+
+/* open File for mapped reading; MFD is unified with '$mmap'(Index) */
+int c_MMAP_OPEN_cf() {
+    BPLONG File, MFD, Handle;
+    BPLONG i, size;
+    CHAR_PTR base;
+#ifdef WIN32
+    FILE *fp;
+#else
+    int fd;
+    struct stat st;
+#endif
+
+    File = ARG(1, 2); DEREF(File);
+    MFD = ARG(2, 2);
+    if (check_file_term(File) != BP_TRUE) return BP_ERROR;
+    get_file_name(File);
+
+    for (i = 0; i < MAXFILES; i++) {
+        if (mmap_table[i].base == NULL) break;
+    }
+    if (i == MAXFILES) {
+        bp_exception = out_of_range; return BP_ERROR;
+    }
+
+#ifdef WIN32
+    fp = fopen(full_file_name, "rb");
+    if (fp == NULL) {
+        bp_exception = c_existence_error(et_SOURCE_SINK, File);
+        return BP_ERROR;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size == 0) {
+        base = mmap_empty_file;
+    } else {
+        base = (CHAR_PTR)malloc(size);
+        if (base == NULL || fread(base, 1, size, fp) != (size_t)size) {
+            if (base != NULL) free(base);
+            fclose(fp);
+            bp_exception = et_OUT_OF_MEMORY; return BP_ERROR;
+        }
+    }
+    fclose(fp);
+#else
+    fd = open(full_file_name, O_RDONLY);
+    if (fd < 0) {
+        bp_exception = c_existence_error(et_SOURCE_SINK, File);
+        return BP_ERROR;
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        bp_exception = c_permission_error(et_OPEN, et_SOURCE_SINK, File);
+        return BP_ERROR;
+    }
+    size = (BPLONG)st.st_size;
+    if (size == 0) {
+        base = mmap_empty_file;
+    } else {
+        base = (CHAR_PTR)mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == (CHAR_PTR)MAP_FAILED) {
+            close(fd);
+            bp_exception = et_OUT_OF_MEMORY; return BP_ERROR;
+        }
+        madvise(base, (size_t)size, MADV_SEQUENTIAL);
+    }
+    close(fd);  /* the mapping stays valid after the descriptor is closed */
+#endif
+    mmap_table[i].base = base;
+    mmap_table[i].size = size;
+    mmap_table[i].pos = 0;
+    mmap_table[i].engine = bp_current_engine();
+    mmap_num_open++;
+    Handle = ADDTAG(heap_top, STR);
+    NEW_HEAP_NODE((BPLONG)mmap_psc);
+    NEW_HEAP_NODE(MAKEINT(i));
+    return unify(MFD, Handle);
+}
+
+static void mmap_unmap(BPLONG index) {
+    if (mmap_table[index].base != mmap_empty_file) {
+#ifdef WIN32
+        free(mmap_table[index].base);
+#else
+        munmap(mmap_table[index].base, (size_t)mmap_table[index].size);
+#endif
+    }
+    mmap_table[index].base = NULL;
+    mmap_num_open--;
+}
+
+/* unmap the files that engine e has mapped; called when e is released or freed,
+   and before each query of the top level, whose earlier queries' bindings are gone */
+void mmap_release_engine(BP_ENGINE_PTR e) {
+    BPLONG i;
+
+    for (i = 0; mmap_num_open > 0 && i < MAXFILES; i++) {
+        if (mmap_table[i].base != NULL && mmap_table[i].engine == e) mmap_unmap(i);
+    }
+}
+
+int c_MMAP_CLOSE_c() {
+    BPLONG MFD, Index;
+
+    MFD = ARG(1, 1); DEREF(MFD);
+    GET_MMAP_INDEX(MFD, Index);
+    mmap_unmap(Index);
+    return BP_TRUE;
+}
+
+int c_MMAP_AT_EOF_c() {
+    BPLONG MFD, Index;
+
+    MFD = ARG(1, 1); DEREF(MFD);
+    GET_MMAP_INDEX(MFD, Index);
+    return (mmap_table[Index].pos >= mmap_table[Index].size) ? BP_TRUE : BP_FALSE;
+}
+
+/* return the number of bytes of the utf8 char at s, never crossing end */
+static int mmap_utf8_char_len(CHAR_PTR s, CHAR_PTR end) {
+    int c, n, i;
+
+    c = (BYTE)*s;
+    if (c < 0x80) return 1;
+    if ((c & 0xe0) == 0xc0) {
+        n = 2;
+    } else if ((c & 0xf0) == 0xe0) {
+        n = 3;
+    } else if ((c & 0xf8) == 0xf0) {
+        n = 4;
+    } else {
+        return 1;  /* not utf8, take the byte as a char */
+    }
+    if (s+n > end) return 1;
+    for (i = 1; i < n; i++) {
+        if ((*(s+i) & 0xc0) != 0x80) return 1;
+    }
+    return n;
+}
+
+/* word-at-a-time byte tests: a word has no byte >= 0x80, or has a zero byte */
+#define SWAR_ONES 0x0101010101010101ULL
+#define SWAR_HIGHS 0x8080808080808080ULL
+#define SWAR_HAS_ZERO_BYTE(w) (((w) - SWAR_ONES) & ~(w) & SWAR_HIGHS)
+
+/* build a string of the bytes in [s,end) on the heap; the caller has checked the space */
+static BPLONG mmap_bytes_to_picat_str(CHAR_PTR s, CHAR_PTR end) {
+    BPLONG ret_lst;
+    BPLONG_PTR ret_lst_ptr;
+    BPLONG ch;
+    BPULONG w;
+    int i, len;
+
+    ret_lst_ptr = &ret_lst;
+    while (s < end) {
+        if (end-s >= 8) {  /* fast path for a block of 8 ASCII chars */
+            memcpy(&w, s, 8);
+            if ((w & SWAR_HIGHS) == 0) {
+                for (i = 0; i < 8; i++) {
+                    FOLLOW(heap_top) = char_sym_table[(int)s[i]];
+                    FOLLOW(ret_lst_ptr) = ADDTAG(heap_top, LST);
+                    heap_top++;
+                    ret_lst_ptr = heap_top++;
+                }
+                s += 8;
+                continue;
+            }
+        }
+        len = mmap_utf8_char_len(s, end);
+        if (len == 1 && !(*s & 0x80)) {
+            ch = char_sym_table[(int)*s];
+        } else {
+            ch = ADDTAG(insert_sym(s, len, 0), ATM);
+        }
+        s += len;
+        FOLLOW(heap_top) = ch;
+        FOLLOW(ret_lst_ptr) = ADDTAG(heap_top, LST);
+        heap_top++;
+        ret_lst_ptr = heap_top++;
+    }
+    FOLLOW(ret_lst_ptr) = nil_sym;
+    return ret_lst;
+}
+
+/* read the next line into a string, without its LF or CRLF ending; end_of_file is returned after the last line */
+int c_MMAP_READ_LINE_cf() {
+    BPLONG MFD, Index, Line;
+    CHAR_PTR s, end, nl;
+    BPLONG len;
+
+    MFD = ARG(1, 2); DEREF(MFD);
+    Line = ARG(2, 2);
+    GET_MMAP_INDEX(MFD, Index);
+
+    if (mmap_table[Index].pos >= mmap_table[Index].size) {
+        return unify(Line, eof_atom);
+    }
+    s = mmap_table[Index].base + mmap_table[Index].pos;
+    end = mmap_table[Index].base + mmap_table[Index].size;
+    nl = (CHAR_PTR)memchr(s, '\n', (size_t)(end - s));
+    if (nl == NULL) nl = end;
+    len = nl - s;
+    LOCAL_OVERFLOW_CHECK_WITH_MARGIN("mmap_read_line", 2*len+LARGE_MARGIN);
+    mmap_table[Index].pos += (nl < end) ? len+1 : len;
+    if (nl < end && nl > s && *(nl-1) == '\r') nl--;
+    return unify(Line, mmap_bytes_to_picat_str(s, nl));
+}
+
+/* read up to N (>0) chars; end_of_file is returned when no char is left */
+int c_MMAP_READ_CHARS_ccf() {
+    BPLONG MFD, Index, N, Lst;
+    CHAR_PTR s, s0, end;
+    BPLONG i, n;
+
+    MFD = ARG(1, 3); DEREF(MFD);
+    N = ARG(2, 3); DEREF(N);
+    Lst = ARG(3, 3);
+    GET_MMAP_INDEX(MFD, Index);
+    if (!ISINT(N) || INTVAL(N) <= 0) {
+        bp_exception = illegal_arguments; return BP_ERROR;
+    }
+    n = INTVAL(N);
+
+    if (mmap_table[Index].pos >= mmap_table[Index].size) {
+        return unify(Lst, eof_atom);
+    }
+    s0 = s = mmap_table[Index].base + mmap_table[Index].pos;
+    end = mmap_table[Index].base + mmap_table[Index].size;
+    for (i = 0; i < n && s < end; i++) {
+        s += mmap_utf8_char_len(s, end);
+    }
+    LOCAL_OVERFLOW_CHECK_WITH_MARGIN("mmap_read_chars", 2*i+LARGE_MARGIN);
+    mmap_table[Index].pos += (s - s0);
+    return unify(Lst, mmap_bytes_to_picat_str(s0, s));
+}
+
+/************ bulk fact loader ************/
+/*
+  c_LOAD_DELIMITED_FACTS_cccccccccf(File, Name, Sep, Quote, Header, Types, Offset, NCols, Res)
+
+  Each row of a CSV/TSV file becomes a fact Name(F1,...,Fn) that is added
+  to the dynamic predicate Name/n by assertz. A row is parsed into a C
+  buffer, converted into a term on the heap, copied into the clause store,
+  and the heap space is reclaimed before the next row is read, so the heap
+  usage does not depend on the size of the file.
+
+  Loading starts at byte Offset of the file; NCols is the number of fields
+  of the rows read so far, or -1 if there are none. Res is the number of
+  facts added if the file has been loaded. If a row does not fit in the
+  free heap space, Res is gc(Words,Offset1,NCols1,Count): Count facts have
+  been added, and the caller should collect garbage so that Words words
+  are free and call again with Offset1 and NCols1 to load the rest.
+
+  Sep and Quote are char codes (Quote = 0 disables quoting); a quoted
+  field may contain separators, newlines, and doubled quotes. Header = 1
+  skips the first row. Types is a list of column types, one of the
+  LOAD_COL_ codes below; columns beyond the list are LOAD_COL_AUTO.
+*/
+#define LOAD_COL_AUTO 0
+#define LOAD_COL_INT 1
+#define LOAD_COL_FLOAT 2
+#define LOAD_COL_NUMBER 3
+#define LOAD_COL_ATOM 4
+#define LOAD_COL_STRING 5
+#define LOAD_COL_SKIP 6
+
+#define LOAD_MAX_TYPES 256
+
+struct load_row {
+    CHAR_PTR buf;  /* field contents, each one terminated by '\0' */
+    BPLONG buf_size;
+    BPLONG top;
+    BPLONG *fields;  /* offsets of the fields in buf */
+    BPLONG fields_size;
+    BPLONG nfields;
+};
+
+static int load_row_put(struct load_row *row, int c) {
+    if (row->top >= row->buf_size) {
+        CHAR_PTR new_buf = (CHAR_PTR)realloc(row->buf, 2*row->buf_size);
+        if (new_buf == NULL) return 0;
+        row->buf = new_buf;
+        row->buf_size *= 2;
+    }
+    row->buf[row->top++] = (CHAR)c;
+    return 1;
+}
+
+static int load_row_new_field(struct load_row *row) {
+    if (row->nfields >= row->fields_size) {
+        BPLONG *new_fields = (BPLONG *)realloc(row->fields, 2*row->fields_size*sizeof(BPLONG));
+        if (new_fields == NULL) return 0;
+        row->fields = new_fields;
+        row->fields_size *= 2;
+    }
+    row->fields[row->nfields++] = row->top;
+    return 1;
+}
+
+/* read a row into row; returns the number of fields, 0 at the end of the file, or -1 if out of memory */
+static BPLONG load_read_row(FILE *fp, struct load_row *row, int sep, int quote) {
+    int c, in_quote = 0, at_field_start = 1;
+
+    row->top = 0;
+    row->nfields = 0;
+    c = GETC_UNLOCKED(fp);
+    while (c == '\n' || c == '\r') c = GETC_UNLOCKED(fp);  /* skip empty lines */
+    if (c == EOF) return 0;
+    if (!load_row_new_field(row)) return -1;
+    for (;;) {
+        if (in_quote) {
+            if (c == EOF) break;
+            if (c == quote) {
+                c = GETC_UNLOCKED(fp);
+                if (c != quote) {
+                    in_quote = 0;
+                    continue;
+                }
+            }
+            if (!load_row_put(row, c)) return -1;
+        } else if (c == EOF || c == '\n') {
+            break;
+        } else if (c == sep) {
+            if (!load_row_put(row, '\0') || !load_row_new_field(row)) return -1;
+            at_field_start = 1;
+            c = GETC_UNLOCKED(fp);
+            continue;
+        } else if (c == quote && at_field_start) {
+            in_quote = 1;
+        } else if (c != '\r') {
+            if (!load_row_put(row, c)) return -1;
+        }
+        at_field_start = 0;
+        c = GETC_UNLOCKED(fp);
+    }
+    if (!load_row_put(row, '\0')) return -1;
+    return row->nfields;
+}
+
+/* convert s, which is NUL-terminated, to an integer; returns 0 if it is not a small integer */
+static int load_parse_int(CHAR_PTR s, BPLONG len, BPLONG *val) {
+    BPLONG i = 0, v = 0;
+    int neg = 0;
+
+    if (len > 0 && (s[0] == '-' || s[0] == '+')) {
+        neg = (s[0] == '-');
+        i = 1;
+    }
+    if (i == len) return 0;
+    for (; i < len; i++) {
+        if (s[i] < '0' || s[i] > '9') return 0;
+        v = v*10 + (s[i]-'0');
+        if (v > BP_MAXINT_1W) return 0;
+    }
+    *val = neg ? -v : v;
+    return 1;
+}
+
+static int load_parse_float(CHAR_PTR s, BPLONG len, double *val) {
+    char *end;
+
+    if (len == 0) return 0;
+    *val = strtod((char *)s, &end);
+    return (end == (char *)s+len);
+}
+
+/* convert a field to a term on the heap; returns BP_ERROR with bp_exception set if the field does not match the type */
+static BPLONG load_field_to_term(CHAR_PTR s, BPLONG len, int type) {
+    BPLONG i;
+    double f;
+
+    switch (type) {
+    case LOAD_COL_INT:
+        if (load_parse_int(s, len, &i)) return MAKEINT(i);
+        bp_exception = c_type_error(et_INTEGER, ADDTAG(insert_sym(s, len, 0), ATM));
+        return BP_ERROR;
+    case LOAD_COL_FLOAT:
+        if (load_parse_float(s, len, &f)) return encodefloat1(f);
+        bp_exception = c_type_error(et_NUMBER, ADDTAG(insert_sym(s, len, 0), ATM));
+        return BP_ERROR;
+    case LOAD_COL_NUMBER:
+        if (load_parse_int(s, len, &i)) return MAKEINT(i);
+        if (load_parse_float(s, len, &f)) return encodefloat1(f);
+        bp_exception = c_type_error(et_NUMBER, ADDTAG(insert_sym(s, len, 0), ATM));
+        return BP_ERROR;
+    case LOAD_COL_STRING:
+        return mmap_bytes_to_picat_str(s, s+len);
+    case LOAD_COL_AUTO:
+        if (load_parse_int(s, len, &i)) return MAKEINT(i);
+        if (load_parse_float(s, len, &f)) return encodefloat1(f);
+        return ADDTAG(insert_sym(s, len, 0), ATM);
+    default:
+        return ADDTAG(insert_sym(s, len, 0), ATM);
+    }
+}
+
+int c_LOAD_DELIMITED_FACTS_cccccccccf() {
+    BPLONG File, Name, Sep, Quote, Header, Types, Offset, NCols, Res;
+    BPLONG count = 0, nfields, ncols, arity = 0, i, j, lst, row_offset, need = 0;
+    BPLONG_PTR heap_mark, ptr;
+    SYM_REC_PTR name_sym_ptr, sym_ptr = NULL;
+    BPLONG res = BP_TRUE;
+    int types[LOAD_MAX_TYPES];
+    BPLONG ntypes = 0;
+    struct load_row row;
+    FILE *fp;
+
+    File = ARG(1, 9); DEREF(File);
+    Name = ARG(2, 9); DEREF(Name);
+    Sep = ARG(3, 9); DEREF(Sep);
+    Quote = ARG(4, 9); DEREF(Quote);
+    Header = ARG(5, 9); DEREF(Header);
+    Types = ARG(6, 9); DEREF(Types);
+    Offset = ARG(7, 9); DEREF(Offset);
+    NCols = ARG(8, 9); DEREF(NCols);
+    Res = ARG(9, 9);
+    if (!ISATOM(Name) || !ISINT(Sep) || !ISINT(Quote) || !ISINT(Header) || !ISINT(Offset) || !ISINT(NCols)) {
+        bp_exception = illegal_arguments; return BP_ERROR;
+    }
+    while (ISLIST(Types)) {
+        ptr = (BPLONG_PTR)UNTAGGED_ADDR(Types);
+        lst = FOLLOW(ptr); DEREF(lst);
+        if (!ISINT(lst) || ntypes >= LOAD_MAX_TYPES) {
+            bp_exception = illegal_arguments; return BP_ERROR;
+        }
+        types[ntypes++] = (int)INTVAL(lst);
+        Types = FOLLOW(ptr+1); DEREF(Types);
+    }
+    if (check_file_term(File) != BP_TRUE) return BP_ERROR;
+    get_file_name(File);
+
+    fp = fopen(full_file_name, "rb");
+    if (fp == NULL) {
+        bp_exception = c_existence_error(et_SOURCE_SINK, File);
+        return BP_ERROR;
+    }
+    setvbuf(fp, NULL, _IOFBF, IN_BUF_SIZE);
+    if (INTVAL(Offset) > 0 && fseek(fp, (long)INTVAL(Offset), SEEK_SET) != 0) {
+        fclose(fp);
+        bp_exception = c_existence_error(et_SOURCE_SINK, File);
+        return BP_ERROR;
+    }
+
+    row.buf_size = 4096;
+    row.fields_size = 64;
+    row.buf = (CHAR_PTR)malloc(row.buf_size);
+    row.fields = (BPLONG *)malloc(row.fields_size*sizeof(BPLONG));
+    if (row.buf == NULL || row.fields == NULL) {
+        res = BP_ERROR; bp_exception = et_OUT_OF_MEMORY; goto load_end;
+    }
+    name_sym_ptr = GET_ATM_SYM_REC(Name);
+    ncols = INTVAL(NCols);
+    if (ncols >= 0) {
+        for (j = 0; j < ncols; j++) {
+            if (j >= ntypes || types[j] != LOAD_COL_SKIP) arity++;
+        }
+        if (arity > 0) {
+            sym_ptr = insert_sym(GET_NAME(name_sym_ptr), GET_LENGTH(name_sym_ptr), arity);
+        }
+    }
+
+    if (INTVAL(Offset) == 0 && INTVAL(Header) == 1 && load_read_row(fp, &row, (int)INTVAL(Sep), (int)INTVAL(Quote)) < 0) {
+        res = BP_ERROR; bp_exception = et_OUT_OF_MEMORY; goto load_end;
+    }
+    for (;;) {
+        BPLONG fact;
+
+        row_offset = (BPLONG)ftell(fp);
+        if ((nfields = load_read_row(fp, &row, (int)INTVAL(Sep), (int)INTVAL(Quote))) == 0) break;
+
+        if (nfields < 0) {
+            res = BP_ERROR; bp_exception = et_OUT_OF_MEMORY; goto load_end;
+        }
+        if (ncols < 0) {  /* the first row determines the arity */
+            ncols = nfields;
+            for (j = 0; j < ncols; j++) {
+                if (j >= ntypes || types[j] != LOAD_COL_SKIP) arity++;
+            }
+            if (arity > 0) {
+                sym_ptr = insert_sym(GET_NAME(name_sym_ptr), GET_LENGTH(name_sym_ptr), arity);
+            }
+        } else if (nfields != ncols) {
+            res = BP_ERROR;
+            bp_exception = c_syntax_error(ADDTAG(insert_sym("inconsistent_number_of_fields", 29, 0), ATM));
+            goto load_end;
+        }
+        /* strings take 2 words per byte and floats 4 words per field */
+        need = 2*row.top+4*nfields+arity+LARGE_MARGIN;
+        if (local_top - heap_top <= need) {  /* resume at this row after a GC */
+            break;
+        }
+        need = 0;
+        heap_mark = heap_top;
+        if (arity == 0) {
+            fact = Name;
+        } else {
+            ptr = heap_top;
+            heap_top += arity+1;
+            FOLLOW(ptr) = (BPLONG)sym_ptr;
+            for (i = 1, j = 0; j < ncols; j++) {
+                int type = (j < ntypes) ? types[j] : LOAD_COL_AUTO;
+                CHAR_PTR s;
+                BPLONG arg;
+                if (type == LOAD_COL_SKIP) continue;
+                s = row.buf+row.fields[j];
+                arg = load_field_to_term(s, (BPLONG)strlen((char *)s), type);
+                if (arg == BP_ERROR) {  /* the exception term is on the heap */
+                    res = BP_ERROR; goto load_end;
+                }
+                FOLLOW(ptr+i) = arg;
+                i++;
+            }
+            fact = ADDTAG(ptr, STR);
+        }
+        if (b_ASSERTZ_cc(fact, true_atom) == BP_ERROR) {
+            res = BP_ERROR; goto load_end;
+        }
+        heap_top = heap_mark;
+        count++;
+    }
+
+load_end:
+    fclose(fp);
+    free(row.buf);
+    free(row.fields);
+    if (res == BP_ERROR) return BP_ERROR;
+    if (need == 0) return unify(Res, MAKEINT(count));
+    ptr = heap_top;
+    heap_top += 5;
+    FOLLOW(ptr) = (BPLONG)insert_sym("gc", 2, 4);
+    FOLLOW(ptr+1) = MAKEINT(need);
+    FOLLOW(ptr+2) = MAKEINT(row_offset);
+    FOLLOW(ptr+3) = MAKEINT(ncols);
+    FOLLOW(ptr+4) = MAKEINT(count);
+    return unify(Res, ADDTAG(ptr, STR));
+}
+
 /* write one byte or a list of bytes into FD */
 int b_WRITE_BYTE_cc(BPLONG FDIndex, BPLONG op) {
     FILE *out_fptr;
@@ -4215,7 +4908,281 @@ int b_SET_STRING_TO_PARSE_c(BPLONG Str) {
     return BP_TRUE;
 }
 
+/* write a list of integers into FD, separated by Sep (a single-char atom) */
+#define INT_LIST_BUF_SIZE 4096
+
+int c_WRITE_INT_LIST_ccc() {
+    BPLONG FDIndex, Lst, Sep, Lst0;
+    FILE *out_fptr;
+    CHAR buf[INT_LIST_BUF_SIZE];
+    CHAR sep_c;
+    BPLONG i, written;
+
+    FDIndex = ARG(1, 3); DEREF(FDIndex);
+    Lst = ARG(2, 3); DEREF(Lst);
+    Sep = ARG(3, 3); DEREF(Sep);
+    if (!ISINT(FDIndex) || !ISATOM(Sep) || GET_LENGTH(GET_ATM_SYM_REC(Sep)) != 1) {
+        bp_exception = illegal_arguments; return BP_ERROR;
+    }
+    FDIndex = INTVAL(FDIndex);
+    CHECK_FILE_INDEX(FDIndex);
+    out_fptr = file_table[FDIndex].fdes;
+    sep_c = *GET_NAME(GET_ATM_SYM_REC(Sep));
+
+    /* check the whole list first, so that nothing is written on error */
+    Lst0 = Lst;
+    while (ISLIST(Lst)) {
+        BPLONG_PTR lst_ptr;
+        BPLONG elm;
+
+        lst_ptr = (BPLONG_PTR)UNTAGGED_ADDR(Lst);
+        elm = FOLLOW(lst_ptr); DEREF(elm);
+        Lst = FOLLOW(lst_ptr+1); DEREF(Lst);
+        if (!ISINT(elm)) {
+            bp_exception = c_type_error(et_INTEGER, elm);
+            return BP_ERROR;
+        }
+    }
+    if (Lst != nil_sym) {
+        bp_exception = c_type_error(et_LIST, Lst0);
+        return BP_ERROR;
+    }
+
+    i = 0;
+    written = 0;
+    Lst = Lst0;
+    while (ISLIST(Lst)) {
+        BPLONG_PTR lst_ptr;
+        BPLONG elm;
+
+        lst_ptr = (BPLONG_PTR)UNTAGGED_ADDR(Lst);
+        elm = FOLLOW(lst_ptr); DEREF(elm);
+        Lst = FOLLOW(lst_ptr+1); DEREF(Lst);
+        if (i > INT_LIST_BUF_SIZE-32) {  /* no room for another integer */
+            fwrite(buf, 1, i, out_fptr);
+            written += i;
+            i = 0;
+        }
+        i += bp_itoa(INTVAL(elm), buf+i);
+        if (ISLIST(Lst)) buf[i++] = sep_c;
+    }
+    fwrite(buf, 1, i, out_fptr);
+    written += i;
+    FLUSH_IF_TTY(out_fptr);
+    /* the output has no newline, so the column only moves forward */
+    if (FDIndex == out_file_i) {
+        line_position += written;
+    } else {
+        file_table[FDIndex].line_position += written;
+    }
+    return BP_TRUE;
+}
+
+/************ CNF dump ************/
+/*
+  Clauses dumped by the SAT compiler are formatted into a private buffer
+  that is written to curr_out in large blocks. The header line is written
+  as a placeholder by sat_solve and patched in place by print_cnf_header
+  once the numbers of variables and clauses are known.
+
+  The output format is selected by the file name:
+    *.bcnf          binary DIMACS: the same header line as in the text
+                    format, "p cnf V C" padded with spaces and ended by a
+                    newline, followed by clauses in which every literal L
+                    is encoded as the variable-length unsigned integer
+                    2*|L|+(L<0), 7 bits per byte (low bits first, high bit
+                    set on all but the last byte), and each clause is
+                    terminated by a zero byte. Since no literal encodes to
+                    a zero byte, a reader takes the header up to the first
+                    newline and decodes the rest byte by byte.
+    *.gz,*.zst,*.xz the dump is compressed in place by gzip, zstd, or xz
+                    when the file is closed after the header has been
+                    patched.
+
+  There is no OPB output: the SAT compiler encodes pseudo-Boolean
+  constraints into clauses before they reach the dump, so only CNF exists
+  at this point.
+*/
+#define CNF_BUF_SIZE 1048576
+#define CNF_COMPRESS_NONE 0
+#define CNF_COMPRESS_GZIP 1
+#define CNF_COMPRESS_ZSTD 2
+#define CNF_COMPRESS_XZ 3
+
+static CHAR_PTR cnf_buf = NULL;
+static BPLONG cnf_buf_top;
+static int cnf_binary;
+static int cnf_compress;
+
+/* if name[0..*stem_len) ends with suffix, strip the suffix from *stem_len */
+static int cnf_name_has_suffix(CHAR_PTR name, BPLONG *stem_len, const char *suffix) {
+    BPLONG slen = (BPLONG)strlen(suffix);
+    if (*stem_len < slen || strncmp((char *)name+*stem_len-slen, suffix, (size_t)slen) != 0) return 0;
+    *stem_len -= slen;
+    return 1;
+}
+
+void start_cnf_dump() {
+    SYM_REC_PTR sym_ptr;
+    BPLONG len;
+
+    cnf_binary = 0;
+    cnf_compress = CNF_COMPRESS_NONE;
+    if (ISATOM(file_table[out_file_i].name_atom) && file_table[out_file_i].name_atom != nil_sym) {
+        sym_ptr = GET_ATM_SYM_REC(file_table[out_file_i].name_atom);
+        len = GET_LENGTH(sym_ptr);
+        if (cnf_name_has_suffix(GET_NAME(sym_ptr), &len, ".gz")) {
+            cnf_compress = CNF_COMPRESS_GZIP;
+        } else if (cnf_name_has_suffix(GET_NAME(sym_ptr), &len, ".zst")) {
+            cnf_compress = CNF_COMPRESS_ZSTD;
+        } else if (cnf_name_has_suffix(GET_NAME(sym_ptr), &len, ".xz")) {
+            cnf_compress = CNF_COMPRESS_XZ;
+        }
+        cnf_binary = cnf_name_has_suffix(GET_NAME(sym_ptr), &len, ".bcnf");
+    }
+    if (cnf_buf == NULL) {
+        cnf_buf = (CHAR_PTR)malloc(CNF_BUF_SIZE);
+        if (cnf_buf == NULL) myquit(OUT_OF_MEMORY, "cnf");
+    }
+    cnf_buf_top = 0;
+}
+
+static void flush_cnf_buf() {
+    if (cnf_buf_top > 0) {
+        fwrite(cnf_buf, 1, cnf_buf_top, curr_out);
+        cnf_buf_top = 0;
+    }
+}
+
+/* write the literals on the stack from lit_ptr0 down to lit_ptr (exclusive) as a DIMACS clause */
+void print_cnf_clause(BPLONG_PTR lit_ptr0, BPLONG_PTR lit_ptr) {
+    BPLONG_PTR ptr;
+    BPLONG i;
+
+    if (cnf_buf == NULL) start_cnf_dump();
+    i = cnf_buf_top;
+    for (ptr = lit_ptr0; ptr != lit_ptr; ptr--) {
+        if (i > CNF_BUF_SIZE-24) {  /* no room for another literal */
+            cnf_buf_top = i;
+            flush_cnf_buf();
+            i = 0;
+        }
+        if (cnf_binary) {
+            BPLONG lit = INTVAL(*ptr);
+            BPULONG code = (lit < 0) ? (((BPULONG)(-lit)) << 1) | 1 : ((BPULONG)lit) << 1;
+            while (code > 0x7f) {
+                cnf_buf[i++] = (CHAR)((code & 0x7f) | 0x80);
+                code >>= 7;
+            }
+            cnf_buf[i++] = (CHAR)code;
+        } else {
+            i += bp_itoa(INTVAL(*ptr), cnf_buf+i);
+            cnf_buf[i++] = ' ';
+        }
+    }
+    if (i > CNF_BUF_SIZE-2) {
+        cnf_buf_top = i;
+        flush_cnf_buf();
+        i = 0;
+    }
+    if (cnf_binary) {
+        cnf_buf[i++] = 0;
+    } else {
+        cnf_buf[i++] = '0';
+        cnf_buf[i++] = '\n';
+    }
+    cnf_buf_top = i;
+}
+
+#ifndef WIN32
+/*
+  Compress the closed dump file name in place: the compressor writes to
+  name.tmp, which then replaces the file.  The compressor is run without
+  a shell, so the file name is passed to it as is.
+*/
+static int compress_cnf_dump(CHAR_PTR name, int compress) {
+    const char *argv[5];
+    char *tmp_name;
+    pid_t pid;
+    int fd, status;
+
+    switch (compress) {
+    case CNF_COMPRESS_GZIP: argv[0] = "gzip"; break;
+    case CNF_COMPRESS_ZSTD: argv[0] = "zstd"; break;
+    case CNF_COMPRESS_XZ: argv[0] = "xz"; break;
+    default: return BP_TRUE;
+    }
+    argv[1] = "-c";
+    argv[2] = "--";
+    argv[3] = (const char *)name;
+    argv[4] = NULL;
+
+    tmp_name = (char *)malloc(strlen((char *)name)+5);
+    if (tmp_name == NULL) myquit(OUT_OF_MEMORY, "cnf");
+    sprintf(tmp_name, "%s.tmp", (char *)name);
+    fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        bp_exception = c_permission_error(et_OPEN, et_SOURCE_SINK, ADDTAG(BP_NEW_SYM((CHAR_PTR)tmp_name, 0), ATM));
+        free(tmp_name);
+        return BP_ERROR;
+    }
+    pid = fork();
+    if (pid == 0) {
+        dup2(fd, 1);
+        close(fd);
+        execvp(argv[0], (char *const *)argv);
+        _exit(127);
+    }
+    close(fd);
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        unlink(tmp_name);
+        free(tmp_name);
+        if (pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+            bp_exception = c_existence_error(ADDTAG(BP_NEW_SYM("compressor", 0), ATM), ADDTAG(BP_NEW_SYM((CHAR_PTR)argv[0], 0), ATM));
+        } else {
+            bp_exception = c_existence_error(et_SOURCE_SINK, ADDTAG(BP_NEW_SYM((CHAR_PTR)name, 0), ATM));
+        }
+        return BP_ERROR;
+    }
+    if (rename(tmp_name, (char *)name) != 0) {
+        unlink(tmp_name);
+        free(tmp_name);
+        bp_exception = c_permission_error(et_MODIFY, et_SOURCE_SINK, ADDTAG(BP_NEW_SYM((CHAR_PTR)name, 0), ATM));
+        return BP_ERROR;
+    }
+    free(tmp_name);
+    return BP_TRUE;
+}
+#endif
+
+/* the output file whose dump is compressed when it is closed, or -1 */
+static BPLONG cnf_compress_file_i = -1;
+static int cnf_compress_pending;
+
+/* called after file i has been closed, before its index is released */
+int cnf_dump_closed(BPLONG i) {
+    if (i != cnf_compress_file_i) return BP_TRUE;
+    cnf_compress_file_i = -1;
+#ifndef WIN32
+    return compress_cnf_dump(GET_NAME(GET_ATM_SYM_REC(file_table[i].name_atom)), cnf_compress_pending);
+#else
+    return BP_TRUE;
+#endif
+}
+
 void print_cnf_header(int nvars, int ncls) {
+    flush_cnf_buf();
     fseek(curr_out, 0, SEEK_SET);
     fprintf(curr_out, "p cnf %d %d", nvars, ncls);
+    fflush(curr_out);
+    if (cnf_compress != CNF_COMPRESS_NONE) {
+        cnf_compress_file_i = out_file_i;
+        cnf_compress_pending = cnf_compress;
+    }
+    if (cnf_buf != NULL) {
+        free(cnf_buf);
+        cnf_buf = NULL;
+    }
+    cnf_binary = 0;
+    cnf_compress = CNF_COMPRESS_NONE;
 }
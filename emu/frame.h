@@ -48,6 +48,7 @@
 #define AR_CURR_ANSWER(ar) *(ar-10)
 
 #define AR_TABLE_NEW_BITS(ar) *(ar-11)
+#define AR_ANSWER_MARK(ar) *(ar-11)  /* semi-naive: the answer after which the frame consumes, or NULL */
 
 /************************************************/
 #define FLAT_FRAME_TAG 0x0L
@@ -110,10 +111,11 @@ subgoalTableEntry ->
                 args
 
    The STATE slot stores the following information
-   ...  4           3           2          1         0
-   -----------------------------------------------------------
-      promoted | looping | evaluated  | iteration | revised   |
-   ------------------------------------------------------------
+   ...  5           4           3           2          1         0
+   -----------------------------------------------------------------------
+      removed  | promoted | looping | evaluated  | iteration | revised   |
+   -----------------------------------------------------------------------
+    removed -- 1: the subgoal has been removed from the subgoal table
     iteration -- 1: iteration; 0: normal
     evaluated - 1: the subgoal has been evaluated; 0: not evaluated
     looping -- 1: a looping node 0: not a looping node
@@ -123,6 +125,7 @@ subgoalTableEntry ->
     table_use_answer instruction while pioneers execute table_check_competion
     after a round of execution.
 */
+#define SUBGOAL_REMOVED_BIT 0x20L
 #define SUBGOAL_NEW_REGION_SET_BIT 0x10L
 #define SUBGOAL_LOOPING_BIT 0x8L
 #define SUBGOAL_EVALUATED_BIT 0x4L
@@ -184,6 +187,12 @@ subgoalTableEntry ->
         GT_SCC_ROOT(ptr) = (BPLONG)ptr;         \
     }
 
+/* called when an evaluation of subgoal_entry starts; first is 0 if it is
+   evaluated again in the iteration of its SCC */
+#define START_SUBGOAL_EVALUATION(subgoal_entry, first) {                \
+        if (semi_naive_tabling) semi_naive_start_evaluation(subgoal_entry, first); \
+    }
+
 #define TABLE_FREE_CELL(ptr) {FOLLOW(ptr+1) = (BPLONG)table_free_cells_ptr; table_free_cells_ptr = ptr;}
 
 
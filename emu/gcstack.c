@@ -40,10 +40,12 @@ int garbage_collector()
 {
     extern BPLONG cputime();
     BPLONG msec0;
+    BPLONG_PTR peak_heap_top;
 
     msec0 = cputime();
 
     if (toam_signal_vec != 0 || in_critical_region != 0) return BP_TRUE;
+    peak_heap_top = heap_top;
 
     gc_is_working = 1;
 
@@ -67,6 +69,7 @@ int garbage_collector()
     if (gcStack() == BP_ERROR) return BP_ERROR;
     /* printf("=>heap\n"); */
     if (gcHeap() == BP_ERROR) return BP_ERROR;
+    release_unused_heap_pages(peak_heap_top);
 
     gc_is_working = 0;
     //  check_susp_frames_reep("<=GC");
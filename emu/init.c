@@ -157,10 +157,10 @@ void init_toam(argc, argv)
       printf("PICATPATH= %s\n",str);
       }
     */
-    BP_MALLOC(stack_low_addr, stack_size);
+    stack_low_addr = allocate_stack_area(stack_size);
     if (stack_low_addr == NULL) myquit(OUT_OF_MEMORY, "in");
 
-    trail_low_addr = (BPLONG_PTR)malloc(trail_size*sizeof(BPLONG));
+    trail_low_addr = allocate_trail_area(trail_size);
     if (trail_low_addr == NULL) myquit(OUT_OF_MEMORY, "in");
 
     trail_water_mark = trail_low_addr+LARGE_MARGIN;
@@ -279,6 +279,192 @@ void init_stack(bsize)
     local_top = arreg-FLAT_FRAME_SIZE;
 }
 
+/*****************************************************************************
+  Engines. Each engine has its own stack/heap area, trail, and registers, so
+  that an embedding application can keep several independent queries, for
+  example mounted with bp_mount_query_term, and run them in turn. The
+  registers of the running engine are the globals used by the emulator, and
+  bp_switch_engine saves them into the running engine's record before it
+  loads those of another engine. Engines share the program area, the symbol
+  table, the table area, and the global maps. Only one engine runs at a time,
+  and no engine may be switched from inside a C predicate that the running
+  engine called.
+*****************************************************************************/
+extern BPLONG_PTR sreg;
+
+static BP_ENGINE main_engine;
+static BP_ENGINE_PTR curr_engine = &main_engine;
+static int num_engines = 1;
+
+static void save_engine(BP_ENGINE_PTR e)
+{
+    e->stack_low_addr = stack_low_addr;
+    e->stack_up_addr = stack_up_addr;
+    e->stack_size = stack_size;
+    e->trail_low_addr = trail_low_addr;
+    e->trail_up_addr = trail_up_addr;
+    e->trail_size = trail_size;
+    e->trail_water_mark = trail_water_mark;
+    e->trail_water_mark0 = trail_water_mark0;
+#ifdef BP_RESERVE_AREAS
+    e->stack_reserve_low = stack_reserve_low;
+    e->stack_reserve_size = stack_reserve_size;
+    e->trail_reserve_low = trail_reserve_low;
+    e->trail_reserve_size = trail_reserve_size;
+#endif
+    e->arreg = arreg;
+    e->breg = breg;
+    e->breg0 = breg0;
+    e->local_top = local_top;
+    e->heap_top = heap_top;
+    e->trail_top = trail_top;
+    e->hbreg = hbreg;
+    e->sfreg = sfreg;
+    e->gc_b = gc_b;
+    e->sreg = sreg;
+    e->inst_begin = inst_begin;
+    e->toam_signal_vec = toam_signal_vec;
+    e->in_critical_region = in_critical_region;
+    e->curr_toam_status = curr_toam_status;
+    e->bp_exception = bp_exception;
+    e->trigger_no = trigger_no;
+}
+
+static void load_engine(BP_ENGINE_PTR e)
+{
+    stack_low_addr = e->stack_low_addr;
+    stack_up_addr = e->stack_up_addr;
+    stack_size = e->stack_size;
+    trail_low_addr = e->trail_low_addr;
+    trail_up_addr = e->trail_up_addr;
+    trail_size = e->trail_size;
+    trail_water_mark = e->trail_water_mark;
+    trail_water_mark0 = e->trail_water_mark0;
+#ifdef BP_RESERVE_AREAS
+    stack_reserve_low = e->stack_reserve_low;
+    stack_reserve_size = e->stack_reserve_size;
+    trail_reserve_low = e->trail_reserve_low;
+    trail_reserve_size = e->trail_reserve_size;
+#endif
+    arreg = e->arreg;
+    breg = e->breg;
+    breg0 = e->breg0;
+    local_top = e->local_top;
+    heap_top = e->heap_top;
+    trail_top = e->trail_top;
+    hbreg = e->hbreg;
+    sfreg = e->sfreg;
+    gc_b = e->gc_b;
+    sreg = e->sreg;
+    inst_begin = e->inst_begin;
+    /* the event pool is shared, so its bit stays with the pool */
+    toam_signal_vec = (e->toam_signal_vec & ~EVENT_POOL_NONEMPTY) | (toam_signal_vec & EVENT_POOL_NONEMPTY);
+    in_critical_region = e->in_critical_region;
+    curr_toam_status = e->curr_toam_status;
+    bp_exception = e->bp_exception;
+    trigger_no = e->trigger_no;
+}
+
+/* Create an engine whose areas have the given sizes in words (0 for the sizes
+   of the running engine). The running engine stays the same. Return NULL if
+   there is not enough memory. */
+BP_ENGINE_PTR bp_new_engine(new_stack_size, new_trail_size)
+    BPLONG new_stack_size, new_trail_size;
+{
+    BP_ENGINE_PTR e;
+
+    if (new_stack_size == 0) new_stack_size = stack_size;
+    if (new_stack_size < 1000000) new_stack_size = 1000000;
+    if (new_trail_size == 0) new_trail_size = trail_size;
+    if (new_trail_size < 1000000) new_trail_size = 1000000;
+
+    e = (BP_ENGINE_PTR)malloc(sizeof(BP_ENGINE));
+    if (e == NULL) return NULL;
+
+    save_engine(curr_engine);
+    stack_low_addr = allocate_stack_area(new_stack_size);
+    if (stack_low_addr != NULL) {
+        trail_low_addr = allocate_trail_area(new_trail_size);
+        if (trail_low_addr == NULL) free_stack_and_trail_areas();
+    }
+    if (stack_low_addr == NULL || trail_low_addr == NULL) {
+        load_engine(curr_engine);
+        free(e);
+        return NULL;
+    }
+    stack_size = new_stack_size;
+    trail_size = new_trail_size;
+    stack_up_addr = stack_low_addr + stack_size -1;
+    trail_up_addr = trail_low_addr + trail_size -1;
+    trail_water_mark = trail_low_addr+LARGE_MARGIN;
+    trail_water_mark0 = trail_low_addr+2;
+    bp_reset_engine();
+
+    save_engine(e);
+    load_engine(curr_engine);
+    num_engines++;
+    return e;
+}
+
+/* Empty the areas of the running engine and rebuild its bottom frames, so
+   that it can be reused for an unrelated query. The areas keep their sizes. */
+void bp_reset_engine()
+{
+    heap_top = stack_low_addr;
+    trail_top = trail_up_addr;
+    local_top = stack_up_addr;
+    arreg = breg = sfreg = NULL;
+    init_stack(NUM_CG_GLOBALS+2);
+    breg0 = breg;
+    gc_b = breg;
+    cg_initialize();
+
+    curr_toam_status = TOAM_NOTSET;
+    inst_begin = 0;
+    sreg = NULL;
+    toam_signal_vec &= EVENT_POOL_NONEMPTY;
+    in_critical_region = 0;
+    bp_exception = (BPLONG)NULL;
+    trigger_no = 0;
+}
+
+BP_ENGINE_PTR bp_current_engine()
+{
+    return curr_engine;
+}
+
+/* the number of engines, including the main one */
+int bp_num_engines()
+{
+    return num_engines;
+}
+
+int bp_switch_engine(e)
+    BP_ENGINE_PTR e;
+{
+    if (e == NULL) return BP_ERROR;
+    if (e == curr_engine) return BP_TRUE;
+    save_engine(curr_engine);
+    load_engine(e);
+    curr_engine = e;
+    return BP_TRUE;
+}
+
+/* Free an engine created by bp_new_engine. The running engine cannot be freed. */
+int bp_free_engine(e)
+    BP_ENGINE_PTR e;
+{
+    if (e == NULL || e == curr_engine || e == &main_engine) return BP_ERROR;
+    save_engine(curr_engine);
+    load_engine(e);
+    free_stack_and_trail_areas();
+    load_engine(curr_engine);
+    mmap_release_engine(e);
+    free(e);
+    num_engines--;
+    return BP_TRUE;
+}
+
 int init_loading(argc, argv)
     int argc;
     char *argv[];
@@ -411,6 +597,7 @@ void add_main_arg(main_arg)
 int c_init_global_each_session() {
 
     set_global_call_number(1);
+    mmap_release_engine(curr_engine);
     return BP_TRUE;
 }
 
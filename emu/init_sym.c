@@ -47,6 +47,7 @@ void init_sym() {
     address_psc = insert_sym("$address", 8, 2);  //branch
     socket_psc = insert_sym("$socket", 7, 1);  //branch
     stream_psc = insert_sym("$stream", 7, 1);  //branch
+    mmap_psc = insert_sym("$mmap", 5, 1);
 
     timer_psc = BP_NEW_SYM("$timer", 5);
     enter_dyn_call = insert_sym("$trace_call", 11, 1);
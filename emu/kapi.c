@@ -12,6 +12,12 @@
 #include "kapi.h"
 #include <stdlib.h>
 #include "frame.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/time.h>
+#endif
 
 #ifdef M64BITS
 #define HALF_WORD_LONG 32
@@ -22,6 +28,7 @@
 SYM_REC_PTR objectRef;
 extern char *string_in;
 char *bp_get_name();
+static void init_engine_locks(void);
 
 /* Prolog to C */
 /*
@@ -282,9 +289,306 @@ int PinitP(argc, argv)
     int argc;
     char **argv;
 {
+    init_engine_locks();
     return initialize_bprolog(argc, argv);
 }
 
+/*****************************************************************************
+  Engines for multi-threaded applications (see bp_new_engine in init.c).
+  Only one engine runs at a time in a process. A thread that wants to build
+  terms, call goals, or read answers in an engine first takes the engine lock
+  with PlockEngine, which also makes the engine the running one, and gives it
+  back with PunlockEngine. PinitP must have been called before.
+
+      e = PacquireEngine(pool);
+      PlockEngine(e);
+      ... build Goal ...
+      res = PcallTimeout(Goal, 100);
+      ... read the bindings of Goal ...
+      PunlockEngine();
+      PreleaseEngine(pool, e);
+
+  PcallTimeout raises the 'interrupt' event in the running query when the
+  time limit is reached, and keeps raising it until the query returns, so a
+  query that catches the exception is stopped as well. The watchdog thread is
+  started on first use.
+*****************************************************************************/
+#ifdef _WIN32
+typedef CRITICAL_SECTION BP_MUTEX;
+typedef CONDITION_VARIABLE BP_COND;
+#define BP_MUTEX_INIT(m) InitializeCriticalSection(m)
+#define BP_COND_INIT(c) InitializeConditionVariable(c)
+#define BP_LOCK(m) EnterCriticalSection(m)
+#define BP_UNLOCK(m) LeaveCriticalSection(m)
+#define BP_WAIT(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define BP_SIGNAL(c) WakeConditionVariable(c)
+#else
+typedef pthread_mutex_t BP_MUTEX;
+typedef pthread_cond_t BP_COND;
+#define BP_MUTEX_INIT(m) pthread_mutex_init(m, NULL)
+#define BP_COND_INIT(c) pthread_cond_init(c, NULL)
+#define BP_LOCK(m) pthread_mutex_lock(m)
+#define BP_UNLOCK(m) pthread_mutex_unlock(m)
+#define BP_WAIT(c, m) pthread_cond_wait(c, m)
+#define BP_SIGNAL(c) pthread_cond_signal(c)
+#endif
+
+#define WATCHDOG_REPEAT_MSECS 10
+
+/* The watchdog thread changes toam_signal_vec while the emulator runs, so it
+   uses atomic operations. A plain update by the emulator may still drop the
+   bit, which is why the watchdog raises it again until the call returns. */
+#if defined(_WIN64)
+#define SIGNAL_VEC_OR(bits) InterlockedOr64((volatile LONG64 *)&toam_signal_vec, (LONG64)(bits))
+#define SIGNAL_VEC_AND(bits) InterlockedAnd64((volatile LONG64 *)&toam_signal_vec, (LONG64)(bits))
+#elif defined(_WIN32)
+#define SIGNAL_VEC_OR(bits) InterlockedOr((volatile LONG *)&toam_signal_vec, (LONG)(bits))
+#define SIGNAL_VEC_AND(bits) InterlockedAnd((volatile LONG *)&toam_signal_vec, (LONG)(bits))
+#else
+#define SIGNAL_VEC_OR(bits) __atomic_fetch_or(&toam_signal_vec, (BPULONG)(bits), __ATOMIC_SEQ_CST)
+#define SIGNAL_VEC_AND(bits) __atomic_fetch_and(&toam_signal_vec, (BPULONG)(bits), __ATOMIC_SEQ_CST)
+#endif
+
+struct bp_engine_pool {
+    BPLONG size;
+    BPLONG n_free;
+    BP_ENGINE_PTR *engines;  /* the free engines are engines[0..n_free-1] */
+    BP_MUTEX lock;
+    BP_COND freed;
+};
+
+static int engine_locks_initialized = 0;
+static BP_MUTEX engine_lock;
+static BP_MUTEX watchdog_lock;
+static BP_COND watchdog_cond;
+static int watchdog_started = 0;
+static int watchdog_armed = 0;
+static BPLONG watchdog_generation = 0;  /* incremented each time the watchdog is armed */
+static BPLONG watchdog_fired_generation = 0;  /* the generation for which it last fired */
+static BPLONG watchdog_deadline;  /* in milliseconds of wall-clock time */
+static BPLONG time_out_atom = 0;
+
+/* The locks must exist before other threads use them, so PinitP creates them. */
+static void init_engine_locks()
+{
+    if (engine_locks_initialized) return;
+    streams_locked = 1;
+    BP_MUTEX_INIT(&engine_lock);
+    BP_MUTEX_INIT(&watchdog_lock);
+    BP_COND_INIT(&watchdog_cond);
+    engine_locks_initialized = 1;
+}
+
+static BPLONG wall_msecs()
+{
+#ifdef _WIN32
+    return (BPLONG)GetTickCount64();
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (BPLONG)tv.tv_sec*1000 + tv.tv_usec/1000;
+#endif
+}
+
+/* wait on cond for at most msecs; the caller holds m */
+static void wait_msecs(BP_COND *cond, BP_MUTEX *m, BPLONG msecs)
+{
+#ifdef _WIN32
+    SleepConditionVariableCS(cond, m, (DWORD)msecs);
+#else
+    struct timespec ts;
+    BPLONG until = wall_msecs()+msecs;
+    ts.tv_sec = until/1000;
+    ts.tv_nsec = (until%1000)*1000000;
+    pthread_cond_timedwait(cond, m, &ts);
+#endif
+}
+
+#ifdef _WIN32
+static DWORD WINAPI watchdog_loop(LPVOID arg)
+#else
+static void *watchdog_loop(void *arg)
+#endif
+{
+    BPLONG now;
+
+    (void)arg;
+    BP_LOCK(&watchdog_lock);
+    for (; ; ) {
+        while (!watchdog_armed) BP_WAIT(&watchdog_cond, &watchdog_lock);
+        now = wall_msecs();
+        if (now < watchdog_deadline) {
+            wait_msecs(&watchdog_cond, &watchdog_lock, watchdog_deadline-now);
+            continue;
+        }
+        watchdog_fired_generation = watchdog_generation;
+        SIGNAL_VEC_OR(INTERRUPT);
+        watchdog_deadline = now+WATCHDOG_REPEAT_MSECS;
+    }
+    return 0;
+}
+
+static int start_watchdog()
+{
+#ifdef _WIN32
+    if (CreateThread(NULL, 0, watchdog_loop, NULL, 0, NULL) == NULL) return BP_ERROR;
+#else
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, watchdog_loop, NULL) != 0) return BP_ERROR;
+    pthread_detach(thread);
+#endif
+    watchdog_started = 1;
+    return BP_TRUE;
+}
+
+int PlockEngine(e)
+    BP_ENGINE_PTR e;
+{
+    if (e == NULL) return BP_ERROR;
+    init_engine_locks();
+    BP_LOCK(&engine_lock);
+    return bp_switch_engine(e);
+}
+
+void PunlockEngine()
+{
+    BP_UNLOCK(&engine_lock);
+}
+
+BP_ENGINE_PTR PnewEngine(stack_size, trail_size)
+    BPLONG stack_size, trail_size;
+{
+    BP_ENGINE_PTR e;
+
+    init_engine_locks();
+    BP_LOCK(&engine_lock);
+    e = bp_new_engine(stack_size, trail_size);
+    BP_UNLOCK(&engine_lock);
+    return e;
+}
+
+int PfreeEngine(e)
+    BP_ENGINE_PTR e;
+{
+    int res;
+
+    init_engine_locks();
+    BP_LOCK(&engine_lock);
+    res = bp_free_engine(e);
+    BP_UNLOCK(&engine_lock);
+    return res;
+}
+
+/* Call once(Goal) in the running engine, whose lock the caller holds. Return BP_ERROR
+   with bp_exception set to time_out if the call has not finished after msecs
+   milliseconds (0 for no limit). */
+int PcallTimeout(goal, msecs)
+    BPLONG goal, msecs;
+{
+    int res, fired;
+    BPLONG generation = 0;
+
+    if (msecs > 0) {
+        BP_LOCK(&watchdog_lock);
+        if (!watchdog_started && start_watchdog() == BP_ERROR) {
+            BP_UNLOCK(&watchdog_lock);
+            return BP_ERROR;
+        }
+        generation = ++watchdog_generation;
+        watchdog_deadline = wall_msecs()+msecs;
+        watchdog_armed = 1;
+        BP_SIGNAL(&watchdog_cond);
+        BP_UNLOCK(&watchdog_lock);
+    }
+    res = bp_call_term_catch(goal);
+    if (msecs > 0) {
+        /* once disarmed under the lock, the watchdog cannot fire for this call any more */
+        BP_LOCK(&watchdog_lock);
+        watchdog_armed = 0;
+        fired = (watchdog_fired_generation == generation);
+        if (fired) SIGNAL_VEC_AND(~INTERRUPT);
+        BP_UNLOCK(&watchdog_lock);
+        if (fired) {
+            if (time_out_atom == 0) time_out_atom = ADDTAG(BP_NEW_SYM("time_out", 0), ATM);
+            bp_exception = time_out_atom;
+            return BP_ERROR;
+        }
+    }
+    return res;
+}
+
+/* Create a pool of n engines whose areas have the given sizes (0 for the sizes of the running engine) */
+BP_ENGINE_POOL_PTR PnewEnginePool(n, stack_size, trail_size)
+    BPLONG n, stack_size, trail_size;
+{
+    BP_ENGINE_POOL_PTR pool;
+    BPLONG i;
+
+    pool = (BP_ENGINE_POOL_PTR)malloc(sizeof(BP_ENGINE_POOL));
+    if (pool == NULL) return NULL;
+    pool->engines = (BP_ENGINE_PTR *)malloc(sizeof(BP_ENGINE_PTR)*n);
+    if (pool->engines == NULL) {
+        free(pool);
+        return NULL;
+    }
+    for (i = 0; i < n; i++) {
+        pool->engines[i] = PnewEngine(stack_size, trail_size);
+        if (pool->engines[i] == NULL) {
+            while (--i >= 0) PfreeEngine(pool->engines[i]);
+            free(pool->engines);
+            free(pool);
+            return NULL;
+        }
+    }
+    pool->size = n;
+    pool->n_free = n;
+    BP_MUTEX_INIT(&pool->lock);
+    BP_COND_INIT(&pool->freed);
+    return pool;
+}
+
+/* Take a free engine from the pool, waiting until one is released if necessary */
+BP_ENGINE_PTR PacquireEngine(pool)
+    BP_ENGINE_POOL_PTR pool;
+{
+    BP_ENGINE_PTR e;
+
+    BP_LOCK(&pool->lock);
+    while (pool->n_free == 0) BP_WAIT(&pool->freed, &pool->lock);
+    e = pool->engines[--pool->n_free];
+    BP_UNLOCK(&pool->lock);
+    return e;
+}
+
+/* Empty an engine taken from the pool and give it back. The caller must not hold the engine lock. */
+void PreleaseEngine(pool, e)
+    BP_ENGINE_POOL_PTR pool;
+    BP_ENGINE_PTR e;
+{
+    PlockEngine(e);
+    bp_reset_engine();
+    mmap_release_engine(e);
+    PunlockEngine();
+
+    BP_LOCK(&pool->lock);
+    pool->engines[pool->n_free++] = e;
+    BP_SIGNAL(&pool->freed);
+    BP_UNLOCK(&pool->lock);
+}
+
+/* Free a pool whose engines have all been released */
+int PfreeEnginePool(pool)
+    BP_ENGINE_POOL_PTR pool;
+{
+    BPLONG i;
+
+    if (pool->n_free != pool->size) return BP_ERROR;
+    for (i = 0; i < pool->size; i++) PfreeEngine(pool->engines[i]);
+    free(pool->engines);
+    free(pool);
+    return BP_TRUE;
+}
+
 void jni_interface() {
 }
 
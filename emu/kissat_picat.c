@@ -57,6 +57,7 @@ int c_sat_start_dump(){
     sat_nvars = sat_nvars_limit = (int)INTVAL(num);
 
     sat_dump_flag = 1;
+    start_cnf_dump();
     sat_dump_or_count_flag = 1;
     num_cls = 0;
     return BP_TRUE;
@@ -98,12 +99,7 @@ int b_SAT_ADD_CL_c(BPLONG cl) {
     if (sat_dump_or_count_flag == 1) {
         num_cls++;
         if (sat_dump_flag == 1) {
-            for (ptr = local_top; ptr != lit_ptr; ptr--) {
-                write_term(*ptr);
-                write_space();
-            }
-            write_term(BP_ZERO);
-            b_NL();
+            print_cnf_clause(local_top, lit_ptr);
         }
     } else {
 	  for (ptr = local_top; ptr != lit_ptr; ptr--) {
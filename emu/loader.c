@@ -206,6 +206,7 @@ BYTE op_mode;
 struct hrec {
     BPLONG l;
     BPLONG_PTR link;
+    BPLONG_PTR tail;  /* last entry of the chain, so that inserth appends in constant time */
 };
 
 struct hrec *indextab = NULL;
@@ -281,6 +282,7 @@ int loader(file, file_type, load_damon)
         printf("file %s not exist\n", file);
         return 1;
     }
+    note_loaded_file(file);
     // printf("\n     ...... loading file %s curr_fence=%x\n", file,curr_fence);
 
     while ((eof_flag = READ_DATA(&magic, 1)) == 0) {
@@ -587,6 +589,7 @@ int get_index_tab(clause_no, lenptr)
     for (j = 0; j < size; j++) {
         indextab[j].l = 0;
         indextab[j].link = (BPLONG_PTR)(&(indextab[j].link));
+        indextab[j].tail = NULL;
     }
     for (j = 0; j < clause_no; j++) {
         if ((eof_flag = READ_DATA(&type, 1)))
@@ -730,19 +733,13 @@ struct hrec *bucket;
     BPLONG_PTR temp;
 
     bucket->l++;
-    temp = (BPLONG_PTR)&(bucket->link);
     if (bucket->l > 1) {
-        temp = (BPLONG_PTR)*temp;
-        while ((BPLONG_PTR)*temp != temp)
-        {
-
-            /*    printf("type = %i \n", (BPLONG)*temp++);
-                  printf("val  = %i \n", (BPLONG)*temp++);
-                  printf("label= %x \n", (BPLONG)*temp++);*/
-            temp = (BPLONG_PTR)*(temp+3);
-        }
+        temp = bucket->tail + 3;  /* the link slot of the current last entry */
+    } else {
+        temp = (BPLONG_PTR)&(bucket->link);
     }
     *temp = (BPLONG)hptr;
+    bucket->tail = hptr;
     *hptr++ = ttype;
     *hptr++ = val;
     *hptr++ = (BPLONG)label;
@@ -1246,7 +1243,7 @@ SYM_REC_PTR insert_sym(name, length, arity)
     sym_ptr = (SYM_REC_PTR)curr_fence;
     curr_fence += sizeof(struct sym_rec);
 
-    GET_SPY(sym_ptr) = 0;
+    GET_FLAGS(sym_ptr) = 0;
     GET_ETYPE(sym_ptr) = T_ORDI;
     GET_EP(sym_ptr) = (int (*)(void))nil_sym;
     GET_ARITY(sym_ptr) = (UW32)arity;
@@ -1414,6 +1411,38 @@ SYM_REC_PTR look_for_sym_with_entrance(p)
     return NULL;
 }
 
+#define MAX_DEFAULT_MODULE_ARITY 255
+
+/*
+  The compiler names a call to an unresolved Name by "e$$glb$$Name".  If a
+  default module M defines Name ("e$$M$$Name", or "e$$M$$f$$Name" for a
+  function) with some arity, the call is bound to M instead.  This covers the
+  exports of the default modules that the compiler's tables do not list.
+*/
+BPLONG default_module_name(name, length)
+    CHAR_PTR name;
+    BPLONG length;
+{
+    static const char *default_modules[] = {"basic", "sys", "io", "math"};
+    char buf[MAX_STR_LEN];
+    BPLONG i, arity;
+
+    for (i = 0; i < (BPLONG)(sizeof(default_modules)/sizeof(default_modules[0])); i++) {
+        BPLONG len = (BPLONG)strlen(default_modules[i])+5;
+        if (len+length >= MAX_STR_LEN) return 0;
+        sprintf(buf, "e$$%s$$", default_modules[i]);
+        memcpy(buf+len, name, length);
+        len += length;
+        for (arity = 0; arity <= MAX_DEFAULT_MODULE_ARITY; arity++) {
+            SYM_REC_PTR sym_ptr = search(buf, len, arity, hash_table[bp_str_hash(buf, len, arity)]);
+            if (sym_ptr != NULL && GET_ETYPE(sym_ptr) != T_ORDI) {
+                return ADDTAG(insert_sym(buf, len, 0), ATM);
+            }
+        }
+    }
+    return 0;
+}
+
 /* load from in-memory lists */
 #define READ_FROM_BCINSTS(val) {                        \
         list_ptr = (BPLONG_PTR)UNTAGGED_ADDR(BCInsts);  \
@@ -1674,6 +1703,7 @@ void get_index_tab_fromlist(HashArgs, clause_no)
     for (j = 0; j < size; j++) {
         indextab[j].l = 0;
         indextab[j].link = (BPLONG_PTR)(&(indextab[j].link));
+        indextab[j].tail = NULL;
     }
 
     while (ISLIST(HashArgs)) {
@@ -1901,6 +1931,7 @@ static void load_hashtab_from_c_array(){
         for (j = 0; j < size; j++) {
             indextab[j].l = 0;
             indextab[j].link = (BPLONG_PTR)(&(indextab[j].link));
+            indextab[j].tail = NULL;
         }
 
         for (j = 0; j < clause_no; j++) {
@@ -1944,6 +1975,7 @@ static void load_hashtab_from_c_array(){
 int load_byte_code_from_c_array(){
 
     load_syms_from_c_array();
+    lib_code_low_addr = (BPLONG_PTR)curr_fence;
     load_text_from_c_array();
     load_hashtab_from_c_array();
 
@@ -1952,5 +1984,6 @@ int load_byte_code_from_c_array(){
     last_text  = (BPLONG_PTR)inst_addr;
     inst_addr++;
     curr_fence = (CHAR_PTR)inst_addr;
+    lib_code_up_addr = inst_addr;
     return BP_TRUE;
 }
@@ -138,6 +138,11 @@ BPLONG cputime()
 {
     return (BPLONG)(1000*((float)clock() / (float)CLOCKS_PER_SEC));
 }
+
+BPLONG cputime_usec()
+{
+    return (BPLONG)(1000000*((double)clock() / (double)CLOCKS_PER_SEC));
+}
 #else
 BPLONG cputime()
 {
@@ -145,6 +150,13 @@ BPLONG cputime()
     getrusage(RUSAGE_SELF, &rusage);
     return (BPLONG)(rusage.ru_utime.tv_sec*1000 + rusage.ru_utime.tv_usec/1000);
 }
+
+BPLONG cputime_usec()
+{
+    struct rusage rusage;
+    getrusage(RUSAGE_SELF, &rusage);
+    return (BPLONG)rusage.ru_utime.tv_sec*1000000 + (BPLONG)rusage.ru_utime.tv_usec;
+}
 #endif
 /*
   BPLONG cputime()
@@ -947,6 +959,7 @@ int c_STATISTICS()
 
     fprintf(stderr, "Memory manager:\n");
     fprintf(stderr, "  GC:           Calls(%d), Time(%d ms)\n", (int)no_gcs, (int)gc_time);
+    fprintf(stderr, "  Table GC:     Calls(%d)\n", table_area_num_gcs());
     fprintf(stderr, "  Expansions:   Stack+Heap(%d), Program(%d), Trail(%d), Table(%d)\n\n", (int)num_stack_expansions, (int)num_parea_expansions, (int)num_trail_expansions, (int)table_area_num_expansions());
 
     //  fprintf(stderr,"FD backtracks:     %5d\n\n",  (int)n_backtracks);
@@ -1016,7 +1029,7 @@ lab_reverse:  /* ugly!! but has to consider the case when the tail is a free var
     term_ptr = (BPLONG_PTR)UNTAGGED_ADDR(term);
     cdr = FOLLOW(term_ptr+1);
 lab_test_cdr:
-    if (ISLIST(cdr)) {
+    if (ISLIST(cdr) && IS_HEAP_REFERENCE((BPLONG_PTR)UNTAGGED_ADDR(cdr))) {  /* a tail in the table area has its hash code stored */
         FOLLOW(term_ptr+1) = prev_term;
         prev_term = term;
         term = cdr;
@@ -0,0 +1,2132 @@
+/********************************************************************
+ *   File   : planner.c
+ *   Author : Neng-Fa ZHOU Copyright (C) 1994-2023
+ *   Purpose: Search data of the heuristic and parallel modes of the planner
+
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ ********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "basic.h"
+#include "term.h"
+#include "bapi.h"
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#else
+#include <process.h>
+#endif
+
+/* The A* and IDA* modes of the planner module are driven by Picat code, which calls
+   action/4, final/1, and heuristic/1. This file keeps the search data of the driver
+   outside of the heap, where it survives backtracking and garbage collection:
+
+   - a pool of packed states and a pool of packed actions,
+   - the nodes, one for each state that has been reached, with the fingerprint of the
+     state, the cost of the cheapest known path to the state, and the node and action
+     on that path,
+   - an open-addressing index of the nodes by their fingerprints, which is the visited set,
+   - a binary heap of (f, g, node) entries, which is the frontier of A*.
+
+   A term is packed in preorder as a sequence of items. An item is a kind and an
+   unsigned payload. Its first byte holds the kind in the low 3 bits and the low 4
+   bits of the payload, and each of the following bytes holds 7 more bits of the
+   payload; the top bit of a byte tells whether another byte follows. The payload of
+   an integer is its zigzag code, so that small negative integers are short, and the
+   payload of an atom or a structure is the number of its symbol in a dictionary of
+   symbols. A list cell is followed by its car and cdr, and a structure by its
+   arguments. A variable is packed as the number of its first occurrence, so two terms
+   are variants if and only if their packings are equal. A state of small integers and
+   atoms takes about one byte per subterm.
+
+   A search is either exact or fingerprint-only. An exact search compares the packed
+   states of the nodes that have the same fingerprint, while a fingerprint-only search
+   takes two states with the same 64-bit fingerprint to be the same, and drops the
+   packed state of a node once the node has been expanded. */
+
+#define PK_INT 0
+#define PK_ATM 1
+#define PK_STR 2
+#define PK_LST 3
+#define PK_VAR 4
+
+typedef struct {
+    unsigned long long fp;  /* the fingerprint of the packed state */
+    BPLONG state;           /* offset of the packed state in the state pool, or -1 */
+    BPLONG action;          /* offset of the packed action that led to the state */
+    UW32 state_len;
+    int parent;             /* the node of the previous state on the path, or -1 */
+    int g;                  /* the cost of the cheapest known path to the state */
+    int closed;
+} PlannerNode, *PlannerNodePtr;
+
+typedef struct {
+    int f;
+    int g;
+    int node;
+} PlannerQueueEntry;
+
+typedef struct {
+    BYTE *bytes;
+    BPLONG top, capacity;
+} PlannerPool;
+
+typedef struct {
+    int fingerprint_only;
+    PlannerPool states;
+    BPLONG states_dropped;  /* bytes of dropped states that are still in the state pool */
+    PlannerPool actions;
+    PlannerNodePtr nodes;
+    BPLONG num_nodes, nodes_capacity;
+    UW32 *index;  /* node number plus 1, or 0 for an empty slot */
+    BPLONG index_capacity;
+    PlannerQueueEntry *queue;
+    BPLONG queue_size, queue_capacity;
+    BPLONG next_bound;  /* the smallest f that has exceeded the bound of IDA* */
+} PlannerSearch, *PlannerSearchPtr;
+
+#define PLANNER_NO_BOUND MAX_ARITY
+#define PLANNER_MAX_NODES 0x7fffffffL
+
+static PlannerSearchPtr *planner_searches = NULL;
+static BPLONG num_planner_searches = 0;
+
+/* the term that is being packed */
+static PlannerPool planner_buf = {NULL, 0, 0};
+static BPLONG_PTR planner_vars = NULL;
+static BPLONG num_planner_vars = 0;
+static BPLONG planner_vars_capacity = 0;
+
+/* the dictionary of symbols, indexed by open addressing on the addresses of the symbols */
+static SYM_REC_PTR *planner_syms = NULL;
+static BPLONG num_planner_syms = 0;
+static BPLONG planner_syms_capacity = 0;
+static UW32 *planner_sym_index = NULL;
+static BPLONG planner_sym_index_capacity = 0;
+
+#define PLANNER_SYM_SLOT(sym_ptr, capacity) ((BPLONG)(((BPULONG)(sym_ptr) >> 3) & (BPULONG)((capacity)-1)))
+
+static int planner_pool_reserve(PlannerPool *pool, BPLONG n) {
+    BPLONG new_capacity;
+    BYTE *ptr;
+
+    if (pool->top+n <= pool->capacity) return 1;
+    new_capacity = (pool->capacity == 0) ? 4096 : 2*pool->capacity;
+    while (new_capacity < pool->top+n) new_capacity *= 2;
+    ptr = (BYTE *)realloc(pool->bytes, new_capacity);
+    if (ptr == NULL) return 0;
+    pool->bytes = ptr;
+    pool->capacity = new_capacity;
+    return 1;
+}
+
+/* append the packed term in planner_buf to the pool, and return its offset, or -1 */
+static BPLONG planner_pool_add(PlannerPool *pool) {
+    BPLONG off;
+
+    if (!planner_pool_reserve(pool, planner_buf.top)) return -1;
+    off = pool->top;
+    memcpy(pool->bytes+off, planner_buf.bytes, planner_buf.top);
+    pool->top += planner_buf.top;
+    return off;
+}
+
+static BPLONG planner_sym_number(SYM_REC_PTR sym_ptr) {
+    BPLONG slot, i;
+    UW32 *new_index;
+
+    if (planner_sym_index_capacity != 0) {
+        slot = PLANNER_SYM_SLOT(sym_ptr, planner_sym_index_capacity);
+        while (planner_sym_index[slot] != 0) {
+            if (planner_syms[planner_sym_index[slot]-1] == sym_ptr) return planner_sym_index[slot]-1;
+            slot = (slot+1) & (planner_sym_index_capacity-1);
+        }
+    }
+    if (num_planner_syms == planner_syms_capacity) {
+        BPLONG new_capacity = (planner_syms_capacity == 0) ? 256 : 2*planner_syms_capacity;
+        SYM_REC_PTR *ptr = (SYM_REC_PTR *)realloc(planner_syms, new_capacity*sizeof(SYM_REC_PTR));
+        if (ptr == NULL) return -1;
+        planner_syms = ptr;
+        planner_syms_capacity = new_capacity;
+    }
+    if (2*(num_planner_syms+1) > planner_sym_index_capacity) {
+        BPLONG new_capacity = (planner_sym_index_capacity == 0) ? 512 : 2*planner_sym_index_capacity;
+        new_index = (UW32 *)calloc(new_capacity, sizeof(UW32));
+        if (new_index == NULL) return -1;
+        for (i = 0; i < num_planner_syms; i++) {
+            slot = PLANNER_SYM_SLOT(planner_syms[i], new_capacity);
+            while (new_index[slot] != 0) slot = (slot+1) & (new_capacity-1);
+            new_index[slot] = (UW32)(i+1);
+        }
+        free(planner_sym_index);
+        planner_sym_index = new_index;
+        planner_sym_index_capacity = new_capacity;
+    }
+    slot = PLANNER_SYM_SLOT(sym_ptr, planner_sym_index_capacity);
+    while (planner_sym_index[slot] != 0) slot = (slot+1) & (planner_sym_index_capacity-1);
+    planner_syms[num_planner_syms] = sym_ptr;
+    planner_sym_index[slot] = (UW32)(num_planner_syms+1);
+    return num_planner_syms++;
+}
+
+/* append an item to the pool */
+static int planner_put(PlannerPool *pool, BPLONG kind, BPULONG payload) {
+    BYTE b;
+
+    if (!planner_pool_reserve(pool, 11)) return 0;
+    b = (BYTE)(kind | ((payload & 0xf) << 3));
+    payload >>= 4;
+    if (payload != 0) b |= 0x80;
+    pool->bytes[pool->top++] = b;
+    while (payload != 0) {
+        b = (BYTE)(payload & 0x7f);
+        payload >>= 7;
+        if (payload != 0) b |= 0x80;
+        pool->bytes[pool->top++] = b;
+    }
+    return 1;
+}
+
+static BPULONG planner_get(BYTE **pos_ptr, BPLONG *kind_ptr) {
+    BYTE *pos, b;
+    BPULONG payload;
+    int shift;
+
+    pos = *pos_ptr;
+    b = *pos++;
+    *kind_ptr = b & 0x7;
+    payload = (b >> 3) & 0xf;
+    shift = 4;
+    while (b & 0x80) {
+        b = *pos++;
+        payload |= (BPULONG)(b & 0x7f) << shift;
+        shift += 7;
+    }
+    *pos_ptr = pos;
+    return payload;
+}
+
+static int planner_pack_term(BPLONG term) {
+    BPLONG_PTR ptr;
+    BPLONG i, arity, sym_no, val;
+
+    for (;;) {
+        DEREF(term);
+        if (ISREF(term) || IS_SUSP_VAR(term)) {
+            for (i = 0; i < num_planner_vars; i++) {
+                if (planner_vars[i] == term) break;
+            }
+            if (i == num_planner_vars) {
+                if (num_planner_vars == planner_vars_capacity) {
+                    BPLONG new_capacity = (planner_vars_capacity == 0) ? 16 : 2*planner_vars_capacity;
+                    ptr = (BPLONG_PTR)realloc(planner_vars, new_capacity*sizeof(BPLONG));
+                    if (ptr == NULL) return 0;
+                    planner_vars = ptr;
+                    planner_vars_capacity = new_capacity;
+                }
+                planner_vars[num_planner_vars++] = term;
+            }
+            return planner_put(&planner_buf, PK_VAR, (BPULONG)i);
+        } else if (ISINT(term)) {
+            val = INTVAL(term);
+            return planner_put(&planner_buf, PK_INT, ((BPULONG)val << 1) ^ (BPULONG)(val < 0 ? -1 : 0));
+        } else if (ISATOM(term)) {
+            sym_no = planner_sym_number(GET_ATM_SYM_REC(term));
+            return sym_no >= 0 && planner_put(&planner_buf, PK_ATM, (BPULONG)sym_no);
+        } else if (ISLIST(term)) {
+            if (!planner_put(&planner_buf, PK_LST, 0)) return 0;
+            ptr = (BPLONG_PTR)UNTAGGED_ADDR(term);
+            if (!planner_pack_term(FOLLOW(ptr))) return 0;
+            term = FOLLOW(ptr+1);  /* the tail is packed by the loop */
+        } else {
+            ptr = (BPLONG_PTR)UNTAGGED_ADDR(term);
+            sym_no = planner_sym_number((SYM_REC_PTR)FOLLOW(ptr));
+            if (sym_no < 0 || !planner_put(&planner_buf, PK_STR, (BPULONG)sym_no)) return 0;
+            arity = GET_ARITY((SYM_REC_PTR)FOLLOW(ptr));
+            for (i = 1; i < arity; i++) {
+                if (!planner_pack_term(FOLLOW(ptr+i))) return 0;
+            }
+            term = FOLLOW(ptr+arity);
+        }
+    }
+}
+
+/* pack term into planner_buf; return 0 if memory runs out */
+static int planner_pack(BPLONG term) {
+    planner_buf.top = 0;
+    num_planner_vars = 0;
+    return planner_pack_term(term);
+}
+
+static BPLONG planner_unpack_term(BYTE **pos_ptr) {
+    BPLONG_PTR ptr;
+    BPLONG kind, list, i, arity;
+    BPULONG payload;
+    SYM_REC_PTR sym_ptr;
+
+    payload = planner_get(pos_ptr, &kind);
+    switch (kind) {
+    case PK_INT:
+        return MAKEINT((BPLONG)(payload >> 1) ^ -(BPLONG)(payload & 1));
+    case PK_ATM:
+        return ADDTAG(planner_syms[payload], ATM);
+    case PK_LST:
+        list = ADDTAG(heap_top, LST);
+        for (;;) {
+            ptr = heap_top;
+            heap_top += 2;
+            FOLLOW(ptr) = planner_unpack_term(pos_ptr);
+            if (**pos_ptr != PK_LST) break;  /* the packing of a list cell is one byte */
+            (*pos_ptr)++;
+            FOLLOW(ptr+1) = ADDTAG(heap_top, LST);
+        }
+        FOLLOW(ptr+1) = planner_unpack_term(pos_ptr);
+        return list;
+    case PK_STR:
+        sym_ptr = planner_syms[payload];
+        arity = GET_ARITY(sym_ptr);
+        ptr = heap_top;
+        heap_top += arity+1;
+        FOLLOW(ptr) = (BPLONG)sym_ptr;
+        for (i = 1; i <= arity; i++) {
+            FOLLOW(ptr+i) = planner_unpack_term(pos_ptr);
+        }
+        return ADDTAG(ptr, STR);
+    }
+    if ((BPLONG)payload == num_planner_vars) {  /* the first occurrence */
+        ptr = heap_top;
+        NEW_HEAP_FREE;
+        planner_vars[num_planner_vars++] = (BPLONG)ptr;  /* the room was made when the term was packed */
+    }
+    return planner_vars[payload];
+}
+
+/* build the packed term on the heap; the heap must have two free words for each byte of the term */
+static BPLONG planner_unpack(BYTE *pos) {
+    num_planner_vars = 0;
+    return planner_unpack_term(&pos);
+}
+
+/* the number of bytes of the packed term at pos */
+static BPLONG planner_packed_len(BYTE *pos) {
+    BYTE *pos0;
+    BPLONG kind, pending;
+    BPULONG payload;
+
+    pos0 = pos;
+    pending = 1;
+    while (pending > 0) {
+        payload = planner_get(&pos, &kind);
+        pending--;
+        if (kind == PK_LST) {
+            pending += 2;
+        } else if (kind == PK_STR) {
+            pending += GET_ARITY(planner_syms[payload]);
+        }
+    }
+    return pos-pos0;
+}
+
+static unsigned long long planner_fingerprint(BYTE *bytes, BPLONG len) {
+    unsigned long long h;
+    BPLONG i;
+
+    h = 14695981039346656037ULL;
+    for (i = 0; i < len; i++) {
+        h = (h ^ bytes[i])*1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* the slot of the index that holds the node of the state in planner_buf, or the empty slot where it belongs */
+static BPLONG planner_index_slot(PlannerSearchPtr ps, unsigned long long fp) {
+    BPLONG slot;
+    PlannerNodePtr node;
+
+    slot = (BPLONG)(fp & (unsigned long long)(ps->index_capacity-1));
+    while (ps->index[slot] != 0) {
+        node = ps->nodes+ps->index[slot]-1;
+        if (node->fp == fp &&
+            (ps->fingerprint_only ||
+             (node->state_len == planner_buf.top &&
+              memcmp(ps->states.bytes+node->state, planner_buf.bytes, planner_buf.top) == 0))) break;
+        slot = (slot+1) & (ps->index_capacity-1);
+    }
+    return slot;
+}
+
+static int planner_grow_index(PlannerSearchPtr ps) {
+    UW32 *old_index;
+    BPLONG old_capacity, i, slot;
+
+    old_index = ps->index;
+    old_capacity = ps->index_capacity;
+    ps->index_capacity = (old_capacity == 0) ? 1024 : 2*old_capacity;
+    ps->index = (UW32 *)calloc(ps->index_capacity, sizeof(UW32));
+    if (ps->index == NULL) {
+        ps->index = old_index;
+        ps->index_capacity = old_capacity;
+        return 0;
+    }
+    for (i = 0; i < old_capacity; i++) {
+        if (old_index[i] != 0) {
+            slot = (BPLONG)(ps->nodes[old_index[i]-1].fp & (unsigned long long)(ps->index_capacity-1));
+            while (ps->index[slot] != 0) slot = (slot+1) & (ps->index_capacity-1);
+            ps->index[slot] = old_index[i];
+        }
+    }
+    free(old_index);
+    return 1;
+}
+
+/* move the packed states of the nodes that have not been dropped to a new state pool */
+static void planner_compact_states(PlannerSearchPtr ps) {
+    BYTE *bytes;
+    BPLONG i, top, capacity;
+    PlannerNodePtr node;
+
+    capacity = ps->states.top-ps->states_dropped+1;
+    bytes = (BYTE *)malloc(capacity);
+    if (bytes == NULL) return;
+    top = 0;
+    for (i = 0; i < ps->num_nodes; i++) {
+        node = ps->nodes+i;
+        if (node->state >= 0) {
+            memcpy(bytes+top, ps->states.bytes+node->state, node->state_len);
+            node->state = top;
+            top += node->state_len;
+        }
+    }
+    free(ps->states.bytes);
+    ps->states.bytes = bytes;
+    ps->states.capacity = capacity;
+    ps->states.top = top;
+    ps->states_dropped = 0;
+}
+
+static int planner_queue_less(PlannerQueueEntry *e1, PlannerQueueEntry *e2) {
+    /* among the entries with the smallest f, the deepest one comes first */
+    return e1->f < e2->f || (e1->f == e2->f && e1->g > e2->g);
+}
+
+static int planner_queue_push(PlannerSearchPtr ps, BPLONG f, BPLONG g, BPLONG node_no) {
+    PlannerQueueEntry entry, *ptr;
+    BPLONG i, parent;
+
+    if (ps->queue_size == ps->queue_capacity) {
+        BPLONG new_capacity = (ps->queue_capacity == 0) ? 1024 : 2*ps->queue_capacity;
+        ptr = (PlannerQueueEntry *)realloc(ps->queue, new_capacity*sizeof(PlannerQueueEntry));
+        if (ptr == NULL) return 0;
+        ps->queue = ptr;
+        ps->queue_capacity = new_capacity;
+    }
+    entry.f = (int)f;
+    entry.g = (int)g;
+    entry.node = (int)node_no;
+    i = ps->queue_size++;
+    while (i > 0) {
+        parent = (i-1)/2;
+        if (!planner_queue_less(&entry, ps->queue+parent)) break;
+        ps->queue[i] = ps->queue[parent];
+        i = parent;
+    }
+    ps->queue[i] = entry;
+    return 1;
+}
+
+static void planner_queue_pop(PlannerSearchPtr ps, PlannerQueueEntry *entry_ptr) {
+    PlannerQueueEntry last;
+    BPLONG i, child;
+
+    *entry_ptr = ps->queue[0];
+    last = ps->queue[--ps->queue_size];
+    i = 0;
+    while ((child = 2*i+1) < ps->queue_size) {
+        if (child+1 < ps->queue_size && planner_queue_less(ps->queue+child+1, ps->queue+child)) child++;
+        if (!planner_queue_less(ps->queue+child, &last)) break;
+        ps->queue[i] = ps->queue[child];
+        i = child;
+    }
+    ps->queue[i] = last;
+}
+
+/* Record that the state S has been reached with the cost G. Return 0 if S has already
+   been reached with a cost that is not greater than G, and -1 if memory runs out.
+   Otherwise, set *node_no_ptr to the node of S, and return 1. The packed state is
+   kept in the pool unless keep_state is 0 and the search is fingerprint-only. */
+static int planner_reach(PlannerSearchPtr ps, BPLONG S, BPLONG G, int keep_state, BPLONG *node_no_ptr) {
+    BPLONG slot, node_no;
+    unsigned long long fp;
+    PlannerNodePtr node;
+
+    if (!planner_pack(S)) return -1;
+    fp = planner_fingerprint(planner_buf.bytes, planner_buf.top);
+    slot = planner_index_slot(ps, fp);
+    if (ps->index[slot] != 0) {
+        node_no = ps->index[slot]-1;
+        node = ps->nodes+node_no;
+        if (node->g <= G) return 0;
+    } else {
+        if (ps->num_nodes == ps->nodes_capacity) {
+            BPLONG new_capacity = (ps->nodes_capacity == 0) ? 1024 : 2*ps->nodes_capacity;
+            if (new_capacity > PLANNER_MAX_NODES) new_capacity = PLANNER_MAX_NODES;
+            if (new_capacity == ps->nodes_capacity) return -1;
+            node = (PlannerNodePtr)realloc(ps->nodes, new_capacity*sizeof(PlannerNode));
+            if (node == NULL) return -1;
+            ps->nodes = node;
+            ps->nodes_capacity = new_capacity;
+        }
+        node_no = ps->num_nodes++;
+        node = ps->nodes+node_no;
+        node->fp = fp;
+        node->state = -1;
+        node->state_len = (UW32)planner_buf.top;
+        node->action = -1;
+        ps->index[slot] = (UW32)(node_no+1);
+        if (2*ps->num_nodes > ps->index_capacity && !planner_grow_index(ps)) return -1;
+    }
+    if (node->state < 0 && (keep_state || !ps->fingerprint_only)) {
+        node->state = planner_pool_add(&ps->states);
+        if (node->state < 0) return -1;
+    }
+    node->parent = -1;
+    node->g = (int)G;
+    node->closed = 0;
+    *node_no_ptr = node_no;
+    return 1;
+}
+
+static void planner_reset_search(PlannerSearchPtr ps) {
+    ps->states.top = 0;
+    ps->states_dropped = 0;
+    ps->actions.top = 0;
+    ps->num_nodes = 0;
+    memset(ps->index, 0, ps->index_capacity*sizeof(UW32));
+    ps->queue_size = 0;
+    ps->next_bound = PLANNER_NO_BOUND;
+}
+
+static void planner_free_search(PlannerSearchPtr ps) {
+    free(ps->states.bytes);
+    free(ps->actions.bytes);
+    free(ps->nodes);
+    free(ps->index);
+    free(ps->queue);
+    free(ps);
+}
+
+/* the search whose handle is the term H, or NULL */
+static PlannerSearchPtr planner_search(BPLONG H) {
+    DEREF(H);
+    if (!ISINT(H) || INTVAL(H) < 0 || INTVAL(H) >= num_planner_searches) return NULL;
+    return planner_searches[INTVAL(H)];
+}
+
+/* c_PLANNER_SEARCH_NEW_cf(FingerprintOnly,H): create an empty search, which is
+   fingerprint-only if FingerprintOnly is 1, and bind H to its handle */
+int c_PLANNER_SEARCH_NEW_cf() {
+    BPLONG FingerprintOnly, H, i;
+    PlannerSearchPtr ps, *ptr;
+
+    FingerprintOnly = ARG(1, 2); DEREF(FingerprintOnly);
+    H = ARG(2, 2);
+    if (!ISINT(FingerprintOnly)) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    for (i = 0; i < num_planner_searches; i++) {
+        if (planner_searches[i] == NULL) break;
+    }
+    if (i == num_planner_searches) {
+        ptr = (PlannerSearchPtr *)realloc(planner_searches, (num_planner_searches+1)*sizeof(PlannerSearchPtr));
+        if (ptr == NULL) {
+            bp_exception = et_OUT_OF_MEMORY;
+            return BP_ERROR;
+        }
+        planner_searches = ptr;
+        planner_searches[num_planner_searches++] = NULL;
+    }
+    ps = (PlannerSearchPtr)calloc(1, sizeof(PlannerSearch));
+    if (ps == NULL || !planner_grow_index(ps)) {
+        free(ps);
+        bp_exception = et_OUT_OF_MEMORY;
+        return BP_ERROR;
+    }
+    ps->fingerprint_only = (INTVAL(FingerprintOnly) == 1);
+    ps->next_bound = PLANNER_NO_BOUND;
+    planner_searches[i] = ps;
+    return unify(H, MAKEINT(i));
+}
+
+/* c_PLANNER_SEARCH_FREE_c(H) */
+int c_PLANNER_SEARCH_FREE_c() {
+    BPLONG H;
+    PlannerSearchPtr ps;
+
+    H = ARG(1, 1);
+    ps = planner_search(H);
+    if (ps == NULL) return BP_TRUE;
+    DEREF(H);
+    planner_searches[INTVAL(H)] = NULL;
+    planner_free_search(ps);
+    return BP_TRUE;
+}
+
+/* c_PLANNER_SEARCH_RESET_c(H): forget the states and the frontier of the search */
+int c_PLANNER_SEARCH_RESET_c() {
+    PlannerSearchPtr ps;
+
+    ps = planner_search(ARG(1, 1));
+    if (ps == NULL) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    planner_reset_search(ps);
+    return BP_TRUE;
+}
+
+/* c_PLANNER_SEARCH_ADD_cccccf(H,Parent,S,Action,G,Node): record that state S has been
+   reached with cost G by taking Action from the state of node Parent, which is -1 for
+   the initial state. Fail if S has already been reached with a cost that is not
+   greater than G. Otherwise, bind Node to the node of S, which is reopened if it
+   has been expanded. */
+int c_PLANNER_SEARCH_ADD_cccccf() {
+    BPLONG Parent, S, Action, G, Node;
+    BPLONG node_no, action;
+    PlannerSearchPtr ps;
+    int res;
+
+    ps = planner_search(ARG(1, 6));
+    Parent = ARG(2, 6); DEREF(Parent);
+    S = ARG(3, 6);
+    Action = ARG(4, 6);
+    G = ARG(5, 6); DEREF(G);
+    Node = ARG(6, 6);
+    if (ps == NULL || !ISINT(Parent) || !ISINT(G) || INTVAL(G) < 0 || INTVAL(G) > PLANNER_NO_BOUND ||
+        INTVAL(Parent) < -1 || INTVAL(Parent) >= ps->num_nodes) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    res = planner_reach(ps, S, INTVAL(G), 1, &node_no);
+    if (res == 0) return BP_FALSE;
+    if (res < 0 || !planner_pack(Action) || (action = planner_pool_add(&ps->actions)) < 0) {
+        bp_exception = et_OUT_OF_MEMORY;
+        return BP_ERROR;
+    }
+    ps->nodes[node_no].parent = (int)INTVAL(Parent);
+    ps->nodes[node_no].action = action;
+    return unify(Node, MAKEINT(node_no));
+}
+
+/* c_PLANNER_SEARCH_VISIT_ccc(H,S,G): record that state S has been reached with cost G,
+   and fail if it has already been reached with a cost that is not greater than G */
+int c_PLANNER_SEARCH_VISIT_ccc() {
+    BPLONG G, node_no;
+    PlannerSearchPtr ps;
+    int res;
+
+    ps = planner_search(ARG(1, 3));
+    G = ARG(3, 3); DEREF(G);
+    if (ps == NULL || !ISINT(G) || INTVAL(G) < 0 || INTVAL(G) > PLANNER_NO_BOUND) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    res = planner_reach(ps, ARG(2, 3), INTVAL(G), 0, &node_no);
+    if (res < 0) {
+        bp_exception = et_OUT_OF_MEMORY;
+        return BP_ERROR;
+    }
+    return res;
+}
+
+/* c_PLANNER_SEARCH_QUEUE_ccc(H,Node,F): add Node to the frontier with the estimated total cost F */
+int c_PLANNER_SEARCH_QUEUE_ccc() {
+    BPLONG Node, F;
+    PlannerSearchPtr ps;
+
+    ps = planner_search(ARG(1, 3));
+    Node = ARG(2, 3); DEREF(Node);
+    F = ARG(3, 3); DEREF(F);
+    if (ps == NULL || !ISINT(Node) || !ISINT(F) || INTVAL(Node) < 0 || INTVAL(Node) >= ps->num_nodes ||
+        INTVAL(F) < 0 || INTVAL(F) > PLANNER_NO_BOUND) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    Node = INTVAL(Node);
+    if (!planner_queue_push(ps, INTVAL(F), ps->nodes[Node].g, Node)) {
+        bp_exception = et_OUT_OF_MEMORY;
+        return BP_ERROR;
+    }
+    return BP_TRUE;
+}
+
+/* c_PLANNER_SEARCH_POP_cfff(H,Node,S,G): remove the node with the smallest estimated
+   total cost from the frontier, mark it as expanded, and bind S and G to its state
+   and cost. Fail if the frontier is empty. */
+int c_PLANNER_SEARCH_POP_cfff() {
+    BPLONG Node, S, G, state;
+    PlannerSearchPtr ps;
+    PlannerNodePtr node;
+    PlannerQueueEntry entry;
+
+    ps = planner_search(ARG(1, 4));
+    Node = ARG(2, 4);
+    S = ARG(3, 4);
+    G = ARG(4, 4);
+    if (ps == NULL) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    for (;;) {
+        if (ps->queue_size == 0) return BP_FALSE;
+        planner_queue_pop(ps, &entry);
+        node = ps->nodes+entry.node;
+        if (!node->closed && node->g == entry.g) break;  /* otherwise, the entry is stale */
+    }
+    if (local_top-heap_top <= 2*(BPLONG)node->state_len+LARGE_MARGIN) {
+        bp_exception = et_OUT_OF_MEMORY_STACK;
+        return BP_ERROR;
+    }
+    node->closed = 1;
+    state = planner_unpack(ps->states.bytes+node->state);
+    if (ps->fingerprint_only) {
+        node->state = -1;
+        ps->states_dropped += node->state_len;
+        if (ps->states_dropped > 65536 && 2*ps->states_dropped > ps->states.top) planner_compact_states(ps);
+    }
+    return unify(Node, MAKEINT(entry.node)) &&
+        unify(S, state) &&
+        unify(G, MAKEINT(node->g));
+}
+
+/* c_PLANNER_SEARCH_PLAN_ccf(H,Node,Plan): bind Plan to the actions on the path to Node */
+int c_PLANNER_SEARCH_PLAN_ccf() {
+    BPLONG Node, Plan, node_no, size, plan;
+    BPLONG_PTR ptr;
+    PlannerSearchPtr ps;
+    PlannerNodePtr node;
+
+    ps = planner_search(ARG(1, 3));
+    Node = ARG(2, 3); DEREF(Node);
+    Plan = ARG(3, 3);
+    if (ps == NULL || !ISINT(Node) || INTVAL(Node) < 0 || INTVAL(Node) >= ps->num_nodes) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    size = 0;
+    for (node_no = INTVAL(Node); ps->nodes[node_no].parent >= 0; node_no = ps->nodes[node_no].parent) {
+        size += 2+2*planner_packed_len(ps->actions.bytes+ps->nodes[node_no].action);
+    }
+    if (local_top-heap_top <= size+LARGE_MARGIN) {
+        bp_exception = et_OUT_OF_MEMORY_STACK;
+        return BP_ERROR;
+    }
+    plan = nil_sym;
+    for (node_no = INTVAL(Node); ps->nodes[node_no].parent >= 0; node_no = ps->nodes[node_no].parent) {
+        node = ps->nodes+node_no;
+        ptr = heap_top;
+        heap_top += 2;
+        FOLLOW(ptr+1) = plan;
+        FOLLOW(ptr) = planner_unpack(ps->actions.bytes+node->action);
+        plan = ADDTAG(ptr, LST);
+    }
+    return unify(Plan, plan);
+}
+
+/* c_PLANNER_SEARCH_BOUND_cc(H,F): note that the estimated total cost F has exceeded the bound */
+int c_PLANNER_SEARCH_BOUND_cc() {
+    BPLONG F;
+    PlannerSearchPtr ps;
+
+    ps = planner_search(ARG(1, 2));
+    F = ARG(2, 2); DEREF(F);
+    if (ps == NULL || !ISINT(F)) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    if (INTVAL(F) < ps->next_bound) ps->next_bound = INTVAL(F);
+    return BP_TRUE;
+}
+
+/* c_PLANNER_SEARCH_NEXT_BOUND_cf(H,F): bind F to the smallest estimated total cost that
+   has exceeded the bound, and forget it. Fail if no cost has exceeded the bound. */
+int c_PLANNER_SEARCH_NEXT_BOUND_cf() {
+    BPLONG F, bound;
+    PlannerSearchPtr ps;
+
+    ps = planner_search(ARG(1, 2));
+    F = ARG(2, 2);
+    if (ps == NULL) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    bound = ps->next_bound;
+    if (bound == PLANNER_NO_BOUND) return BP_FALSE;
+    ps->next_bound = PLANNER_NO_BOUND;
+    return unify(F, MAKEINT(bound));
+}
+
+/* c_PLANNER_SEARCH_STATISTICS_cf(H,Stats): bind Stats to the list [states=N,
+   state_bytes=SB,action_bytes=AB,node_bytes=NB,index_bytes=IB,frontier=Q] */
+int c_PLANNER_SEARCH_STATISTICS_cf() {
+    static const char *names[6] = {"states", "state_bytes", "action_bytes", "node_bytes", "index_bytes", "frontier"};
+    BPLONG Stats, list, i;
+    BPLONG vals[6];
+    BPLONG_PTR ptr;
+    SYM_REC_PTR eq_sym_ptr;
+    PlannerSearchPtr ps;
+
+    ps = planner_search(ARG(1, 2));
+    Stats = ARG(2, 2);
+    if (ps == NULL) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    if (local_top-heap_top <= LARGE_MARGIN) {
+        bp_exception = et_OUT_OF_MEMORY_STACK;
+        return BP_ERROR;
+    }
+    vals[0] = ps->num_nodes;
+    vals[1] = ps->states.top-ps->states_dropped;
+    vals[2] = ps->actions.top;
+    vals[3] = ps->num_nodes*(BPLONG)sizeof(PlannerNode);
+    vals[4] = ps->index_capacity*(BPLONG)sizeof(UW32);
+    vals[5] = ps->queue_size;
+    eq_sym_ptr = insert_sym("=", 1, 2);
+    list = nil_sym;
+    for (i = 5; i >= 0; i--) {
+        ptr = heap_top;
+        heap_top += 5;
+        FOLLOW(ptr) = (BPLONG)eq_sym_ptr;
+        FOLLOW(ptr+1) = ADDTAG(insert_sym(names[i], strlen(names[i]), 0), ATM);
+        FOLLOW(ptr+2) = MAKEINT(vals[i]);
+        FOLLOW(ptr+3) = ADDTAG(ptr, STR);
+        FOLLOW(ptr+4) = list;
+        list = ADDTAG(ptr+3, LST);
+    }
+    return unify(Stats, list);
+}
+
+/******************* PARALLEL BRANCH-AND-BOUND ********************/
+/* The parallel mode of the planner module forks worker processes, which search the
+   subtrees below the states at a shallow level of the search tree. Those states are
+   numbered tasks, which are dealt out round-robin to deques, one for each worker. A
+   worker takes tasks from the front of its own deque, where the cheapest ones are, and
+   steals tasks from the back of the other deques when its own deque is empty. The
+   deques, the cost of the best plan found so far, which bounds the searches of all of
+   the workers, and the best plan itself are kept in memory that is shared by the
+   processes. The process that starts the search waits for the workers, which are
+   numbered from 1.
+
+   A plan is exported with the names of its symbols, because a worker may have created
+   symbols that the other processes do not have: the exported form is the number of
+   symbols, the arity, length, and name of each symbol, and the packing of the term in
+   which the symbols are numbered in the order of their first occurrences. */
+
+#define PLANNER_RESULT_CAPACITY (16L*1024*1024)
+
+#define PLANNER_RESULT_NONE 0
+#define PLANNER_RESULT_PLAN 1
+#define PLANNER_RESULT_EXCEPTION 2
+#define PLANNER_RESULT_LOST 3  /* a worker has died, or the result did not fit */
+
+#ifdef WIN32  /* no workers are forked */
+#define PLANNER_LOCK(lock)
+#define PLANNER_UNLOCK(lock)
+#else
+#define PLANNER_LOCK(lock) while (__sync_lock_test_and_set((lock), 1)) {while (*(lock)) ;}
+#define PLANNER_UNLOCK(lock) __sync_lock_release(lock)
+#endif
+
+typedef struct {
+    volatile int lock;
+    int head, tail;  /* the tasks of the deque are in its slots head..tail-1 */
+} PlannerDeque;
+
+typedef struct {
+    volatile int lock;      /* protects the bound and the result */
+    volatile int stop;      /* set when a worker has raised an exception */
+    volatile BPLONG bound;  /* the cost of the best plan found so far, or Limit+1 */
+    int status;
+    BPLONG result_len;
+} PlannerShared;
+
+typedef struct {
+    PlannerShared *shared;
+    size_t size;
+    PlannerDeque *deques;
+    int *slots;          /* the slots of the deque of worker i+1 start at slots+i*deque_capacity */
+    volatile int *done;  /* done[i] is set when worker i+1 has finished normally */
+    BYTE *result;
+    int num_workers;
+    int deque_capacity;
+    int worker;          /* the worker that this process is, or 0 */
+#ifndef WIN32
+    pid_t *pids;
+#endif
+} PlannerParallel, *PlannerParallelPtr;
+
+static PlannerParallelPtr *planner_parallels = NULL;
+static BPLONG num_planner_parallels = 0;
+
+static PlannerPool planner_export_buf = {NULL, 0, 0};
+static int *planner_export_nos = NULL;  /* the numbers of the symbols in the exported term, or -1 */
+static BPLONG planner_export_nos_capacity = 0;
+
+#define PLANNER_ALIGN(n) (((n)+7) & ~(size_t)7)
+
+static int planner_reserve_export_nos(BPLONG n) {
+    int *ptr;
+
+    if (n <= planner_export_nos_capacity) return 1;
+    ptr = (int *)realloc(planner_export_nos, n*sizeof(int));
+    if (ptr == NULL) return 0;
+    planner_export_nos = ptr;
+    planner_export_nos_capacity = n;
+    return 1;
+}
+
+/* export term to planner_export_buf; return 0 if memory runs out */
+static int planner_export(BPLONG term) {
+    BYTE *pos, *end;
+    BPLONG kind, num_syms, next, i, len;
+    BPULONG payload;
+    SYM_REC_PTR sym_ptr;
+    PlannerPool *pool = &planner_export_buf;
+
+    if (!planner_pack(term) || !planner_reserve_export_nos(num_planner_syms)) return 0;
+    for (i = 0; i < num_planner_syms; i++) planner_export_nos[i] = -1;
+    num_syms = 0;
+    pos = planner_buf.bytes;
+    end = pos+planner_buf.top;
+    while (pos < end) {
+        payload = planner_get(&pos, &kind);
+        if ((kind == PK_ATM || kind == PK_STR) && planner_export_nos[payload] < 0) {
+            planner_export_nos[payload] = (int)num_syms++;
+        }
+    }
+    pool->top = 0;
+    if (!planner_put(pool, PK_INT, (BPULONG)num_syms)) return 0;
+    next = 0;
+    for (pos = planner_buf.bytes; pos < end; ) {
+        payload = planner_get(&pos, &kind);
+        if ((kind == PK_ATM || kind == PK_STR) && planner_export_nos[payload] == next) {
+            sym_ptr = planner_syms[payload];
+            len = GET_LENGTH(sym_ptr);
+            if (!planner_put(pool, PK_INT, (BPULONG)GET_ARITY(sym_ptr)) ||
+                !planner_put(pool, PK_INT, (BPULONG)len) ||
+                !planner_pool_reserve(pool, len)) return 0;
+            memcpy(pool->bytes+pool->top, GET_NAME(sym_ptr), len);
+            pool->top += len;
+            next++;
+        }
+    }
+    for (pos = planner_buf.bytes; pos < end; ) {
+        payload = planner_get(&pos, &kind);
+        if (kind == PK_ATM || kind == PK_STR) payload = (BPULONG)planner_export_nos[payload];
+        if (!planner_put(pool, kind, payload)) return 0;
+    }
+    return 1;
+}
+
+/* translate the exported term at bytes into a packed term in planner_buf; return 0 if memory runs out */
+static int planner_import(BYTE *bytes, BPLONG len) {
+    BYTE *pos, *end;
+    BPLONG kind, num_syms, i, arity, name_len, sym_no;
+    BPULONG payload;
+
+    pos = bytes;
+    end = bytes+len;
+    num_syms = (BPLONG)planner_get(&pos, &kind);
+    if (!planner_reserve_export_nos(num_syms)) return 0;
+    for (i = 0; i < num_syms; i++) {
+        arity = (BPLONG)planner_get(&pos, &kind);
+        name_len = (BPLONG)planner_get(&pos, &kind);
+        sym_no = planner_sym_number(insert_sym((char *)pos, name_len, arity));
+        if (sym_no < 0) return 0;
+        planner_export_nos[i] = (int)sym_no;
+        pos += name_len;
+    }
+    planner_buf.top = 0;
+    while (pos < end) {
+        payload = planner_get(&pos, &kind);
+        if (kind == PK_ATM || kind == PK_STR) {
+            payload = (BPULONG)planner_export_nos[payload];
+        } else if (kind == PK_VAR && (BPLONG)payload >= planner_vars_capacity) {  /* make room for planner_unpack */
+            BPLONG_PTR ptr = (BPLONG_PTR)realloc(planner_vars, (payload+16)*sizeof(BPLONG));
+            if (ptr == NULL) return 0;
+            planner_vars = ptr;
+            planner_vars_capacity = payload+16;
+        }
+        if (!planner_put(&planner_buf, kind, payload)) return 0;
+    }
+    return 1;
+}
+
+/* store the exported term in planner_export_buf as the result; the lock must be held */
+static void planner_store_result(PlannerParallelPtr pp, int status) {
+    if (planner_export_buf.top > PLANNER_RESULT_CAPACITY) {
+        pp->shared->status = PLANNER_RESULT_LOST;
+        return;
+    }
+    memcpy(pp->result, planner_export_buf.bytes, planner_export_buf.top);
+    pp->shared->result_len = planner_export_buf.top;
+    pp->shared->status = status;
+}
+
+static void planner_free_parallel(PlannerParallelPtr pp) {
+#ifndef WIN32
+    int i, status;
+
+    for (i = 0; i < pp->num_workers; i++) {
+        if (pp->pids[i] > 0) {
+            kill(pp->pids[i], SIGKILL);
+            waitpid(pp->pids[i], &status, 0);
+        }
+    }
+    munmap((void *)pp->shared, pp->size);
+    free(pp->pids);
+#else
+    free(pp->shared);
+#endif
+    free(pp);
+}
+
+/* the parallel search whose handle is the term H, or NULL */
+static PlannerParallelPtr planner_parallel(BPLONG H) {
+    DEREF(H);
+    if (!ISINT(H) || INTVAL(H) < 0 || INTVAL(H) >= num_planner_parallels) return NULL;
+    return planner_parallels[INTVAL(H)];
+}
+
+/* c_PLANNER_PARALLEL_CPUS_f(N): bind N to the number of processors that are online */
+int c_PLANNER_PARALLEL_CPUS_f() {
+    BPLONG n;
+
+#if defined(WIN32) || !defined(_SC_NPROCESSORS_ONLN)
+    n = 1;
+#else
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) n = 1;
+#endif
+    return unify(ARG(1, 1), MAKEINT(n));
+}
+
+/* c_PLANNER_PARALLEL_NEW_cccf(Workers,NumTasks,Bound,H): create a parallel search with the
+   tasks 1..NumTasks, which is bounded by Bound, and bind H to its handle */
+int c_PLANNER_PARALLEL_NEW_cccf() {
+    BPLONG Workers, NumTasks, Bound, H, h, i, num_workers, num_tasks, capacity;
+    size_t deques_off, slots_off, done_off, result_off, size;
+    BYTE *mem;
+    PlannerParallelPtr pp, *ptr;
+
+    Workers = ARG(1, 4); DEREF(Workers);
+    NumTasks = ARG(2, 4); DEREF(NumTasks);
+    Bound = ARG(3, 4); DEREF(Bound);
+    H = ARG(4, 4);
+    if (!ISINT(Workers) || INTVAL(Workers) < 1 || !ISINT(NumTasks) || INTVAL(NumTasks) < 0 ||
+        !ISINT(Bound) || INTVAL(Bound) < 0) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    num_workers = INTVAL(Workers);
+    if (num_workers > 1024) num_workers = 1024;
+    num_tasks = INTVAL(NumTasks);
+    capacity = (num_tasks+num_workers-1)/num_workers;
+    if (capacity == 0) capacity = 1;
+    deques_off = PLANNER_ALIGN(sizeof(PlannerShared));
+    slots_off = deques_off+PLANNER_ALIGN(num_workers*sizeof(PlannerDeque));
+    done_off = slots_off+PLANNER_ALIGN(num_workers*capacity*sizeof(int));
+    result_off = done_off+PLANNER_ALIGN(num_workers*sizeof(int));
+    size = result_off+PLANNER_RESULT_CAPACITY;
+
+    for (h = 0; h < num_planner_parallels; h++) {
+        if (planner_parallels[h] == NULL) break;
+    }
+    if (h == num_planner_parallels) {
+        ptr = (PlannerParallelPtr *)realloc(planner_parallels, (num_planner_parallels+1)*sizeof(PlannerParallelPtr));
+        if (ptr == NULL) {
+            bp_exception = et_OUT_OF_MEMORY;
+            return BP_ERROR;
+        }
+        planner_parallels = ptr;
+        planner_parallels[num_planner_parallels++] = NULL;
+    }
+    pp = (PlannerParallelPtr)calloc(1, sizeof(PlannerParallel));
+    if (pp == NULL) {
+        bp_exception = et_OUT_OF_MEMORY;
+        return BP_ERROR;
+    }
+#ifdef WIN32
+    mem = (BYTE *)calloc(1, size);
+#else
+    pp->pids = (pid_t *)calloc(num_workers, sizeof(pid_t));
+    mem = (BYTE *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == (BYTE *)MAP_FAILED) mem = NULL;
+    if (mem == NULL || pp->pids == NULL) {
+        if (mem != NULL) munmap(mem, size);
+        free(pp->pids);
+        mem = NULL;
+    }
+#endif
+    if (mem == NULL) {
+        free(pp);
+        bp_exception = et_OUT_OF_MEMORY;
+        return BP_ERROR;
+    }
+    pp->shared = (PlannerShared *)mem;
+    pp->size = size;
+    pp->deques = (PlannerDeque *)(mem+deques_off);
+    pp->slots = (int *)(mem+slots_off);
+    pp->done = (volatile int *)(mem+done_off);
+    pp->result = mem+result_off;
+    pp->num_workers = (int)num_workers;
+    pp->deque_capacity = (int)capacity;
+    pp->worker = 0;
+    pp->shared->bound = INTVAL(Bound);
+    pp->shared->status = PLANNER_RESULT_NONE;
+    for (i = 0; i < num_tasks; i++) {  /* task i+1 goes to worker (i mod num_workers)+1 */
+        PlannerDeque *dq = pp->deques+i%num_workers;
+        pp->slots[(i%num_workers)*capacity+dq->tail++] = (int)(i+1);
+    }
+    planner_parallels[h] = pp;
+    return unify(H, MAKEINT(h));
+}
+
+/* c_PLANNER_PARALLEL_FREE_c(H): kill the workers that are still running, and free the search */
+int c_PLANNER_PARALLEL_FREE_c() {
+    BPLONG H;
+    PlannerParallelPtr pp;
+
+    H = ARG(1, 1);
+    pp = planner_parallel(H);
+    if (pp == NULL) return BP_TRUE;
+    DEREF(H);
+    planner_parallels[INTVAL(H)] = NULL;
+    planner_free_parallel(pp);
+    return BP_TRUE;
+}
+
+/* c_PLANNER_PARALLEL_FORK_cf(H,Worker): fork the workers of the search. Worker is bound to
+   the number of the worker in each forked process, and to 0 in this process, or to -1 if
+   no worker could be forked. A worker that cannot be forked is left out; its tasks are
+   stolen by the others. */
+int c_PLANNER_PARALLEL_FORK_cf() {
+    PlannerParallelPtr pp;
+    int forked;
+#ifndef WIN32
+    int i;
+    pid_t pid;
+#endif
+
+    pp = planner_parallel(ARG(1, 2));
+    if (pp == NULL) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    forked = 0;
+#ifndef WIN32
+    fflush(NULL);  /* so that the buffered output is not written by the workers too */
+    for (i = 0; i < pp->num_workers; i++) {
+        pid = fork();
+        if (pid == 0) {
+            pp->worker = i+1;
+            return unify(ARG(2, 2), MAKEINT(i+1));
+        }
+        pp->pids[i] = pid;
+        if (pid > 0) forked++;
+    }
+#endif
+    return unify(ARG(2, 2), MAKEINT(forked > 0 ? 0 : -1));
+}
+
+/* c_PLANNER_PARALLEL_EXIT_c(H): end the worker process */
+int c_PLANNER_PARALLEL_EXIT_c() {
+    PlannerParallelPtr pp;
+
+    pp = planner_parallel(ARG(1, 1));
+    if (pp == NULL || pp->worker == 0) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    pp->done[pp->worker-1] = 1;
+    fflush(NULL);
+#ifndef WIN32
+    _exit(0);
+#endif
+    return BP_TRUE;
+}
+
+/* c_PLANNER_PARALLEL_WAIT_c(H): wait for the forked workers to end. The result is lost
+   if a worker has ended without finishing its tasks. */
+int c_PLANNER_PARALLEL_WAIT_c() {
+    PlannerParallelPtr pp;
+#ifndef WIN32
+    int i, status;
+#endif
+
+    pp = planner_parallel(ARG(1, 1));
+    if (pp == NULL) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+#ifndef WIN32
+    for (i = 0; i < pp->num_workers; i++) {
+        if (pp->pids[i] <= 0) continue;
+        waitpid(pp->pids[i], &status, 0);
+        pp->pids[i] = 0;
+        if (!pp->done[i] && pp->shared->status != PLANNER_RESULT_EXCEPTION) {
+            pp->shared->status = PLANNER_RESULT_LOST;
+        }
+    }
+#endif
+    return BP_TRUE;
+}
+
+/* c_PLANNER_PARALLEL_TAKE_cf(H,Task): bind Task to the next task of this worker, which
+   is stolen from another worker if this worker has no task left. Task is bound to 0
+   when no task is left, or when the search has been stopped. */
+int c_PLANNER_PARALLEL_TAKE_cf() {
+    PlannerParallelPtr pp;
+    PlannerDeque *dq;
+    int i, w, victim, task;
+
+    pp = planner_parallel(ARG(1, 2));
+    if (pp == NULL || pp->worker == 0) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    task = 0;
+    if (!pp->shared->stop) {
+        w = pp->worker-1;
+        dq = pp->deques+w;
+        PLANNER_LOCK(&dq->lock);
+        if (dq->head < dq->tail) task = pp->slots[w*pp->deque_capacity+dq->head++];
+        PLANNER_UNLOCK(&dq->lock);
+        for (i = 1; task == 0 && i < pp->num_workers; i++) {
+            victim = (w+i)%pp->num_workers;
+            dq = pp->deques+victim;
+            PLANNER_LOCK(&dq->lock);
+            if (dq->head < dq->tail) task = pp->slots[victim*pp->deque_capacity+(--dq->tail)];
+            PLANNER_UNLOCK(&dq->lock);
+        }
+    }
+    return unify(ARG(2, 2), MAKEINT(task));
+}
+
+/* c_PLANNER_PARALLEL_BOUND_cf(H,Bound): bind Bound to the cost of the best plan found so
+   far by any worker, or to the initial bound; Bound is 0 once the search has been stopped */
+int c_PLANNER_PARALLEL_BOUND_cf() {
+    PlannerParallelPtr pp;
+
+    pp = planner_parallel(ARG(1, 2));
+    if (pp == NULL) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    return unify(ARG(2, 2), MAKEINT(pp->shared->stop ? 0 : pp->shared->bound));
+}
+
+/* c_PLANNER_PARALLEL_REPORT_ccc(H,Cost,Plan): make Plan the best plan if Cost is lower
+   than the cost of the best plan found so far */
+int c_PLANNER_PARALLEL_REPORT_ccc() {
+    BPLONG Cost;
+    PlannerParallelPtr pp;
+    PlannerShared *sh;
+
+    pp = planner_parallel(ARG(1, 3));
+    Cost = ARG(2, 3); DEREF(Cost);
+    if (pp == NULL || !ISINT(Cost) || INTVAL(Cost) < 0) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    sh = pp->shared;
+    Cost = INTVAL(Cost);
+    if (Cost >= sh->bound) return BP_TRUE;
+    if (!planner_export(ARG(3, 3))) {
+        bp_exception = et_OUT_OF_MEMORY;
+        return BP_ERROR;
+    }
+    PLANNER_LOCK(&sh->lock);
+    if (Cost < sh->bound && sh->status != PLANNER_RESULT_EXCEPTION) {
+        planner_store_result(pp, PLANNER_RESULT_PLAN);
+        sh->bound = Cost;
+    }
+    PLANNER_UNLOCK(&sh->lock);
+    return BP_TRUE;
+}
+
+/* c_PLANNER_PARALLEL_ABORT_cc(H,Exception): stop the search, and make Exception its
+   result unless another worker has raised an exception already */
+int c_PLANNER_PARALLEL_ABORT_cc() {
+    PlannerParallelPtr pp;
+    PlannerShared *sh;
+    int exported;
+
+    pp = planner_parallel(ARG(1, 2));
+    if (pp == NULL) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    sh = pp->shared;
+    exported = planner_export(ARG(2, 2));
+    PLANNER_LOCK(&sh->lock);
+    if (sh->status != PLANNER_RESULT_EXCEPTION) {
+        if (exported) {
+            planner_store_result(pp, PLANNER_RESULT_EXCEPTION);
+        } else {
+            sh->status = PLANNER_RESULT_LOST;
+        }
+    }
+    sh->stop = 1;
+    PLANNER_UNLOCK(&sh->lock);
+    return BP_TRUE;
+}
+
+/* c_PLANNER_PARALLEL_RESULT_cfff(H,Status,Cost,Term): bind Status to 0 if no plan has
+   been found, to 1 if Term is the best plan and Cost its cost, to 2 if Term is an
+   exception raised by a worker, and to 3 if the result has been lost */
+int c_PLANNER_PARALLEL_RESULT_cfff() {
+    BPLONG term;
+    PlannerParallelPtr pp;
+    PlannerShared *sh;
+
+    pp = planner_parallel(ARG(1, 4));
+    if (pp == NULL) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    sh = pp->shared;
+    term = nil_sym;
+    if (sh->status == PLANNER_RESULT_PLAN || sh->status == PLANNER_RESULT_EXCEPTION) {
+        if (!planner_import(pp->result, sh->result_len)) {
+            bp_exception = et_OUT_OF_MEMORY;
+            return BP_ERROR;
+        }
+        if (local_top-heap_top <= 2*planner_buf.top+LARGE_MARGIN) {
+            bp_exception = et_OUT_OF_MEMORY_STACK;
+            return BP_ERROR;
+        }
+        term = planner_unpack(planner_buf.bytes);
+    }
+    return unify(ARG(2, 4), MAKEINT(sh->status)) &&
+        unify(ARG(3, 4), MAKEINT(sh->bound)) &&
+        unify(ARG(4, 4), term);
+}
+
+/******************* EXTERNAL-MEMORY SEARCH ********************/
+/* The external mode of the planner module expands the states in the order of their
+   costs, and keeps the frontier and the visited set in files, so that the number of
+   states is bounded by the disk rather than by the memory. The states of cost G form
+   layer G. A generated state is not looked up when it is generated. It is appended to a
+   batch in memory, and when the batch is full, the batch is sorted and written to the
+   files of runs, one run for each cost. The duplicates are removed when a layer is about
+   to be expanded: the runs of the layer are merged, the states that are in the visited
+   file are left out, and the result is written to a layer file and merged into the
+   visited file. An action of cost 0 adds a state to the layer that is being expanded;
+   such states form another part of the layer.
+
+   A record in a file is a header followed by the packed state and the packed action that
+   led to the state. The records of a run, a layer, and the visited file are ordered by
+   the fingerprints and the packings of their states, and the records of the visited file
+   have no actions. A record also tells where the record of its parent state, in which the
+   action was taken, is: the number of the layer and the position in the layer file. A
+   plan is found by reading these records back from the final state to the initial state. */
+
+#define PLANNER_EXT_MAX_RUNS 64  /* the number of files that are merged at once */
+#define PLANNER_EXT_IO_BUF 65536
+
+typedef struct {
+    unsigned long long fp;          /* the fingerprint of the state */
+    unsigned long long parent_pos;  /* the position of the record of the parent in its layer file */
+    UW32 state_len;
+    UW32 action_len;
+    int g;                          /* the cost of the state */
+    int parent_layer;               /* the layer of the parent, or -1 for the initial state */
+} PlannerExtHeader;
+
+typedef struct {
+    FILE *file;
+    PlannerExtHeader header;
+    BYTE *bytes;  /* the state and the action of the current record */
+    BPLONG capacity;
+    BPLONG pos;         /* the position of the next record in the file */
+    BPLONG record_pos;  /* the position of the current record */
+} PlannerExtReader;
+
+typedef struct {
+    BPLONG g;
+    BPLONG *runs;  /* the numbers of the files of the runs */
+    BPLONG num_runs, runs_capacity;
+} PlannerExtBucket;
+
+typedef struct {
+    BPLONG g;
+    BPLONG file_no;
+} PlannerExtLayer;
+
+typedef struct {
+    char *dir;
+    BPLONG dir_atom;
+    BPLONG id;
+    BPLONG next_file_no;
+    int out_of_memory;   /* tells whether the last failure was caused by the memory or by a file */
+    PlannerPool batch;   /* the records that have not been written, each padded to 8 bytes */
+    BPLONG batch_size;
+    BPLONG *batch_offs;
+    BPLONG num_batch, batch_offs_capacity;
+    PlannerExtBucket *buckets;
+    BPLONG num_buckets, buckets_capacity;
+    PlannerExtLayer *layers;
+    BPLONG num_layers, layers_capacity;
+    BPLONG visited_no;   /* the number of the visited file, or -1 */
+    PlannerExtReader current;  /* the reader of the layer that is being expanded */
+    BPLONG current_g;
+    BPLONG num_states;   /* the states in the layers */
+    BPLONG bytes_written;
+} PlannerExternal, *PlannerExternalPtr;
+
+static PlannerExternalPtr *planner_externals = NULL;
+static BPLONG num_planner_externals = 0;
+static PlannerExternalPtr planner_ext_sorted;  /* the search whose batch is being sorted */
+
+static void planner_ext_path(PlannerExternalPtr pe, BPLONG no, char *path) {
+    snprintf(path, MAX_STR_LEN, "%s/picat_plan_%ld_%ld_%ld.tmp", pe->dir, (long)getpid(), (long)pe->id, (long)no);
+}
+
+static FILE *planner_ext_create(PlannerExternalPtr pe, BPLONG *no_ptr) {
+    char path[MAX_STR_LEN];
+    FILE *file;
+
+    *no_ptr = pe->next_file_no++;
+    planner_ext_path(pe, *no_ptr, path);
+    file = fopen(path, "wb");
+    if (file != NULL) setvbuf(file, NULL, _IOFBF, PLANNER_EXT_IO_BUF);
+    return file;
+}
+
+static int planner_ext_open(PlannerExternalPtr pe, PlannerExtReader *r, BPLONG no) {
+    char path[MAX_STR_LEN];
+
+    planner_ext_path(pe, no, path);
+    r->file = fopen(path, "rb");
+    if (r->file == NULL) return 0;
+    setvbuf(r->file, NULL, _IOFBF, PLANNER_EXT_IO_BUF);
+    r->pos = 0;
+    return 1;
+}
+
+static void planner_ext_close(PlannerExtReader *r) {
+    if (r->file != NULL) fclose(r->file);
+    r->file = NULL;
+}
+
+static void planner_ext_remove(PlannerExternalPtr pe, BPLONG no) {
+    char path[MAX_STR_LEN];
+
+    planner_ext_path(pe, no, path);
+    remove(path);
+}
+
+static int planner_ext_write(PlannerExternalPtr pe, FILE *file, PlannerExtHeader *header, BYTE *bytes) {
+    size_t len;
+
+    len = header->state_len+header->action_len;
+    if (fwrite(header, sizeof(PlannerExtHeader), 1, file) != 1 ||
+        (len > 0 && fwrite(bytes, 1, len, file) != len)) return 0;
+    pe->bytes_written += sizeof(PlannerExtHeader)+len;
+    return 1;
+}
+
+/* write the state of the record to the visited file */
+static int planner_ext_write_visited(PlannerExternalPtr pe, FILE *file, PlannerExtHeader *header, BYTE *bytes) {
+    PlannerExtHeader visited;
+
+    visited = *header;
+    visited.parent_pos = 0;
+    visited.parent_layer = 0;
+    visited.action_len = 0;
+    return planner_ext_write(pe, file, &visited, bytes);
+}
+
+/* read the next record; return 0 at the end of the file, and -1 if memory runs out */
+static int planner_ext_read(PlannerExtReader *r) {
+    size_t len;
+    BYTE *ptr;
+
+    if (fread(&r->header, sizeof(PlannerExtHeader), 1, r->file) != 1) return 0;
+    len = r->header.state_len+r->header.action_len;
+    if ((BPLONG)len > r->capacity) {
+        ptr = (BYTE *)realloc(r->bytes, len);
+        if (ptr == NULL) return -1;
+        r->bytes = ptr;
+        r->capacity = len;
+    }
+    if (len > 0 && fread(r->bytes, 1, len, r->file) != len) return 0;
+    r->record_pos = r->pos;
+    r->pos += sizeof(PlannerExtHeader)+len;
+    return 1;
+}
+
+static int planner_ext_compare(PlannerExtHeader *h1, BYTE *b1, PlannerExtHeader *h2, BYTE *b2) {
+    int c;
+
+    if (h1->fp != h2->fp) return (h1->fp < h2->fp) ? -1 : 1;
+    c = memcmp(b1, b2, (h1->state_len < h2->state_len) ? h1->state_len : h2->state_len);
+    if (c != 0) return c;
+    return (h1->state_len < h2->state_len) ? -1 : (h1->state_len > h2->state_len);
+}
+
+/* order the records of a batch by their costs and their states */
+static int planner_ext_batch_compare(const void *p1, const void *p2) {
+    PlannerExtHeader *h1, *h2;
+
+    h1 = (PlannerExtHeader *)(planner_ext_sorted->batch.bytes+*(BPLONG *)p1);
+    h2 = (PlannerExtHeader *)(planner_ext_sorted->batch.bytes+*(BPLONG *)p2);
+    if (h1->g != h2->g) return (h1->g < h2->g) ? -1 : 1;
+    return planner_ext_compare(h1, (BYTE *)(h1+1), h2, (BYTE *)(h2+1));
+}
+
+static PlannerExtBucket *planner_ext_bucket(PlannerExternalPtr pe, BPLONG g) {
+    BPLONG i;
+    PlannerExtBucket *ptr;
+
+    for (i = 0; i < pe->num_buckets; i++) {
+        if (pe->buckets[i].g == g) return pe->buckets+i;
+    }
+    if (pe->num_buckets == pe->buckets_capacity) {
+        BPLONG new_capacity = (pe->buckets_capacity == 0) ? 16 : 2*pe->buckets_capacity;
+        ptr = (PlannerExtBucket *)realloc(pe->buckets, new_capacity*sizeof(PlannerExtBucket));
+        if (ptr == NULL) return NULL;
+        pe->buckets = ptr;
+        pe->buckets_capacity = new_capacity;
+    }
+    ptr = pe->buckets+pe->num_buckets++;
+    ptr->g = g;
+    ptr->runs = NULL;
+    ptr->num_runs = 0;
+    ptr->runs_capacity = 0;
+    return ptr;
+}
+
+static int planner_ext_add_run(PlannerExtBucket *bucket, BPLONG no) {
+    BPLONG *ptr;
+
+    if (bucket->num_runs == bucket->runs_capacity) {
+        BPLONG new_capacity = (bucket->runs_capacity == 0) ? 16 : 2*bucket->runs_capacity;
+        ptr = (BPLONG *)realloc(bucket->runs, new_capacity*sizeof(BPLONG));
+        if (ptr == NULL) return 0;
+        bucket->runs = ptr;
+        bucket->runs_capacity = new_capacity;
+    }
+    bucket->runs[bucket->num_runs++] = no;
+    return 1;
+}
+
+/* sort the batch, and write it as runs without duplicates, one run for each cost */
+static int planner_ext_flush(PlannerExternalPtr pe) {
+    BPLONG i, no;
+    FILE *file;
+    PlannerExtHeader *h, *last;
+    PlannerExtBucket *bucket;
+
+    if (pe->num_batch == 0) return 1;
+    planner_ext_sorted = pe;
+    qsort(pe->batch_offs, pe->num_batch, sizeof(BPLONG), planner_ext_batch_compare);
+    file = NULL;
+    last = NULL;
+    for (i = 0; i < pe->num_batch; i++) {
+        h = (PlannerExtHeader *)(pe->batch.bytes+pe->batch_offs[i]);
+        if (last != NULL && last->g == h->g) {
+            if (planner_ext_compare(last, (BYTE *)(last+1), h, (BYTE *)(h+1)) == 0) continue;
+        } else {
+            if (file != NULL && fclose(file) != 0) return 0;
+            file = NULL;
+            bucket = planner_ext_bucket(pe, h->g);
+            if (bucket == NULL || (file = planner_ext_create(pe, &no)) == NULL) {
+                pe->out_of_memory = (bucket == NULL);
+                return 0;
+            }
+            if (!planner_ext_add_run(bucket, no)) {
+                fclose(file);
+                pe->out_of_memory = 1;
+                return 0;
+            }
+        }
+        if (!planner_ext_write(pe, file, h, (BYTE *)(h+1))) {
+            fclose(file);
+            return 0;
+        }
+        last = h;
+    }
+    if (file != NULL && fclose(file) != 0) return 0;
+    pe->batch.top = 0;
+    pe->num_batch = 0;
+    return 1;
+}
+
+/* add the state S with the cost G to the batch. The action is in planner_buf, and the
+   state is packed after it, so the action is moved to the end of the record. The parent
+   is the current record of the layer that is being expanded, unless cost is -1. */
+static int planner_ext_add(PlannerExternalPtr pe, BPLONG S, BPLONG g, BPLONG cost, BPLONG action_len) {
+    PlannerExtHeader *h;
+    BPLONG off, len;
+    BPLONG *ptr;
+
+    off = pe->batch.top;
+    if (!planner_pool_reserve(&pe->batch, sizeof(PlannerExtHeader)+action_len)) return 0;
+    memcpy(pe->batch.bytes+off+sizeof(PlannerExtHeader), planner_buf.bytes, action_len);
+    if (!planner_pack(S)) return 0;
+    len = sizeof(PlannerExtHeader)+planner_buf.top+action_len;
+    len = (len+7) & ~(BPLONG)7;
+    if (!planner_pool_reserve(&pe->batch, len)) return 0;
+    memmove(pe->batch.bytes+off+sizeof(PlannerExtHeader)+planner_buf.top,
+            pe->batch.bytes+off+sizeof(PlannerExtHeader), action_len);
+    memcpy(pe->batch.bytes+off+sizeof(PlannerExtHeader), planner_buf.bytes, planner_buf.top);
+    h = (PlannerExtHeader *)(pe->batch.bytes+off);
+    h->fp = planner_fingerprint(planner_buf.bytes, planner_buf.top);
+    h->parent_pos = (cost < 0) ? 0 : (unsigned long long)pe->current.record_pos;
+    h->state_len = (UW32)planner_buf.top;
+    h->action_len = (UW32)action_len;
+    h->g = (int)g;
+    h->parent_layer = (cost < 0) ? -1 : (int)(pe->num_layers-1);
+    if (pe->num_batch == pe->batch_offs_capacity) {
+        BPLONG new_capacity = (pe->batch_offs_capacity == 0) ? 1024 : 2*pe->batch_offs_capacity;
+        ptr = (BPLONG *)realloc(pe->batch_offs, new_capacity*sizeof(BPLONG));
+        if (ptr == NULL) return 0;
+        pe->batch_offs = ptr;
+        pe->batch_offs_capacity = new_capacity;
+    }
+    pe->batch_offs[pe->num_batch++] = off;
+    pe->batch.top = off+len;
+    return 1;
+}
+
+static int planner_ext_reader_less(PlannerExtReader *r1, PlannerExtReader *r2) {
+    return planner_ext_compare(&r1->header, r1->bytes, &r2->header, r2->bytes) < 0;
+}
+
+/* Merge the runs into the file out, leaving out duplicates. If visited is not NULL, the
+   states in the visited file are left out too, and the merge of the visited file and the
+   result is written to new_visited. Return the number of records written to out, or -1. */
+static BPLONG planner_ext_merge(PlannerExternalPtr pe, BPLONG *runs, BPLONG num_runs,
+                                PlannerExtReader *visited, FILE *out, FILE *new_visited) {
+    PlannerExtReader *readers, *r;
+    PlannerExtReader **heap;
+    PlannerPool last = {NULL, 0, 0};
+    PlannerExtHeader last_header;
+    BPLONG i, n, child, count, res;
+    int has_last, c, visited_res;
+
+    readers = (PlannerExtReader *)calloc(num_runs, sizeof(PlannerExtReader));
+    heap = (PlannerExtReader **)calloc(num_runs, sizeof(PlannerExtReader *));
+    count = -1;
+    if (readers == NULL || heap == NULL) {
+        pe->out_of_memory = 1;
+        goto done;
+    }
+    n = 0;
+    for (i = 0; i < num_runs; i++) {
+        if (!planner_ext_open(pe, readers+i, runs[i])) goto done;
+        res = planner_ext_read(readers+i);
+        if (res < 0) {
+            pe->out_of_memory = 1;
+            goto done;
+        }
+        if (res == 0) continue;
+        r = readers+i;  /* sift up */
+        child = n++;
+        while (child > 0 && planner_ext_reader_less(r, heap[(child-1)/2])) {
+            heap[child] = heap[(child-1)/2];
+            child = (child-1)/2;
+        }
+        heap[child] = r;
+    }
+    visited_res = (visited == NULL) ? 0 : planner_ext_read(visited);
+    count = 0;
+    has_last = 0;
+    while (n > 0) {
+        r = heap[0];
+        if (!has_last || planner_ext_compare(&last_header, last.bytes, &r->header, r->bytes) != 0) {
+            c = 1;
+            while (visited_res > 0 &&
+                   (c = planner_ext_compare(&visited->header, visited->bytes, &r->header, r->bytes)) < 0) {
+                if (!planner_ext_write(pe, new_visited, &visited->header, visited->bytes)) goto failed;
+                visited_res = planner_ext_read(visited);
+            }
+            if (visited_res <= 0) c = 1;
+            if (c != 0) {
+                if (!planner_ext_write(pe, out, &r->header, r->bytes) ||
+                    (new_visited != NULL && !planner_ext_write_visited(pe, new_visited, &r->header, r->bytes))) goto failed;
+                count++;
+            }
+            last.top = 0;
+            if (!planner_pool_reserve(&last, r->header.state_len)) {
+                pe->out_of_memory = 1;
+                goto failed;
+            }
+            memcpy(last.bytes, r->bytes, r->header.state_len);
+            last_header = r->header;
+            has_last = 1;
+        }
+        res = planner_ext_read(r);
+        if (res < 0) {
+            pe->out_of_memory = 1;
+            goto failed;
+        }
+        if (res == 0) r = heap[--n];
+        i = 0;  /* sift down */
+        while ((child = 2*i+1) < n) {
+            if (child+1 < n && planner_ext_reader_less(heap[child+1], heap[child])) child++;
+            if (!planner_ext_reader_less(heap[child], r)) break;
+            heap[i] = heap[child];
+            i = child;
+        }
+        if (n > 0) heap[i] = r;
+    }
+    while (visited_res > 0) {
+        if (!planner_ext_write(pe, new_visited, &visited->header, visited->bytes)) goto failed;
+        visited_res = planner_ext_read(visited);
+    }
+    if (visited_res < 0) {
+        pe->out_of_memory = 1;
+        goto failed;
+    }
+    goto done;
+failed:
+    count = -1;
+done:
+    if (readers != NULL) {
+        for (i = 0; i < num_runs; i++) {
+            planner_ext_close(readers+i);
+            free(readers[i].bytes);
+        }
+    }
+    free(readers);
+    free(heap);
+    free(last.bytes);
+    return count;
+}
+
+/* merge the runs of the bucket until at most PLANNER_EXT_MAX_RUNS are left */
+static int planner_ext_reduce_runs(PlannerExternalPtr pe, PlannerExtBucket *bucket) {
+    BPLONG i, no;
+    FILE *out;
+
+    while (bucket->num_runs > PLANNER_EXT_MAX_RUNS) {
+        out = planner_ext_create(pe, &no);
+        if (out == NULL) return 0;
+        if (planner_ext_merge(pe, bucket->runs, PLANNER_EXT_MAX_RUNS, NULL, out, NULL) < 0) {
+            fclose(out);
+            return 0;
+        }
+        if (fclose(out) != 0) return 0;
+        for (i = 0; i < PLANNER_EXT_MAX_RUNS; i++) planner_ext_remove(pe, bucket->runs[i]);
+        memmove(bucket->runs, bucket->runs+PLANNER_EXT_MAX_RUNS, (bucket->num_runs-PLANNER_EXT_MAX_RUNS)*sizeof(BPLONG));
+        bucket->num_runs -= PLANNER_EXT_MAX_RUNS;
+        if (!planner_ext_add_run(bucket, no)) {
+            pe->out_of_memory = 1;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Make the runs of the cheapest bucket a new layer, and start reading it. Return 1 if a
+   layer has been made, 0 if no state is left, and -1 if a file or the memory fails. */
+static int planner_ext_next_layer(PlannerExternalPtr pe) {
+    BPLONG i, min, layer_no, visited_no, count;
+    FILE *out, *new_visited;
+    PlannerExtBucket bucket;
+    PlannerExtReader visited = {NULL};
+    PlannerExtLayer *ptr;
+
+    planner_ext_close(&pe->current);
+    if (!planner_ext_flush(pe)) return -1;
+    for (;;) {
+        if (pe->num_buckets == 0) return 0;
+        min = 0;
+        for (i = 1; i < pe->num_buckets; i++) {
+            if (pe->buckets[i].g < pe->buckets[min].g) min = i;
+        }
+        bucket = pe->buckets[min];
+        pe->buckets[min] = pe->buckets[--pe->num_buckets];
+        if (!planner_ext_reduce_runs(pe, &bucket)) goto failed;
+        out = planner_ext_create(pe, &layer_no);
+        if (out == NULL) goto failed;
+        new_visited = planner_ext_create(pe, &visited_no);
+        if (new_visited == NULL) {
+            fclose(out);
+            goto failed;
+        }
+        if (pe->visited_no >= 0 && !planner_ext_open(pe, &visited, pe->visited_no)) {
+            fclose(out);
+            fclose(new_visited);
+            goto failed;
+        }
+        count = planner_ext_merge(pe, bucket.runs, bucket.num_runs, (pe->visited_no >= 0) ? &visited : NULL, out, new_visited);
+        planner_ext_close(&visited);
+        if (fclose(out) != 0) count = -1;
+        if (fclose(new_visited) != 0) count = -1;
+        if (count < 0) goto failed;
+        for (i = 0; i < bucket.num_runs; i++) planner_ext_remove(pe, bucket.runs[i]);
+        free(bucket.runs);
+        if (pe->visited_no >= 0) planner_ext_remove(pe, pe->visited_no);
+        pe->visited_no = visited_no;
+        if (count == 0) {
+            planner_ext_remove(pe, layer_no);
+            continue;
+        }
+        if (pe->num_layers == pe->layers_capacity) {
+            BPLONG new_capacity = (pe->layers_capacity == 0) ? 64 : 2*pe->layers_capacity;
+            ptr = (PlannerExtLayer *)realloc(pe->layers, new_capacity*sizeof(PlannerExtLayer));
+            if (ptr == NULL) {
+                pe->out_of_memory = 1;
+                return -1;
+            }
+            pe->layers = ptr;
+            pe->layers_capacity = new_capacity;
+        }
+        pe->layers[pe->num_layers].g = bucket.g;
+        pe->layers[pe->num_layers].file_no = layer_no;
+        pe->num_layers++;
+        pe->num_states += count;
+        pe->current_g = bucket.g;
+        return planner_ext_open(pe, &pe->current, layer_no) ? 1 : -1;
+    }
+failed:
+    free(bucket.runs);
+    return -1;
+}
+
+/* read the record at the position pos of the layer file, keeping the file open for the
+   next record of the same layer. Return 1 if the record has been read, and -1 if a file or
+   the memory fails. */
+static int planner_ext_read_at(PlannerExternalPtr pe, BPLONG layer, BPLONG pos, BPLONG *open_layer, PlannerExtReader *r) {
+    int res;
+
+    if (layer < 0 || layer >= pe->num_layers) return -1;
+    if (*open_layer != layer) {
+        planner_ext_close(r);
+        *open_layer = -1;
+        if (!planner_ext_open(pe, r, pe->layers[layer].file_no)) return -1;
+        *open_layer = layer;
+    }
+    if (fseek(r->file, (long)pos, SEEK_SET) != 0) return -1;
+    r->pos = pos;
+    res = planner_ext_read(r);
+    if (res < 0) pe->out_of_memory = 1;
+    return (res > 0) ? 1 : -1;
+}
+
+static int planner_ext_failed(PlannerExternalPtr pe) {
+    if (pe->out_of_memory) {
+        bp_exception = et_OUT_OF_MEMORY;
+    } else {
+        bp_exception = c_permission_error(et_OUTPUT, et_SOURCE_SINK, pe->dir_atom);
+    }
+    pe->out_of_memory = 0;
+    return BP_ERROR;
+}
+
+static void planner_free_external(PlannerExternalPtr pe) {
+    BPLONG i;
+
+    planner_ext_close(&pe->current);
+    free(pe->current.bytes);
+    for (i = 0; i < pe->next_file_no; i++) planner_ext_remove(pe, i);
+    for (i = 0; i < pe->num_buckets; i++) free(pe->buckets[i].runs);
+    free(pe->buckets);
+    free(pe->layers);
+    free(pe->batch.bytes);
+    free(pe->batch_offs);
+    free(pe->dir);
+    free(pe);
+}
+
+/* the external search whose handle is the term H, or NULL */
+static PlannerExternalPtr planner_external(BPLONG H) {
+    DEREF(H);
+    if (!ISINT(H) || INTVAL(H) < 0 || INTVAL(H) >= num_planner_externals) return NULL;
+    return planner_externals[INTVAL(H)];
+}
+
+/* c_PLANNER_EXTERNAL_NEW_cccf(Dir,BatchSize,S,H): create an external search that keeps its
+   files in the directory Dir, or in the temporary directory if Dir is [], and sorts
+   batches of BatchSize bytes. The initial state is S. Bind H to the handle of the search. */
+int c_PLANNER_EXTERNAL_NEW_cccf() {
+    BPLONG Dir, BatchSize, H, h;
+    CHAR name[MAX_STR_LEN];
+    char *tmp;
+    PlannerExternalPtr pe, *ptr;
+
+    Dir = ARG(1, 4); DEREF(Dir);
+    BatchSize = ARG(2, 4); DEREF(BatchSize);
+    H = ARG(4, 4);
+    if (!ISINT(BatchSize) || INTVAL(BatchSize) <= 0) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    if (ISNIL(Dir)) {
+        tmp = getenv("TMPDIR");
+        if (tmp == NULL) tmp = getenv("TEMP");
+#ifdef WIN32
+        if (tmp == NULL) tmp = ".";
+#else
+        if (tmp == NULL) tmp = "/tmp";
+#endif
+        strncpy(name, tmp, MAX_STR_LEN-1);
+        name[MAX_STR_LEN-1] = '\0';
+    } else {
+        if (check_file_term(Dir) != BP_TRUE) return BP_ERROR;
+        if (ISATOM(Dir)) {
+            namestring(GET_SYM_REC(Dir), name);
+        } else {
+            picat_str_to_c_str(Dir, name, MAX_STR_LEN);
+        }
+    }
+    for (h = 0; h < num_planner_externals; h++) {
+        if (planner_externals[h] == NULL) break;
+    }
+    if (h == num_planner_externals) {
+        ptr = (PlannerExternalPtr *)realloc(planner_externals, (num_planner_externals+1)*sizeof(PlannerExternalPtr));
+        if (ptr == NULL) {
+            bp_exception = et_OUT_OF_MEMORY;
+            return BP_ERROR;
+        }
+        planner_externals = ptr;
+        planner_externals[num_planner_externals++] = NULL;
+    }
+    pe = (PlannerExternalPtr)calloc(1, sizeof(PlannerExternal));
+    if (pe == NULL || (pe->dir = (char *)malloc(strlen(name)+1)) == NULL) {
+        free(pe);
+        bp_exception = et_OUT_OF_MEMORY;
+        return BP_ERROR;
+    }
+    strcpy(pe->dir, name);
+    pe->dir_atom = ADDTAG(insert_sym(name, strlen(name), 0), ATM);
+    pe->id = h;
+    pe->batch_size = INTVAL(BatchSize);
+    pe->visited_no = -1;
+    planner_externals[h] = pe;
+    if (!planner_ext_add(pe, ARG(3, 4), 0, -1, 0)) {
+        pe->out_of_memory = 1;
+        planner_externals[h] = NULL;
+        planner_ext_failed(pe);
+        planner_free_external(pe);
+        return BP_ERROR;
+    }
+    if (!planner_ext_flush(pe)) {  /* find out now whether the files can be written */
+        planner_externals[h] = NULL;
+        planner_ext_failed(pe);
+        planner_free_external(pe);
+        return BP_ERROR;
+    }
+    return unify(H, MAKEINT(h));
+}
+
+/* c_PLANNER_EXTERNAL_FREE_c(H): remove the files of the search, and free it */
+int c_PLANNER_EXTERNAL_FREE_c() {
+    BPLONG H;
+    PlannerExternalPtr pe;
+
+    H = ARG(1, 1);
+    pe = planner_external(H);
+    if (pe == NULL) return BP_TRUE;
+    DEREF(H);
+    planner_externals[INTVAL(H)] = NULL;
+    planner_free_external(pe);
+    return BP_TRUE;
+}
+
+/* c_PLANNER_EXTERNAL_LAYER_cf(H,G): make the next layer, and bind G to its cost. Fail if no
+   state is left. */
+int c_PLANNER_EXTERNAL_LAYER_cf() {
+    PlannerExternalPtr pe;
+    int res;
+
+    pe = planner_external(ARG(1, 2));
+    if (pe == NULL) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    res = planner_ext_next_layer(pe);
+    if (res < 0) return planner_ext_failed(pe);
+    if (res == 0) return BP_FALSE;
+    return unify(ARG(2, 2), MAKEINT(pe->current_g));
+}
+
+/* c_PLANNER_EXTERNAL_NEXT_cf(H,S): bind S to the next state of the layer. Fail at the end
+   of the layer. */
+int c_PLANNER_EXTERNAL_NEXT_cf() {
+    PlannerExternalPtr pe;
+    int res;
+
+    pe = planner_external(ARG(1, 2));
+    if (pe == NULL) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    if (pe->current.file == NULL) return BP_FALSE;
+    res = planner_ext_read(&pe->current);
+    if (res < 0) {
+        pe->out_of_memory = 1;
+        return planner_ext_failed(pe);
+    }
+    if (res == 0) {
+        planner_ext_close(&pe->current);
+        return BP_FALSE;
+    }
+    if (local_top-heap_top <= 2*(BPLONG)pe->current.header.state_len+LARGE_MARGIN) {
+        bp_exception = et_OUT_OF_MEMORY_STACK;
+        return BP_ERROR;
+    }
+    return unify(ARG(2, 2), planner_unpack(pe->current.bytes));
+}
+
+/* c_PLANNER_EXTERNAL_ADD_cccc(H,S,Action,Cost): add the state S, which is reached by
+   taking Action of cost Cost in the last state of the layer */
+int c_PLANNER_EXTERNAL_ADD_cccc() {
+    BPLONG Cost;
+    PlannerExternalPtr pe;
+
+    pe = planner_external(ARG(1, 4));
+    Cost = ARG(4, 4); DEREF(Cost);
+    if (pe == NULL || pe->current.file == NULL || !ISINT(Cost) || INTVAL(Cost) < 0 ||
+        pe->current_g+INTVAL(Cost) > PLANNER_NO_BOUND) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    if (!planner_pack(ARG(3, 4)) ||
+        !planner_ext_add(pe, ARG(2, 4), pe->current_g+INTVAL(Cost), INTVAL(Cost), planner_buf.top)) {
+        pe->out_of_memory = 1;
+        return planner_ext_failed(pe);
+    }
+    if (pe->batch.top >= pe->batch_size && !planner_ext_flush(pe)) return planner_ext_failed(pe);
+    return BP_TRUE;
+}
+
+/* c_PLANNER_EXTERNAL_PLAN_cf(H,Plan): bind Plan to the actions on the path to the last
+   state of the layer */
+int c_PLANNER_EXTERNAL_PLAN_cf() {
+    BPLONG plan, i, size, num_actions;
+    BPLONG_PTR ptr;
+    PlannerPool actions = {NULL, 0, 0};
+    BPLONG *offs = NULL;
+    PlannerExtReader r = {NULL};
+    PlannerExtHeader header;
+    PlannerExternalPtr pe;
+    BPLONG open_layer;
+    int res;
+
+    pe = planner_external(ARG(1, 2));
+    if (pe == NULL || pe->current.file == NULL) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    /* the actions are collected from the last one, each preceded by its length */
+    header = pe->current.header;
+    res = 1;
+    num_actions = 0;
+    open_layer = -1;
+    while (header.parent_layer >= 0) {
+        if (!planner_pool_reserve(&actions, sizeof(BPLONG)+header.action_len)) {
+            res = -1;
+            pe->out_of_memory = 1;
+            break;
+        }
+        memcpy(actions.bytes+actions.top, &header.action_len, sizeof(UW32));
+        memcpy(actions.bytes+actions.top+sizeof(BPLONG),
+               ((num_actions == 0) ? pe->current.bytes : r.bytes)+header.state_len, header.action_len);
+        actions.top += sizeof(BPLONG)+header.action_len;
+        num_actions++;
+        res = planner_ext_read_at(pe, header.parent_layer, (BPLONG)header.parent_pos, &open_layer, &r);
+        if (res < 0) break;
+        header = r.header;
+    }
+    planner_ext_close(&r);
+    free(r.bytes);
+    if (res < 0) {
+        free(actions.bytes);
+        return planner_ext_failed(pe);
+    }
+    offs = (BPLONG *)malloc((num_actions+1)*sizeof(BPLONG));
+    if (offs == NULL) {
+        free(actions.bytes);
+        bp_exception = et_OUT_OF_MEMORY;
+        return BP_ERROR;
+    }
+    for (i = 0, size = 0; i < num_actions; i++) {
+        UW32 len;
+        offs[i] = size;
+        memcpy(&len, actions.bytes+size, sizeof(UW32));
+        size += sizeof(BPLONG)+len;
+    }
+    if (local_top-heap_top <= 2*actions.top+LARGE_MARGIN) {
+        free(actions.bytes);
+        free(offs);
+        bp_exception = et_OUT_OF_MEMORY_STACK;
+        return BP_ERROR;
+    }
+    plan = nil_sym;
+    for (i = 0; i < num_actions; i++) {  /* the last action is added first */
+        ptr = heap_top;
+        heap_top += 2;
+        FOLLOW(ptr+1) = plan;
+        FOLLOW(ptr) = planner_unpack(actions.bytes+offs[i]+sizeof(BPLONG));
+        plan = ADDTAG(ptr, LST);
+    }
+    free(actions.bytes);
+    free(offs);
+    return unify(ARG(2, 2), plan);
+}
+
+/* c_PLANNER_EXTERNAL_STATISTICS_cf(H,Stats): bind Stats to the list [states=N,layers=L,
+   runs=R,batch_bytes=BB,bytes_written=BW] */
+int c_PLANNER_EXTERNAL_STATISTICS_cf() {
+    static const char *names[5] = {"states", "layers", "runs", "batch_bytes", "bytes_written"};
+    BPLONG Stats, list, i;
+    BPLONG vals[5];
+    BPLONG_PTR ptr;
+    SYM_REC_PTR eq_sym_ptr;
+    PlannerExternalPtr pe;
+
+    pe = planner_external(ARG(1, 2));
+    Stats = ARG(2, 2);
+    if (pe == NULL) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    if (local_top-heap_top <= LARGE_MARGIN) {
+        bp_exception = et_OUT_OF_MEMORY_STACK;
+        return BP_ERROR;
+    }
+    vals[0] = pe->num_states;
+    vals[1] = pe->num_layers;
+    vals[2] = 0;
+    for (i = 0; i < pe->num_buckets; i++) vals[2] += pe->buckets[i].num_runs;
+    vals[3] = pe->batch.top;
+    vals[4] = pe->bytes_written;
+    eq_sym_ptr = insert_sym("=", 1, 2);
+    list = nil_sym;
+    for (i = 4; i >= 0; i--) {
+        ptr = heap_top;
+        heap_top += 5;
+        FOLLOW(ptr) = (BPLONG)eq_sym_ptr;
+        FOLLOW(ptr+1) = ADDTAG(insert_sym(names[i], strlen(names[i]), 0), ATM);
+        FOLLOW(ptr+2) = MAKEINT(vals[i]);
+        FOLLOW(ptr+3) = ADDTAG(ptr, STR);
+        FOLLOW(ptr+4) = list;
+        list = ADDTAG(ptr+3, LST);
+    }
+    return unify(Stats, list);
+}
@@ -8,14 +8,35 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.
  ********************************************************************/
 #include <stdlib.h>
+#include <string.h>
 #include "basic.h"
 #include "term.h"
 #include "bapi.h"
 #include "frame.h"
 #include "inst.h"
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 extern BPLONG table_allocate_code;
 void init_picat_table_maps();
+void release_picat_table_maps();
+static int incremental_tabling = 0;  /* see INCREMENTAL TABLING below */
+static BPLONG_PTR table_store = NULL;  /* the mapped table store, see SHARED TABLE STORE below */
+#define SYM_IS_SHARED(sym_ptr) (GET_FLAGS(sym_ptr) & SYM_SHARED)
+static void note_tabled_call(BPLONG_PTR subgoal_entry);
+static void reset_incremental_tabling();
+static void reset_semi_naive_tabling();
+static BPLONG_PTR findNumberedSubgoal(BPLONG_PTR stack_arg_ptr, int arity, SYM_REC_PTR sym_ptr, int nt_last_arg);
+static void publish_shared_subgoal(BPLONG_PTR subgoal_entry);
+static int import_shared_subgoal(BPLONG_PTR subgoal_entry);
+static void table_profile_lookup(int found);
+static void reset_table_profile();
 
 #define AllocateCellFromTableArea(ptr) {                                \
         if (table_free_cells_ptr != NULL) {                             \
@@ -38,6 +59,8 @@ static BPLONG_PTR table_free_cells_ptr = NULL;
 */
 NUMBERED_TERM_AREA_RECORD ta_record;  /* table area record that holds the pointers */
 NUMBERED_TERM_AREA_RECORD_PTR ta_record_ptr;
+#define TABLE_AREA_GC_MIN_BLOCKS 4
+BPLONG table_area_gc_limit = TABLE_AREA_GC_MIN_BLOCKS;  /* the collector runs when ta_record_ptr->num_expansions reaches it */
 
 BPLONG_PTR picat_table_maps[NUM_PICAT_TABLE_MAPS];
 BPLONG picat_table_map_ids[NUM_PICAT_TABLE_MAPS];
@@ -125,7 +148,11 @@ int c_INITIALIZE_TABLE(){
 
 #ifdef NOTABLE
 #else
+    reset_table_profile();
     init_subgoal_table();
+    reset_incremental_tabling();
+    reset_semi_naive_tabling();
+    release_picat_table_maps();
     /* release the table blocks except the first one */
     low_addr = ta_record_ptr->low_addr;
     prev_low_addr = (BPLONG_PTR)FOLLOW(low_addr);
@@ -138,6 +165,7 @@ int c_INITIALIZE_TABLE(){
     ta_record_ptr->top = ta_record_ptr->low_addr+1;
     ta_record_ptr->up_addr = ta_record_ptr->low_addr+NUMBERED_TERM_BLOCK_SIZE;
     ta_record_ptr->num_expansions = 0;
+    table_area_gc_limit = TABLE_AREA_GC_MIN_BLOCKS;
 
     init_gterms_htable(ta_gterms_htable_ptr);
     table_free_cells_ptr = NULL;
@@ -392,6 +420,23 @@ void expandSubgoalTable() {
     subgoalTable = new_htable;
 }
 
+/* Comparing a call with the subgoals in place saves copying it when a variant is found,
+   but costs an extra pass over the call when none is. A copy of a ground call that finds
+   its subgoal is cheap, because its subterms are found in gterms_htable and the space is
+   given back, but a copy of a call with variables cannot be given back. A score per
+   predicate, kept in a small direct-mapped array, counts the recent calls with variables
+   that found their subgoals minus the other calls. The calls of a predicate with a
+   negative score are copied directly, except for every SUBGOAL_PROBE_SAMPLE-th call, so
+   that a change is noticed. */
+#define SUBGOAL_PROBE_SLOTS 256
+#define SUBGOAL_PROBE_SAMPLE 16
+#define SUBGOAL_PROBE_MAX_SCORE 16
+#define SUBGOAL_PROBE_SLOT(sym_ptr) ((((BPULONG)(sym_ptr)) >> 4) % SUBGOAL_PROBE_SLOTS)
+#define SUBGOAL_PROBE_FOUND(score_ptr) {if (*(score_ptr) < SUBGOAL_PROBE_MAX_SCORE) (*(score_ptr))++;}
+#define SUBGOAL_PROBE_MISSED(score_ptr) {if (*(score_ptr) > -SUBGOAL_PROBE_MAX_SCORE) (*(score_ptr))--;}
+static signed char subgoal_probe_score[SUBGOAL_PROBE_SLOTS];
+static BPLONG subgoal_probe_count = 0;
+
 BPLONG_PTR lookupSubgoalTable(BPLONG_PTR stack_arg_ptr, int arity, SYM_REC_PTR sym_ptr, int mode_bits, int nt_last_arg) {
     BPLONG_PTR entryPtrPtr0, entryPtr, thisEntryPtr;
     BPLONG_PTR subgoal_arg_ptr, this_subgoal_arg_ptr;
@@ -400,10 +445,39 @@ BPLONG_PTR lookupSubgoalTable(BPLONG_PTR stack_arg_ptr, int arity, SYM_REC_PTR s
     BPLONG_PTR trail_top0, old_table_top;
     BPLONG initial_diff0;
     BPULONG tmp_mode_bits;
+    signed char *probe_score_ptr;
+    int probed, new_shared = 0, found = 1;
     //    void printSubgoalTableEntry();
 
+    if (table_profiling) table_profile_begin(sym_ptr);
     initial_diff0 = (BPULONG)trail_up_addr-(BPULONG)trail_top;
 
+    /* the call is compared with the subgoals in place first, and it is only copied to the
+       table area if it is new, unless the calls of the predicate are mostly new */
+    probe_score_ptr = subgoal_probe_score+SUBGOAL_PROBE_SLOT(sym_ptr);
+    probed = (*probe_score_ptr >= 0 || (++subgoal_probe_count % SUBGOAL_PROBE_SAMPLE) == 0);
+    if (probed) {
+        thisEntryPtr = findNumberedSubgoal(stack_arg_ptr, arity, sym_ptr, nt_last_arg);
+        if (thisEntryPtr != NULL) {
+            if (global_var_num == 0) {  /* a ground call */
+                SUBGOAL_PROBE_MISSED(probe_score_ptr);
+            } else {
+                SUBGOAL_PROBE_FOUND(probe_score_ptr);
+            }
+            /* let the ground arguments refer to their copies in the table area, as a copy would do */
+            arity1 = (nt_last_arg == 0) ? arity : arity-1;
+            subgoal_arg_ptr = GT_ARG_ADDR(thisEntryPtr);
+            for (i = 0; i < arity1; i++) {
+                BPLONG t2 = FOLLOW(subgoal_arg_ptr+i);
+                if (TAG(t2) != ATM && isGroundNumberedTerm(t2)) FOLLOW(stack_arg_ptr-i) = t2;
+            }
+            goto lookup_end;
+        }
+        SUBGOAL_PROBE_MISSED(probe_score_ptr);
+        trail_top0 = (BPLONG_PTR)((BPULONG)trail_up_addr-initial_diff0);
+        UNDO_TRAILING;
+    }
+
     /* before numbering the tabled call */
     PREPARE_NUMBER_TERM(0);
     subgoal_record_size = arity+GT_RECORD_SIZE;
@@ -460,12 +534,22 @@ BPLONG_PTR lookupSubgoalTable(BPLONG_PTR stack_arg_ptr, int arity, SYM_REC_PTR s
         if (ta_record_ptr->top == old_table_top+subgoal_record_size) {
             ta_record_ptr->top = old_table_top;
         }
+        if (!probed) {
+            if (global_var_num == nt_last_arg) {  /* a ground call, except for the ignored last argument */
+                SUBGOAL_PROBE_MISSED(probe_score_ptr);
+            } else {
+                SUBGOAL_PROBE_FOUND(probe_score_ptr);
+            }
+        }
         goto lookup_end;
     lab_fail1:
         entryPtr = (BPLONG_PTR)GT_NEXT(entryPtr);
     }
     /* not found, register the subgoal now */
+    if (!probed) SUBGOAL_PROBE_MISSED(probe_score_ptr);
+    found = 0;
     InitializeSubgoalTableEntry(thisEntryPtr, sym_ptr);
+    if (table_store != NULL && SYM_IS_SHARED(sym_ptr)) new_shared = 1;
     //  SET_SUBGOAL_ANS_REVISED(entryPtr);
     GT_NEXT(thisEntryPtr) = FOLLOW(entryPtrPtr0);
     FOLLOW(entryPtrPtr0) = (BPLONG)thisEntryPtr;
@@ -479,6 +563,9 @@ BPLONG_PTR lookupSubgoalTable(BPLONG_PTR stack_arg_ptr, int arity, SYM_REC_PTR s
 lookup_end:
     trail_top0 = (BPLONG_PTR)((BPULONG)trail_up_addr-initial_diff0);
     UNDO_TRAILING;
+    if (new_shared && import_shared_subgoal(thisEntryPtr) == BP_ERROR) return (BPLONG_PTR)BP_ERROR;
+    if (incremental_tabling) note_tabled_call(thisEntryPtr);
+    if (table_profiling) table_profile_lookup(found);
     //  printf("<=lookup\n");
     return thisEntryPtr;
 }
@@ -578,6 +665,9 @@ BPLONG hashval_of_tabled_subgoal(BPLONG_PTR subgoal_entry) {
     sym_ptr = (SYM_REC_PTR)GT_SYM(subgoal_entry);
     arity = GET_ARITY(sym_ptr);
     table_arg_ptr = GT_ARG_ADDR(subgoal_entry);
+    /* the subgoal was hashed with its last argument ignored, and table_allocate has
+       since stored the resource limit in it */
+    if (sym_ptr == plan_psc) arity--;
 
     hcode_sum = ((BPLONG)sym_ptr & HASH_BITS) >> 2;
     if (arity == 0) return hcode_sum;
@@ -1072,6 +1162,7 @@ void complete_scc_elms(BPLONG_PTR subgoal_entry) {
 
     if (GT_TOP_AR(subgoal_entry) == SUBGOAL_COMPLETE) return;  /* set already */
     GT_TOP_AR(subgoal_entry) = SUBGOAL_COMPLETE;
+    if (table_store != NULL && SYM_IS_SHARED((SYM_REC_PTR)GT_SYM(subgoal_entry))) publish_shared_subgoal(subgoal_entry);
     /* fprintf(curr_out,"COMPLETE:");print_subgoal_entry_only(subgoal_entry);printf("\n"); */
     ptr = (BPLONG_PTR)GT_SCC_ELMS(subgoal_entry);
     while (ptr != NULL) {
@@ -1093,8 +1184,1519 @@ void reset_temp_complete_scc_elms(BPLONG_PTR subgoal_entry) {
         if (entry != NULL && GT_TOP_AR(entry) == SUBGOAL_TEMP_COMPLETE) {
             GT_TOP_AR(entry) = (BPLONG)NULL;
         }
-        ptr = (BPLONG_PTR)FOLLOW(ptr+1);
+        ptr = (BPLONG_PTR)FOLLOW(ptr+1);
+    }
+}
+
+/* an open-addressing map from addresses to addresses, with NULL for a missing key */
+typedef struct {
+    BPLONG_PTR *keys;
+    BPLONG_PTR *vals;
+    BPULONG mask;
+    BPLONG count;
+} TABLE_ADDR_MAP;
+
+static void table_addr_map_init(TABLE_ADDR_MAP *map, BPLONG size) {
+    map->keys = (BPLONG_PTR *)calloc(size, sizeof(BPLONG_PTR));
+    map->vals = (BPLONG_PTR *)malloc(size*sizeof(BPLONG_PTR));
+    if (map->keys == NULL || map->vals == NULL) {
+        myquit(OUT_OF_MEMORY, "ta");
+    }
+    map->mask = size-1;
+    map->count = 0;
+}
+
+static void table_addr_map_free(TABLE_ADDR_MAP *map) {
+    free(map->keys);
+    free(map->vals);
+    map->keys = map->vals = NULL;
+}
+
+#define TABLE_ADDR_HASH(ptr, mask) ((((BPULONG)(ptr) >> 3) * 2654435761UL) & (mask))
+
+static BPLONG_PTR table_addr_map_get(TABLE_ADDR_MAP *map, BPLONG_PTR key) {
+    BPULONG i;
+
+    if (map->keys == NULL) return NULL;
+    i = TABLE_ADDR_HASH(key, map->mask);
+    while (map->keys[i] != NULL) {
+        if (map->keys[i] == key) return map->vals[i];
+        i = (i+1) & map->mask;
+    }
+    return NULL;
+}
+
+static void table_addr_map_put(TABLE_ADDR_MAP *map, BPLONG_PTR key, BPLONG_PTR val) {
+    BPULONG i;
+
+    if (map->keys == NULL) table_addr_map_init(map, 256);
+    if (2*(map->count+1) > (BPLONG)map->mask) {  /* double the size */
+        TABLE_ADDR_MAP old_map = *map;
+        BPULONG j;
+
+        table_addr_map_init(map, 2*(old_map.mask+1));
+        for (j = 0; j <= old_map.mask; j++) {
+            if (old_map.keys[j] != NULL) table_addr_map_put(map, old_map.keys[j], old_map.vals[j]);
+        }
+        table_addr_map_free(&old_map);
+    }
+    i = TABLE_ADDR_HASH(key, map->mask);
+    while (map->keys[i] != NULL) {
+        if (map->keys[i] == key) {
+            map->vals[i] = val;
+            return;
+        }
+        i = (i+1) & map->mask;
+    }
+    map->keys[i] = key;
+    map->vals[i] = val;
+    map->count++;
+}
+
+/******************* INCREMENTAL TABLING ********************/
+/* Incremental tabling is in use once a dynamic predicate has been declared
+   incremental. From then on, a tabled call records its caller in the dependents
+   list of the subgoal it looks up, and a call to an incremental predicate
+   records its caller in the table_dependents list of the predicate. The caller
+   of a call is the subgoal of the nearest table frame on the chain of parent
+   frames. When an incremental predicate is changed, the subgoals on its list and,
+   through the dependents lists, all of the subgoals that used their answers are
+   removed from the subgoal table, so that their next calls evaluate them again.
+   Subgoals that were evaluated before incremental tabling was in use have no
+   dependents recorded. */
+
+/* The dependents list of a subgoal is a list of cells [subgoal,next] of the
+   subgoals that used its answers. The lists are kept in subgoal_dependents,
+   keyed by the subgoal entry, so only the subgoals that have dependents take
+   space. */
+static TABLE_ADDR_MAP subgoal_dependents;
+
+#define SUBGOAL_DEPENDENTS(subgoal_entry) table_addr_map_get(&subgoal_dependents, subgoal_entry)
+#define SET_SUBGOAL_DEPENDENTS(subgoal_entry, list_ptr) table_addr_map_put(&subgoal_dependents, subgoal_entry, list_ptr)
+
+static InterpretedPredPtr *incremental_preds = NULL;
+static BPLONG num_incremental_preds = 0;
+static BPLONG incremental_preds_capacity = 0;
+
+/* removed subgoals whose answer tables could not be freed because a frame
+   still referenced them */
+static BPLONG_PTR *retired_subgoals = NULL;
+static BPLONG num_retired_subgoals = 0;
+static BPLONG retired_subgoals_capacity = 0;
+
+/* the nearest tabled ancestor of the frame fp, or NULL */
+static BPLONG_PTR tabled_ancestor_frame(BPLONG_PTR fp) {
+    while (!IS_TABLE_FRAME(fp)) {
+        if (AR_AR(fp) == (BPLONG)fp) return NULL;
+        fp = (BPLONG_PTR)AR_AR(fp);
+    }
+    return fp;
+}
+
+/* the subgoal of the nearest tabled ancestor of the frame fp, or NULL */
+static BPLONG_PTR tabled_ancestor_subgoal(BPLONG_PTR fp) {
+    fp = tabled_ancestor_frame(fp);
+    return (fp == NULL) ? NULL : (BPLONG_PTR)GET_AR_SUBGOAL_TABLE(fp);
+}
+
+/* add subgoal_entry to the list of cells list, unless it is on the list already,
+   and return the list */
+static BPLONG_PTR add_table_dependent(BPLONG_PTR list, BPLONG_PTR subgoal_entry) {
+    BPLONG_PTR list_ptr;
+
+    for (list_ptr = list; list_ptr != NULL; list_ptr = (BPLONG_PTR)FOLLOW(list_ptr+1)) {
+        if ((BPLONG_PTR)FOLLOW(list_ptr) == subgoal_entry) return list;
+    }
+    AllocateCellFromTableArea(list_ptr);
+    if (list_ptr == NULL) {
+        myquit(OUT_OF_MEMORY, "ta");
+    }
+    FOLLOW(list_ptr) = (BPLONG)subgoal_entry;
+    FOLLOW(list_ptr+1) = (BPLONG)list;
+    return list_ptr;
+}
+
+static void add_subgoal_dependent(BPLONG_PTR subgoal_entry, BPLONG_PTR dependent) {
+    BPLONG_PTR list, new_list;
+
+    list = SUBGOAL_DEPENDENTS(subgoal_entry);
+    new_list = add_table_dependent(list, dependent);
+    if (new_list != list) SET_SUBGOAL_DEPENDENTS(subgoal_entry, new_list);
+}
+
+/* called when the tabled call in the frame arreg has looked up subgoal_entry */
+static void note_tabled_call(BPLONG_PTR subgoal_entry) {
+    BPLONG_PTR caller;
+
+    caller = tabled_ancestor_subgoal((BPLONG_PTR)AR_AR(arreg));
+    if (caller != NULL && caller != subgoal_entry) {
+        add_subgoal_dependent(subgoal_entry, caller);
+    }
+}
+
+/* called when the incremental predicate is called from the frame arreg */
+void table_note_dynamic_call(InterpretedPredPtr pred_ptr) {
+    BPLONG_PTR caller;
+
+    caller = tabled_ancestor_subgoal(arreg);
+    if (caller != NULL) {
+        pred_ptr->table_dependents = add_table_dependent(pred_ptr->table_dependents, caller);
+    }
+}
+
+/* 1 if execution may still return or backtrack to a table frame of subgoal_entry,
+   or to any table frame if subgoal_entry is NULL. Those are the frames on the
+   chain of parents of ar, the choice points from b, and their parents. A parent
+   that is older than the next choice point is also a parent of that choice
+   point, so each chain is followed only down to the next choice point. */
+static int table_frame_is_live(BPLONG_PTR ar, BPLONG_PTR b, BPLONG_PTR subgoal_entry) {
+    BPLONG_PTR fp = ar;
+
+    while (1) {
+        while (fp < b) {
+            if (IS_TABLE_FRAME(fp) && (subgoal_entry == NULL || (BPLONG_PTR)GET_AR_SUBGOAL_TABLE(fp) == subgoal_entry)) return 1;
+            if (AR_AR(fp) == (BPLONG)fp) return 0;
+            fp = (BPLONG_PTR)AR_AR(fp);
+        }
+        if (IS_TABLE_FRAME(b) && (subgoal_entry == NULL || (BPLONG_PTR)GET_AR_SUBGOAL_TABLE(b) == subgoal_entry)) return 1;
+        if (AR_B(b) == (BPLONG)b) return 0;
+        fp = (BPLONG_PTR)AR_AR(b);
+        b = (BPLONG_PTR)AR_B(b);
+    }
+}
+
+static int subgoal_is_referenced(BPLONG_PTR subgoal_entry) {
+    return table_frame_is_live(arreg, breg, subgoal_entry);
+}
+
+static void free_subgoal_answer_table(BPLONG_PTR subgoal_entry) {
+    BPLONG_PTR answerTable, bucket_ptr;
+
+    answerTable = (BPLONG_PTR)GT_ANSWER_TABLE(subgoal_entry);
+    if (answerTable != NULL && ((BPLONG)answerTable & 0x1) == 0) {
+        bucket_ptr = (BPLONG_PTR)ANSWERTABLE_BUCKET_PTR(answerTable);
+        if (bucket_ptr != NULL) {
+            free(bucket_ptr);
+        }
+        free(answerTable);
+    }
+    GT_ANSWER_TABLE(subgoal_entry) = (BPLONG)NULL;
+}
+
+/* free the answer tables of the retired subgoals that are no longer referenced */
+static void free_retired_subgoals(int all) {
+    BPLONG i, j;
+
+    j = 0;
+    for (i = 0; i < num_retired_subgoals; i++) {
+        if (all || !subgoal_is_referenced(retired_subgoals[i])) {
+            free_subgoal_answer_table(retired_subgoals[i]);
+        } else {
+            retired_subgoals[j++] = retired_subgoals[i];
+        }
+    }
+    num_retired_subgoals = j;
+}
+
+/* the space of a removed subgoal stays in the table area, but its answer table
+   is freed now, or later if a frame references it */
+static void release_removed_subgoal(BPLONG_PTR subgoal_entry) {
+    BPLONG_PTR ptr;
+
+    if (!subgoal_is_referenced(subgoal_entry)) {
+        free_subgoal_answer_table(subgoal_entry);
+        return;
+    }
+    if (num_retired_subgoals == retired_subgoals_capacity) {
+        BPLONG new_capacity = (retired_subgoals_capacity == 0) ? 16 : 2*retired_subgoals_capacity;
+        ptr = (BPLONG_PTR)realloc(retired_subgoals, new_capacity*sizeof(BPLONG_PTR));
+        if (ptr == NULL) return;  /* the answer table is leaked */
+        retired_subgoals = (BPLONG_PTR *)ptr;
+        retired_subgoals_capacity = new_capacity;
+    }
+    retired_subgoals[num_retired_subgoals++] = subgoal_entry;
+}
+
+/* remove subgoal_entry from the subgoal table; return 0 if it is not in the table */
+static int unlink_subgoal_entry(BPLONG_PTR subgoal_entry) {
+    BPLONG_PTR entry_addr;
+
+    if (GT_STATE(subgoal_entry) & SUBGOAL_REMOVED_BIT) return 0;
+    entry_addr = subgoalTable + (hashval_of_tabled_subgoal(subgoal_entry) % subgoalTableBucketSize);
+    while ((BPLONG_PTR)FOLLOW(entry_addr) != NULL) {
+        if ((BPLONG_PTR)FOLLOW(entry_addr) == subgoal_entry) goto found;
+        entry_addr = GT_NEXT_ADDR(FOLLOW(entry_addr));
+    }
+    return 0;
+found:
+    FOLLOW(entry_addr) = GT_NEXT(subgoal_entry);
+    subgoalTableEntriesCount--;
+    GT_STATE(subgoal_entry) |= SUBGOAL_REMOVED_BIT;
+    return 1;
+}
+
+/* remove the subgoals on the list of cells, and the subgoals that depend on them */
+static void invalidate_subgoals(BPLONG_PTR list_ptr) {
+    BPLONG_PTR subgoal_entry, deps, tail, next_ptr;
+
+    while (list_ptr != NULL) {
+        subgoal_entry = (BPLONG_PTR)FOLLOW(list_ptr);
+        next_ptr = (BPLONG_PTR)FOLLOW(list_ptr+1);
+        TABLE_FREE_CELL(list_ptr);
+        list_ptr = next_ptr;
+        deps = SUBGOAL_DEPENDENTS(subgoal_entry);
+        if (deps != NULL) {  /* push the dependents */
+            SET_SUBGOAL_DEPENDENTS(subgoal_entry, NULL);
+            tail = deps;
+            while ((BPLONG_PTR)FOLLOW(tail+1) != NULL) tail = (BPLONG_PTR)FOLLOW(tail+1);
+            FOLLOW(tail+1) = (BPLONG)list_ptr;
+            list_ptr = deps;
+        }
+        /* a subgoal that was removed by abolish_table keeps its dependents */
+        if (unlink_subgoal_entry(subgoal_entry)) release_removed_subgoal(subgoal_entry);
+    }
+}
+
+/* called before the incremental predicate is changed */
+void invalidate_table_dependents(InterpretedPredPtr pred_ptr) {
+    BPLONG_PTR list_ptr;
+
+    list_ptr = pred_ptr->table_dependents;
+    pred_ptr->table_dependents = NULL;
+    free_retired_subgoals(0);
+    invalidate_subgoals(list_ptr);
+}
+
+/* forget the dependents when the table area is initialized */
+static void reset_incremental_tabling() {
+    BPLONG i;
+
+    for (i = 0; i < num_incremental_preds; i++) {
+        incremental_preds[i]->table_dependents = NULL;
+    }
+    table_addr_map_free(&subgoal_dependents);
+    free_retired_subgoals(1);
+}
+
+int register_incremental_pred(InterpretedPredPtr pred_ptr) {
+    InterpretedPredPtr *ptr;
+
+    if (pred_ptr->incremental) return BP_TRUE;
+    if (num_incremental_preds == incremental_preds_capacity) {
+        BPLONG new_capacity = (incremental_preds_capacity == 0) ? 16 : 2*incremental_preds_capacity;
+        ptr = (InterpretedPredPtr *)realloc(incremental_preds, new_capacity*sizeof(InterpretedPredPtr));
+        if (ptr == NULL) {
+            bp_exception = et_OUT_OF_MEMORY;
+            return BP_ERROR;
+        }
+        incremental_preds = ptr;
+        incremental_preds_capacity = new_capacity;
+    }
+    incremental_preds[num_incremental_preds++] = pred_ptr;
+    pred_ptr->incremental = 1;
+    incremental_tabling = 1;
+    return BP_TRUE;
+}
+
+/* c_ABOLISH_TABLE_cc(F,N): remove the subgoals of the tabled predicate F/N. A removed
+   subgoal keeps its dependents list, because incremental predicates may still refer
+   to it. */
+int c_ABOLISH_TABLE_cc() {
+    BPLONG f, n, i;
+    SYM_REC_PTR sym_ptr;
+    BPLONG_PTR entry_addr, subgoal_entry;
+
+    f = ARG(1, 2); DEREF(f);
+    n = ARG(2, 2); DEREF(n);
+    if (!ISATOM(f) || !ISINT(n)) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    GET_GLOBAL_SYM(f, n, sym_ptr);
+    free_retired_subgoals(0);
+    for (i = 0; i < subgoalTableBucketSize; i++) {
+        entry_addr = subgoalTable+i;
+        while ((subgoal_entry = (BPLONG_PTR)FOLLOW(entry_addr)) != NULL) {
+            if ((SYM_REC_PTR)GT_SYM(subgoal_entry) != sym_ptr) {
+                entry_addr = GT_NEXT_ADDR(subgoal_entry);
+                continue;
+            }
+            FOLLOW(entry_addr) = GT_NEXT(subgoal_entry);
+            subgoalTableEntriesCount--;
+            GT_STATE(subgoal_entry) |= SUBGOAL_REMOVED_BIT;
+            release_removed_subgoal(subgoal_entry);
+        }
+    }
+    return BP_TRUE;
+}
+
+/******************* SEMI-NAIVE EVALUATION ********************/
+/* A looping SCC is evaluated repeatedly until no answer is added or revised.
+   When a subgoal of a semi-naive predicate is evaluated again, a call it makes
+   to a subgoal that is not complete consumes only the answers that were added
+   after the same call was made in the previous evaluation. The older answers
+   were consumed by that call.
+
+   This is sound if a clause, together with the non-tabled predicates it calls,
+   makes at most one call to a subgoal that is not complete, as in left- or
+   right-linear transitive closure programs, and if the non-tabled parts of the
+   clauses give the same results in every evaluation and do not cut away answers.
+   When a call is made while the table frame of an earlier call to a subgoal that
+   is not complete can still be backtracked to, the first condition does not hold,
+   so the predicate falls back to the normal evaluation, and the caller is marked
+   revised so that its SCC is evaluated again. Mode-directed predicates, whose
+   answers are revised in place, and library predicates are never semi-naive.
+
+   Answers are added to the end of an answer table, so the answers that a call
+   has seen are given by a mark, the last answer when the call was made. For
+   each subgoal of a semi-naive predicate, semi_naive_marks holds a list of
+   records [callee,prev_mark,mark,next], one for each subgoal that is not complete
+   that it has called. The mark is taken by the first such call in the current
+   evaluation, and prev_mark is the mark of the previous evaluation. A table frame
+   stores the answer after which it starts to consume in AR_ANSWER_MARK. */
+int semi_naive_tabling = 0;  /* the number of semi-naive predicates */
+static TABLE_ADDR_MAP semi_naive_marks;
+
+#define SN_CALLEE(rec) FOLLOW((BPLONG_PTR)(rec))
+#define SN_PREV_MARK(rec) FOLLOW((BPLONG_PTR)(rec)+1)
+#define SN_MARK(rec) FOLLOW((BPLONG_PTR)(rec)+2)
+#define SN_NEXT(rec) FOLLOW((BPLONG_PTR)(rec)+3)
+#define SN_RECORD_SIZE 4
+#define SN_NO_MARK ((BPLONG)0x1L)  /* no call has been made; NULL marks an empty answer table */
+
+#define SYM_IS_SEMI_NAIVE(sym_ptr) (GET_FLAGS(sym_ptr) & SYM_SEMI_NAIVE)
+
+/* the last answer of subgoal_entry, or NULL */
+static BPLONG semi_naive_last_answer(BPLONG_PTR subgoal_entry) {
+    BPLONG answer_table;
+
+    answer_table = GT_ANSWER_TABLE(subgoal_entry);
+    if (answer_table == (BPLONG)NULL) return (BPLONG)NULL;
+    if (answer_table & 0x1) return (BPLONG)UNTAGGED_ADDR(answer_table);  /* has only one answer */
+    return ANSWERTABLE_LAST(answer_table);
+}
+
+/* the answer after which the new frame ar for subgoal_entry starts to consume, or NULL */
+BPLONG semi_naive_answer_mark(BPLONG_PTR ar, BPLONG_PTR subgoal_entry) {
+    BPLONG_PTR caller_ar, caller, b, list, rec;
+    SYM_REC_PTR sym_ptr;
+    BPLONG mark;
+
+    if (SUBGOAL_IS_COMPLETE(subgoal_entry)) return (BPLONG)NULL;
+    caller_ar = tabled_ancestor_frame((BPLONG_PTR)AR_AR(ar));
+    if (caller_ar == NULL) return (BPLONG)NULL;
+    caller = (BPLONG_PTR)GET_AR_SUBGOAL_TABLE(caller_ar);
+    sym_ptr = (SYM_REC_PTR)GT_SYM(caller);
+    if (!SYM_IS_SEMI_NAIVE(sym_ptr)) return (BPLONG)NULL;
+    if (TABLE_MODE_OPT_ARG((BPLONG_PTR)GET_EP((SYM_REC_PTR)GT_SYM(subgoal_entry))) != 0) return (BPLONG)NULL;
+
+    /* the choice points younger than the caller's frame belong to the clause being executed */
+    for (b = (BPLONG_PTR)AR_B(ar); b < caller_ar; b = (BPLONG_PTR)AR_B(b)) {
+        if (IS_TABLE_FRAME(b) && !SUBGOAL_IS_COMPLETE((BPLONG_PTR)GET_AR_SUBGOAL_TABLE(b))) {
+            GET_FLAGS(sym_ptr) &= ~SYM_SEMI_NAIVE;
+            semi_naive_tabling--;
+            SET_SUBGOAL_ANS_REVISED(caller);
+            return (BPLONG)NULL;
+        }
+    }
+
+    list = table_addr_map_get(&semi_naive_marks, caller);
+    for (rec = list; rec != NULL; rec = (BPLONG_PTR)SN_NEXT(rec)) {
+        if ((BPLONG_PTR)SN_CALLEE(rec) == subgoal_entry) break;
+    }
+    if (rec == NULL) {
+        ALLOCATE_FROM_NUMBERED_TERM_AREA(ta_record_ptr, rec, SN_RECORD_SIZE);
+        if (rec == NULL) {
+            myquit(OUT_OF_MEMORY, "ta");
+        }
+        SN_CALLEE(rec) = (BPLONG)subgoal_entry;
+        SN_PREV_MARK(rec) = SN_NO_MARK;
+        SN_MARK(rec) = SN_NO_MARK;
+        SN_NEXT(rec) = (BPLONG)list;
+        table_addr_map_put(&semi_naive_marks, caller, rec);
+    }
+    if (SN_MARK(rec) == SN_NO_MARK) SN_MARK(rec) = semi_naive_last_answer(subgoal_entry);
+    mark = SN_PREV_MARK(rec);
+    return (mark == SN_NO_MARK) ? (BPLONG)NULL : mark;
+}
+
+/* forget the marks when the table area is initialized or collected; the calls
+   without marks consume all answers */
+static void reset_semi_naive_tabling() {
+    table_addr_map_free(&semi_naive_marks);
+}
+
+/* called when an evaluation of subgoal_entry starts, see START_SUBGOAL_EVALUATION */
+void semi_naive_start_evaluation(BPLONG_PTR subgoal_entry, int first) {
+    BPLONG_PTR rec;
+
+    if (!SYM_IS_SEMI_NAIVE((SYM_REC_PTR)GT_SYM(subgoal_entry))) return;
+    for (rec = table_addr_map_get(&semi_naive_marks, subgoal_entry); rec != NULL; rec = (BPLONG_PTR)SN_NEXT(rec)) {
+        SN_PREV_MARK(rec) = (first) ? SN_NO_MARK : SN_MARK(rec);
+        SN_MARK(rec) = SN_NO_MARK;
+    }
+}
+
+/* c_SET_SEMI_NAIVE_TABLING_ccc(F,N,Flag): make the tabled predicate F/N semi-naive
+   (Flag=1) or not (Flag=0); fail if F/N cannot be made semi-naive */
+int c_SET_SEMI_NAIVE_TABLING_ccc() {
+    BPLONG f, n, flag;
+    BPLONG_PTR ep;
+    SYM_REC_PTR sym_ptr;
+
+    f = ARG(1, 3); DEREF(f);
+    n = ARG(2, 3); DEREF(n);
+    flag = ARG(3, 3); DEREF(flag);
+    if (!ISATOM(f) || !ISINT(n) || !ISINT(flag)) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    GET_GLOBAL_SYM(f, n, sym_ptr);
+    reset_semi_naive_tabling();
+    if (INTVAL(flag) == 0) {
+        if (SYM_IS_SEMI_NAIVE(sym_ptr)) {
+            GET_FLAGS(sym_ptr) &= ~SYM_SEMI_NAIVE;
+            semi_naive_tabling--;
+        }
+        return BP_TRUE;
+    }
+    if (GET_ETYPE(sym_ptr) != T_PRED) return BP_FALSE;
+    ep = (BPLONG_PTR)GET_EP(sym_ptr);
+    if (FOLLOW(ep) != table_allocate_code || TABLE_MODE_OPT_ARG(ep) != 0) return BP_FALSE;
+    if (ep >= lib_code_low_addr && ep < lib_code_up_addr) return BP_FALSE;
+    if (!SYM_IS_SEMI_NAIVE(sym_ptr)) {
+        GET_FLAGS(sym_ptr) |= SYM_SEMI_NAIVE;
+        semi_naive_tabling++;
+    }
+    return BP_TRUE;
+}
+
+/******************* SHARED TABLE STORE ********************/
+/* A table store is a file that several processes map into their memory, so that
+   the complete subgoals of the shared predicates are evaluated by one of them only.
+   When a subgoal of a shared predicate is complete, it is written with its answers
+   as a record into the store. When a new subgoal of a shared predicate is found in
+   the store, its answers are added to its answer table, and it is complete without
+   being evaluated.
+
+   The store is append-only. A record is written into space taken from the top with
+   an atomic add, and it is published by a compare-and-swap on the head of its bucket,
+   so lookups take no lock, and a record never changes once it is reachable. The
+   cells of a record refer to each other by offsets within the record, and to atoms
+   and functors by the entries of the record's symbol table, which hold their names
+   and arities, so a record means the same in every process. The hash code of a
+   subgoal is computed from the names of its symbols for the same reason. A process
+   that finds the store full stops publishing.
+
+   The store outlives the processes, so a restarted program finds the subgoals that
+   were completed in earlier runs. A record carries the key of the process that
+   wrote it, and only the records with the process's own key are used. The key is a
+   checksum of the program's source files unless it is given when the store is
+   opened, so the records of a program that has changed are not used. The answers of
+   a shared predicate must not depend on anything else that differs between the
+   processes. The subgoals of the planner are not shared, because their answers
+   depend on their resource limits.
+
+   The store header is followed by the buckets:
+
+   magic, word size, capacity (in words), top, number of buckets, version, number of records
+
+   A record is:
+
+   next, hash code, size, arity, number of answers, symbol table offset,
+   number of symbols, predicate symbol number, key, args, answers, cells, symbol table
+
+   A cell is an integer or a numbered variable as in the table area, or an offset or
+   a symbol number shifted left by 2 and tagged with LST, STR or ATM. A structure is
+   a symbol number followed by the arguments. The symbol table holds the offsets of
+   the entries, and an entry is the arity and the length followed by the name.
+*/
+#define TABLE_STORE_MAGIC 0x53545450L  /* "PTTS" */
+#define TABLE_STORE_VERSION 2
+#define TABLE_STORE_HEADER_SIZE 8
+#define TS_MAGIC 0
+#define TS_WORD_SIZE 1
+#define TS_CAPACITY 2
+#define TS_TOP 3
+#define TS_NUM_BUCKETS 4
+#define TS_VERSION 5
+#define TS_NUM_RECORDS 6
+
+#define TS_REC_NEXT 0
+#define TS_REC_HASH 1
+#define TS_REC_SIZE 2
+#define TS_REC_ARITY 3
+#define TS_REC_NUM_ANSWERS 4
+#define TS_REC_SYMS 5
+#define TS_REC_NUM_SYMS 6
+#define TS_REC_PRED 7
+#define TS_REC_KEY 8
+#define TS_REC_HEADER_SIZE 9
+
+#define TS_CELL(val, tag) (((BPLONG)(val) << 2) | (tag))
+#define TS_CELL_VAL(cell) ((BPULONG)(cell) >> 2)
+#define TS_CELL_IS_NUMBER(cell) ((cell) & TOP_BIT)  /* an integer or a numbered variable */
+
+#ifdef WIN32  /* a store cannot be opened */
+#define TS_LOAD(ptr) (*(ptr))
+#define TS_FETCH_ADD(ptr, n) ((*(ptr) += (n))-(n))
+#define TS_CAS(ptr, old, new) (*(ptr) = (new), 1)
+#else
+#define TS_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define TS_FETCH_ADD(ptr, n) __atomic_fetch_add((ptr), (n), __ATOMIC_ACQ_REL)
+#define TS_CAS(ptr, old, new) __sync_bool_compare_and_swap((ptr), (old), (new))
+#endif
+
+/* the record being built */
+static BPLONG_PTR ts_buf = NULL;
+static BPLONG ts_buf_top, ts_buf_capacity;
+static SYM_REC_PTR *ts_syms = NULL;  /* the symbols of the record, in the order of their numbers */
+static BPLONG ts_num_syms, ts_syms_capacity;
+static BPLONG ts_key;  /* the key of the records of this process */
+static BPLONG_PTR ts_sym_index = NULL;  /* open addressing, the symbol numbers plus 1 */
+static BPLONG ts_sym_index_size;
+static int ts_failed;
+
+/* the symbols of the record being read */
+static SYM_REC_PTR *ts_resolved = NULL;
+static BPLONG ts_resolved_capacity = 0;
+
+static BPLONG ts_hashval_sym(SYM_REC_PTR sym_ptr) {
+    CHAR_PTR name;
+    BPLONG i, len;
+    UW32 h;
+
+    name = GET_NAME(sym_ptr);
+    len = GET_LENGTH(sym_ptr);
+    h = (UW32)GET_ARITY(sym_ptr);
+    for (i = 0; i < len; i++) {
+        h = h*31+(BYTE)name[i];
+    }
+    return h;
+}
+
+/* a hash code of a numbered term that does not depend on the addresses of its symbols */
+static BPLONG ts_hashval(BPLONG term) {
+    BPLONG_PTR ptr;
+    BPLONG i, arity;
+    UW32 h;
+
+    if (TS_CELL_IS_NUMBER(term)) {
+        return IsNumberedVar(term) ? 0 : (UW32)INTVAL(term);
+    }
+    switch (TAG(term)) {
+    case ATM:
+        return ts_hashval_sym(GET_ATM_SYM_REC(term));
+    case LST:
+        h = 1;
+        do {
+            ptr = (BPLONG_PTR)UNTAGGED_ADDR(term);
+            h = MurmurHash3_x86_32_uint32((UW32)ts_hashval(FOLLOW(ptr)), h);
+            term = FOLLOW(ptr+1);
+        } while (ISLIST(term));
+        return MurmurHash3_x86_32_uint32((UW32)ts_hashval(term), h);
+    case STR:
+        ptr = (BPLONG_PTR)UNTAGGED_ADDR(term);
+        h = (UW32)ts_hashval_sym((SYM_REC_PTR)FOLLOW(ptr));
+        arity = GET_ARITY((SYM_REC_PTR)FOLLOW(ptr));
+        for (i = 1; i <= arity; i++) {
+            h = MurmurHash3_x86_32_uint32((UW32)ts_hashval(FOLLOW(ptr+i)), h);
+        }
+        return h;
+    }
+    return 0;
+}
+
+static BPLONG ts_hashval_subgoal(SYM_REC_PTR sym_ptr, BPLONG_PTR args, BPLONG arity) {
+    BPLONG i;
+    UW32 h;
+
+    h = (UW32)ts_hashval_sym(sym_ptr);
+    for (i = 0; i < arity; i++) {
+        h = MurmurHash3_x86_32_uint32((UW32)ts_hashval(FOLLOW(args+i)), h);
+    }
+    return h;
+}
+
+/* reserve size words at the top of the record being built, and return their offset */
+static BPLONG ts_reserve(BPLONG size) {
+    BPLONG off;
+
+    if (ts_buf_top+size > ts_buf_capacity) {
+        BPLONG new_capacity = 2*ts_buf_capacity;
+        BPLONG_PTR ptr;
+        while (ts_buf_top+size > new_capacity) new_capacity *= 2;
+        ptr = (BPLONG_PTR)realloc(ts_buf, new_capacity*sizeof(BPLONG));
+        if (ptr == NULL) {
+            ts_failed = 1;
+            return 0;
+        }
+        ts_buf = ptr;
+        ts_buf_capacity = new_capacity;
+    }
+    off = ts_buf_top;
+    ts_buf_top += size;
+    return off;
+}
+
+/* the number of sym_ptr in the symbol table of the record being built */
+static BPLONG ts_sym_number(SYM_REC_PTR sym_ptr) {
+    BPLONG i, n;
+    BPULONG h;
+
+    if (2*(ts_num_syms+1) > ts_sym_index_size) {
+        BPLONG new_size = (ts_sym_index_size == 0) ? 64 : 2*ts_sym_index_size;
+        BPLONG_PTR index = (BPLONG_PTR)calloc(new_size, sizeof(BPLONG));
+        SYM_REC_PTR *syms = (SYM_REC_PTR *)realloc(ts_syms, (new_size/2)*sizeof(SYM_REC_PTR));
+        if (index == NULL || syms == NULL) {
+            if (index != NULL) free(index);
+            if (syms != NULL) ts_syms = syms;
+            ts_failed = 1;
+            return 0;
+        }
+        ts_syms = syms;
+        ts_syms_capacity = new_size/2;
+        if (ts_sym_index != NULL) free(ts_sym_index);
+        ts_sym_index = index;
+        ts_sym_index_size = new_size;
+        for (n = 0; n < ts_num_syms; n++) {
+            h = (((BPULONG)ts_syms[n]) >> 3) % new_size;
+            while (index[h] != 0) h = (h+1) % new_size;
+            index[h] = n+1;
+        }
+    }
+    h = (((BPULONG)sym_ptr) >> 3) % ts_sym_index_size;
+    while ((i = ts_sym_index[h]) != 0) {
+        if (ts_syms[i-1] == sym_ptr) return i-1;
+        h = (h+1) % ts_sym_index_size;
+    }
+    ts_syms[ts_num_syms] = sym_ptr;
+    ts_sym_index[h] = ts_num_syms+1;
+    return ts_num_syms++;
+}
+
+/* encode the numbered term into the record being built */
+static BPLONG ts_encode(BPLONG term) {
+    BPLONG_PTR ptr;
+    BPLONG off, prev_off, cell, list, i, arity;
+
+    if (TS_CELL_IS_NUMBER(term)) return term;
+    switch (TAG(term)) {
+    case ATM:
+        return TS_CELL(ts_sym_number(GET_ATM_SYM_REC(term)), ATM);
+    case LST:
+        list = 0; prev_off = 0;
+        do {
+            off = ts_reserve(2);
+            if (ts_failed) return 0;
+            if (list == 0) {
+                list = TS_CELL(off, LST);
+            } else {
+                ts_buf[prev_off+1] = TS_CELL(off, LST);
+            }
+            ptr = (BPLONG_PTR)UNTAGGED_ADDR(term);
+            cell = ts_encode(FOLLOW(ptr));
+            ts_buf[off] = cell;
+            term = FOLLOW(ptr+1);
+            prev_off = off;
+        } while (ISLIST(term));
+        cell = ts_encode(term);
+        ts_buf[prev_off+1] = cell;
+        return list;
+    case STR:
+        ptr = (BPLONG_PTR)UNTAGGED_ADDR(term);
+        arity = GET_ARITY((SYM_REC_PTR)FOLLOW(ptr));
+        off = ts_reserve(arity+1);
+        if (ts_failed) return 0;
+        cell = ts_sym_number((SYM_REC_PTR)FOLLOW(ptr));
+        ts_buf[off] = cell;
+        for (i = 1; i <= arity; i++) {
+            cell = ts_encode(FOLLOW(ptr+i));
+            ts_buf[off+i] = cell;
+        }
+        return TS_CELL(off, STR);
+    }
+    ts_failed = 1;
+    return 0;
+}
+
+/* look up the symbols of the record, return 0 if the record is malformed */
+static int ts_resolve_syms(BPLONG_PTR rec) {
+    BPLONG i, n, off, size, len;
+    BPLONG_PTR entry;
+
+    n = rec[TS_REC_NUM_SYMS];
+    size = rec[TS_REC_SIZE];
+    if (n < 0 || rec[TS_REC_SYMS] <= 0 || rec[TS_REC_SYMS]+n > size) return 0;
+    if (rec[TS_REC_PRED] < 0 || rec[TS_REC_PRED] >= n) return 0;
+    if (n > ts_resolved_capacity) {
+        SYM_REC_PTR *ptr = (SYM_REC_PTR *)realloc(ts_resolved, n*sizeof(SYM_REC_PTR));
+        if (ptr == NULL) return 0;
+        ts_resolved = ptr;
+        ts_resolved_capacity = n;
+    }
+    for (i = 0; i < n; i++) {
+        off = rec[rec[TS_REC_SYMS]+i];
+        if (off <= 0 || off+2 > size) return 0;
+        entry = rec+off;
+        len = entry[1];  /* the name and its terminating 0 must lie in the record */
+        if (len < 0 || len > size*(BPLONG)sizeof(BPLONG) || off+2+(len+(BPLONG)sizeof(BPLONG))/(BPLONG)sizeof(BPLONG) > size) return 0;
+        if (((const char *)(entry+2))[len] != 0) return 0;
+        if (entry[0] < 0 || entry[0] > MAX_ARITY) return 0;
+        ts_resolved[i] = insert_sym((const char *)(entry+2), len, entry[0]);
+    }
+    return 1;
+}
+
+/* does the cell of rec represent the numbered term? */
+static int ts_match(BPLONG_PTR rec, BPLONG cell, BPLONG term) {
+    BPLONG_PTR ptr, cell_ptr;
+    BPLONG i, arity;
+
+start:
+    if (TS_CELL_IS_NUMBER(cell)) return (cell == term);
+    switch (TAG(cell)) {
+    case ATM:
+        return (term == (BPLONG)ADDTAG(ts_resolved[TS_CELL_VAL(cell)], ATM));
+    case LST:
+        if (!ISLIST(term)) return 0;
+        cell_ptr = rec+TS_CELL_VAL(cell);
+        ptr = (BPLONG_PTR)UNTAGGED_ADDR(term);
+        if (!ts_match(rec, cell_ptr[0], FOLLOW(ptr))) return 0;
+        cell = cell_ptr[1];
+        term = FOLLOW(ptr+1);
+        goto start;
+    case STR:
+        if (!ISSTRUCT(term)) return 0;
+        cell_ptr = rec+TS_CELL_VAL(cell);
+        ptr = (BPLONG_PTR)UNTAGGED_ADDR(term);
+        if (FOLLOW(ptr) != (BPLONG)ts_resolved[cell_ptr[0]]) return 0;
+        arity = GET_ARITY((SYM_REC_PTR)FOLLOW(ptr));
+        for (i = 1; i <= arity; i++) {
+            if (!ts_match(rec, cell_ptr[i], FOLLOW(ptr+i))) return 0;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/* build the term of the cell of rec on the heap, leaving its numbered variables as they are */
+static BPLONG ts_decode(BPLONG_PTR rec, BPLONG cell) {
+    BPLONG_PTR cell_ptr, ptr;
+    BPLONG term, list, i, arity;
+    SYM_REC_PTR sym_ptr;
+
+    if (TS_CELL_IS_NUMBER(cell)) return cell;
+    switch (TAG(cell)) {
+    case ATM:
+        return ADDTAG(ts_resolved[TS_CELL_VAL(cell)], ATM);
+    case LST:
+        list = ADDTAG(heap_top, LST);
+        do {
+            cell_ptr = rec+TS_CELL_VAL(cell);
+            ptr = heap_top;
+            heap_top += 2;
+            term = ts_decode(rec, cell_ptr[0]);
+            FOLLOW(ptr) = term;
+            cell = cell_ptr[1];
+            FOLLOW(ptr+1) = ADDTAG(heap_top, LST);
+        } while (!TS_CELL_IS_NUMBER(cell) && TAG(cell) == LST);
+        FOLLOW(ptr+1) = ts_decode(rec, cell);
+        return list;
+    case STR:
+        cell_ptr = rec+TS_CELL_VAL(cell);
+        sym_ptr = ts_resolved[cell_ptr[0]];
+        arity = GET_ARITY(sym_ptr);
+        ptr = heap_top;
+        heap_top += arity+1;
+        FOLLOW(ptr) = (BPLONG)sym_ptr;
+        for (i = 1; i <= arity; i++) {
+            term = ts_decode(rec, cell_ptr[i]);
+            FOLLOW(ptr+i) = term;
+        }
+        return ADDTAG(ptr, STR);
+    }
+    return nil_sym;
+}
+
+/* the record in the store of the subgoal, or NULL */
+static BPLONG_PTR ts_lookup(SYM_REC_PTR sym_ptr, BPLONG_PTR args, BPLONG arity, BPLONG hcode) {
+    BPLONG_PTR rec;
+    BPLONG off, i, capacity;
+
+    capacity = table_store[TS_CAPACITY];
+    off = TS_LOAD(table_store+TABLE_STORE_HEADER_SIZE+(BPULONG)hcode % table_store[TS_NUM_BUCKETS]);
+    while (off > 0 && off < capacity) {
+        rec = table_store+off;
+        if (rec[TS_REC_HASH] == hcode && rec[TS_REC_KEY] == ts_key && rec[TS_REC_ARITY] == arity && ts_resolve_syms(rec) &&
+            ts_resolved[rec[TS_REC_PRED]] == sym_ptr) {
+            for (i = 0; i < arity; i++) {
+                if (!ts_match(rec, rec[TS_REC_HEADER_SIZE+i], FOLLOW(args+i))) break;
+            }
+            if (i == arity) return rec;
+        }
+        off = rec[TS_REC_NEXT];
+    }
+    return NULL;
+}
+
+/* write the complete subgoal into the store */
+static void publish_shared_subgoal(BPLONG_PTR subgoal_entry) {
+    SYM_REC_PTR sym_ptr;
+    BPLONG_PTR args, answer_table, answer, rec, bucket_ptr;
+    BPLONG arity, hcode, num_answers, answers_off, syms_off, off, i, j, len, cell, old;
+
+    if (table_store == NULL) return;  /* closed after the subgoal was looked up */
+    sym_ptr = (SYM_REC_PTR)GT_SYM(subgoal_entry);
+    arity = GET_ARITY(sym_ptr);
+    args = GT_ARG_ADDR(subgoal_entry);
+    hcode = ts_hashval_subgoal(sym_ptr, args, arity);
+    if (ts_lookup(sym_ptr, args, arity, hcode) != NULL) return;  /* published by another process */
+
+    answer_table = (BPLONG_PTR)GT_ANSWER_TABLE(subgoal_entry);
+    if (answer_table == NULL) {
+        num_answers = 0;
+        answer = NULL;
+    } else if ((BPLONG)answer_table & 0x1) {
+        num_answers = 1;
+        answer = (BPLONG_PTR)UNTAGGED_ADDR(answer_table);
+    } else {
+        num_answers = ANSWERTABLE_COUNT(answer_table);
+        answer = (BPLONG_PTR)ANSWERTABLE_FIRST(answer_table);
+    }
+
+    if (ts_buf == NULL) {
+        ts_buf = (BPLONG_PTR)malloc(1024*sizeof(BPLONG));
+        if (ts_buf == NULL) return;
+        ts_buf_capacity = 1024;
+    }
+    ts_buf_top = 0;
+    ts_num_syms = 0;
+    if (ts_sym_index != NULL) memset(ts_sym_index, 0, ts_sym_index_size*sizeof(BPLONG));
+    ts_failed = 0;
+
+    ts_reserve(TS_REC_HEADER_SIZE+arity);
+    answers_off = ts_reserve(num_answers*arity);
+    if (ts_failed) return;
+    ts_buf[TS_REC_PRED] = ts_sym_number(sym_ptr);
+    for (i = 0; i < arity; i++) {
+        cell = ts_encode(FOLLOW(args+i));
+        ts_buf[TS_REC_HEADER_SIZE+i] = cell;
+    }
+    for (j = 0; j < num_answers; j++) {
+        for (i = 0; i < arity; i++) {
+            cell = ts_encode(FOLLOW(ANSWER_ARG_ADDR(answer)+i));
+            ts_buf[answers_off+j*arity+i] = cell;
+        }
+        answer = (BPLONG_PTR)ANSWER_NEXT_IN_TABLE(answer);
+    }
+    syms_off = ts_reserve(ts_num_syms);
+    for (i = 0; i < ts_num_syms && !ts_failed; i++) {
+        len = GET_LENGTH(ts_syms[i]);
+        off = ts_reserve(2+(len+sizeof(BPLONG))/sizeof(BPLONG));  /* with a terminating 0 */
+        if (ts_failed) break;
+        ts_buf[syms_off+i] = off;
+        ts_buf[off] = GET_ARITY(ts_syms[i]);
+        ts_buf[off+1] = len;
+        memset(ts_buf+off+2, 0, (ts_buf_top-off-2)*sizeof(BPLONG));
+        memcpy(ts_buf+off+2, GET_NAME(ts_syms[i]), len);
+    }
+    if (ts_failed) return;
+    ts_buf[TS_REC_NEXT] = 0;
+    ts_buf[TS_REC_HASH] = hcode;
+    ts_buf[TS_REC_SIZE] = ts_buf_top;
+    ts_buf[TS_REC_ARITY] = arity;
+    ts_buf[TS_REC_NUM_ANSWERS] = num_answers;
+    ts_buf[TS_REC_SYMS] = syms_off;
+    ts_buf[TS_REC_NUM_SYMS] = ts_num_syms;
+    ts_buf[TS_REC_KEY] = ts_key;
+
+    off = TS_FETCH_ADD(table_store+TS_TOP, ts_buf_top);
+    if (off+ts_buf_top > table_store[TS_CAPACITY]) return;  /* the store is full */
+    rec = table_store+off;
+    memcpy(rec, ts_buf, ts_buf_top*sizeof(BPLONG));
+    bucket_ptr = table_store+TABLE_STORE_HEADER_SIZE+(BPULONG)hcode % table_store[TS_NUM_BUCKETS];
+    do {
+        old = TS_LOAD(bucket_ptr);
+        rec[TS_REC_NEXT] = old;
+    } while (!TS_CAS(bucket_ptr, old, off));
+    TS_FETCH_ADD(table_store+TS_NUM_RECORDS, 1);
+}
+
+/* If the new subgoal is in the store, add its answers to its answer table and make it
+   complete. Nothing is done if the heap has no room for building an answer. */
+static int import_shared_subgoal(BPLONG_PTR subgoal_entry) {
+    SYM_REC_PTR sym_ptr;
+    BPLONG_PTR rec, args, answers, stack_arg_ptr, answer, answer_table, heap_top0;
+    BPLONG arity, hcode, num_answers, i, j;
+
+    sym_ptr = (SYM_REC_PTR)GT_SYM(subgoal_entry);
+    arity = GET_ARITY(sym_ptr);
+    args = GT_ARG_ADDR(subgoal_entry);
+    hcode = ts_hashval_subgoal(sym_ptr, args, arity);
+    rec = ts_lookup(sym_ptr, args, arity, hcode);
+    if (rec == NULL) return BP_FALSE;
+    if ((BPLONG)(local_top-heap_top) < rec[TS_REC_SIZE]+arity+LARGE_MARGIN) return BP_FALSE;
+
+    num_answers = rec[TS_REC_NUM_ANSWERS];
+    answers = rec+TS_REC_HEADER_SIZE+arity;
+    heap_top0 = heap_top;
+    for (j = 0; j < num_answers; j++) {
+        stack_arg_ptr = heap_top+arity-1;  /* the arguments are stored in reverse order, as on the stack */
+        heap_top += arity;
+        for (i = 0; i < arity; i++) {
+            FOLLOW(stack_arg_ptr-i) = ts_decode(rec, answers[j*arity+i]);
+        }
+        answer_table = (BPLONG_PTR)GT_ANSWER_TABLE(subgoal_entry);
+        if (answer_table == NULL) {
+            answer = addFirstTableAnswer(stack_arg_ptr, arity);
+            if ((BPLONG)answer == BP_ERROR) goto import_error;
+            GT_ANSWER_TABLE(subgoal_entry) = ((BPLONG)answer | 0x1);
+        } else {
+            if ((BPLONG)answer_table & 0x1) {
+                answer_table = allocateAnswerTable((BPLONG_PTR)UNTAGGED_ADDR(answer_table), arity);
+                if ((BPLONG)answer_table == BP_ERROR) goto import_error;
+                GT_ANSWER_TABLE(subgoal_entry) = (BPLONG)answer_table;
+            }
+            if (addTableAnswer(stack_arg_ptr, arity, subgoal_entry) == BP_ERROR) goto import_error;
+        }
+        heap_top = heap_top0;
+    }
+    GT_TOP_AR(subgoal_entry) = SUBGOAL_COMPLETE;
+    return BP_TRUE;
+
+import_error:
+    heap_top = heap_top0;
+    return BP_ERROR;
+}
+
+static void close_table_store() {
+    BPLONG top;
+
+    if (table_store == NULL) return;
+#ifndef WIN32
+    top = TS_LOAD(table_store+TS_TOP);
+    if (top > table_store[TS_CAPACITY]) top = table_store[TS_CAPACITY];
+    msync(table_store, top*sizeof(BPLONG), MS_SYNC);  /* so that the tables survive a crash of the system */
+    munmap(table_store, table_store[TS_CAPACITY]*sizeof(BPLONG));
+#endif
+    table_store = NULL;
+}
+
+#define TS_FNV_BASIS ((BPULONG)14695981039346656037ULL)
+#define TS_FNV_PRIME ((BPULONG)1099511628211ULL)
+
+static BPULONG ts_hash_bytes(BPULONG h, CHAR_PTR s, BPLONG n) {
+    BPLONG i;
+
+    for (i = 0; i < n; i++) {
+        h = (h ^ (BYTE)s[i])*TS_FNV_PRIME;
+    }
+    return h;
+}
+
+/* add the contents of the file to the hash code, return 0 if it cannot be read */
+static int ts_hash_file(BPULONG *h_ptr, CHAR_PTR name) {
+    CHAR buf[4096];
+    FILE *fp;
+    size_t n;
+
+    fp = fopen(name, "rb");
+    if (fp == NULL) return 0;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        *h_ptr = ts_hash_bytes(*h_ptr, buf, (BPLONG)n);
+    }
+    fclose(fp);
+    return 1;
+}
+
+/* A checksum of the loaded modules and of the files they were read from, including
+   the main file. Library modules, which are not read from files, count by name. */
+static BPLONG table_program_key(BPLONG modules) {
+    BPLONG m;
+    BPULONG h;
+    SYM_REC_PTR sym_ptr;
+    CHAR_PTR path;
+
+    h = TS_FNV_BASIS;
+    DEREF(modules);
+    while (ISLIST(modules)) {
+        m = FOLLOW((BPLONG_PTR)UNTAGGED_ADDR(modules)); DEREF(m);
+        modules = FOLLOW((BPLONG_PTR)UNTAGGED_ADDR(modules)+1); DEREF(modules);
+        if (!ISATOM(m)) continue;
+        sym_ptr = GET_ATM_SYM_REC(m);
+        h = ts_hash_bytes(h, GET_NAME(sym_ptr), GET_LENGTH(sym_ptr));
+        path = loaded_file_path(GET_NAME(sym_ptr), GET_LENGTH(sym_ptr));
+        if (path != NULL) ts_hash_file(&h, path);
+    }
+    return (BPLONG)h;
+}
+
+/* c_TABLE_STORE_OPEN_cc(File,Key): map the table store File, creating it if it does not
+   exist. Key is an integer, an atom, a string, or '$modules'(Modules) for the checksum of
+   the program. */
+int c_TABLE_STORE_OPEN_cc() {
+    BPLONG File, Key;
+#ifdef WIN32
+    File = ARG(1, 2); DEREF(File);
+    bp_exception = c_permission_error(et_OPEN, et_SOURCE_SINK, File);
+    return BP_ERROR;
+#else
+    BPLONG header[TABLE_STORE_HEADER_SIZE];
+    BPLONG capacity, num_buckets;
+    BPLONG_PTR store;
+    CHAR name[MAX_STR_LEN];
+    struct stat st;
+    int fd;
+
+    File = ARG(1, 2); DEREF(File);
+    Key = ARG(2, 2); DEREF(Key);
+    if (check_file_term(File) != BP_TRUE) return BP_ERROR;
+    if (ISATOM(File)) {
+        namestring(GET_SYM_REC(File), name);
+    } else {
+        picat_str_to_c_str(File, name, MAX_STR_LEN);
+    }
+    if (ISINT(Key)) {
+        Key = INTVAL(Key);
+    } else if (ISATOM(Key)) {
+        Key = ts_hashval_sym(GET_ATM_SYM_REC(Key));
+    } else if (ISLIST(Key)) {
+        CHAR key_str[MAX_STR_LEN];
+        picat_str_to_c_str(Key, key_str, MAX_STR_LEN);
+        Key = (BPLONG)ts_hash_bytes(TS_FNV_BASIS, key_str, strlen(key_str));
+    } else if (ISSTRUCT(Key) && GET_ARITY(GET_STR_SYM_REC(Key)) == 1) {
+        Key = table_program_key(FOLLOW((BPLONG_PTR)UNTAGGED_ADDR(Key)+1));
+    } else {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+
+    fd = open(name, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        bp_exception = c_permission_error(et_OPEN, et_SOURCE_SINK, File);
+        return BP_ERROR;
+    }
+    flock(fd, LOCK_EX);  /* only one process initializes a new store */
+    if (fstat(fd, &st) != 0) goto open_error;
+    if (st.st_size == 0) {
+        capacity = (sizeof(BPLONG) == 8) ? (1L << 27) : (1L << 24);  /* the file is sparse */
+        num_buckets = capacity/128;
+        if (ftruncate(fd, (off_t)capacity*sizeof(BPLONG)) != 0) goto open_error;
+    } else {
+        if (st.st_size < (off_t)sizeof(header) ||
+            pread(fd, header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+            header[TS_MAGIC] != TABLE_STORE_MAGIC || header[TS_WORD_SIZE] != sizeof(BPLONG) ||
+            header[TS_VERSION] != TABLE_STORE_VERSION ||
+            (off_t)header[TS_CAPACITY]*(off_t)sizeof(BPLONG) != st.st_size) {
+            goto open_error;
+        }
+        capacity = header[TS_CAPACITY];
+        num_buckets = header[TS_NUM_BUCKETS];
+    }
+    store = (BPLONG_PTR)mmap(NULL, (size_t)capacity*sizeof(BPLONG), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (store == (BPLONG_PTR)MAP_FAILED) goto open_error;
+    if (st.st_size == 0) {  /* the file is filled with 0s */
+        store[TS_WORD_SIZE] = sizeof(BPLONG);
+        store[TS_CAPACITY] = capacity;
+        store[TS_TOP] = TABLE_STORE_HEADER_SIZE+num_buckets;
+        store[TS_NUM_BUCKETS] = num_buckets;
+        store[TS_VERSION] = TABLE_STORE_VERSION;
+        store[TS_MAGIC] = TABLE_STORE_MAGIC;
+    }
+    flock(fd, LOCK_UN);
+    close(fd);  /* the mapping stays valid after the descriptor is closed */
+    close_table_store();
+    table_store = store;
+    ts_key = Key;
+    return BP_TRUE;
+
+open_error:
+    flock(fd, LOCK_UN);
+    close(fd);
+    bp_exception = c_permission_error(et_OPEN, et_SOURCE_SINK, File);
+    return BP_ERROR;
+#endif
+}
+
+int c_TABLE_STORE_CLOSE() {
+    close_table_store();
+    return BP_TRUE;
+}
+
+/* c_SHARE_TABLE_cc(F,N): share the complete subgoals of F/N through the table store */
+int c_SHARE_TABLE_cc() {
+    BPLONG f, n;
+    SYM_REC_PTR sym_ptr;
+
+    f = ARG(1, 2); DEREF(f);
+    n = ARG(2, 2); DEREF(n);
+    if (!ISATOM(f) || !ISINT(n)) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    GET_GLOBAL_SYM(f, n, sym_ptr);
+    if (sym_ptr != plan_psc) GET_FLAGS(sym_ptr) |= SYM_SHARED;
+    return BP_TRUE;
+}
+
+/******************* TABLE PROFILING ********************/
+/* When profiling is on, the following counters are kept for each tabled predicate:
+   the calls that found their subgoals in the subgoal table (hits), the calls that
+   added new subgoals (misses), the SCCs whose leaders are subgoals of the predicate,
+   the iterations in which those SCCs were evaluated again, the CPU time from the first
+   call of a leader to the completion of its SCC, less the time of the SCCs that were
+   completed in between, and the bytes taken from the table
+   area for the subgoals and answers of the predicate. The table area is measured
+   before a subgoal is looked up or an answer is added, and its growth is charged to
+   the predicate at the next measurement. The numbers of subgoals and answers are
+   counted in the subgoal table when the profile is taken. */
+int table_profiling = 0;  /* 0: off, 1: on, 2: on and printed at exit */
+
+typedef struct {
+    SYM_REC_PTR sym_ptr;
+    BPLONG hits, misses, sccs, iterations, bytes;
+    BPLONG completion_time;    /* in microseconds */
+    BPLONG subgoals, answers;  /* counted when the profile is taken */
+} TableProfile, *TableProfilePtr;
+
+typedef struct {
+    BPLONG_PTR subgoal_entry;
+    BPLONG start_time;
+    BPLONG nested_time;  /* the time of the SCCs completed since the start */
+} TableProfileLeader;
+
+static TableProfilePtr table_profiles = NULL;
+static BPLONG num_table_profiles, table_profiles_capacity;
+static BPLONG *table_profile_index = NULL;  /* open addressing, the profile numbers plus 1 */
+static BPLONG table_profile_index_size;
+static BPLONG table_profile_pending = -1;   /* the profile that the growth of the table area is charged to */
+static BPLONG_PTR table_profile_top0;
+static BPLONG table_profile_expansions0;
+static TableProfileLeader *table_profile_leaders = NULL;  /* the leaders being evaluated, outermost first */
+static BPLONG num_table_profile_leaders, table_profile_leaders_capacity;
+static int table_profile_exit_registered = 0;
+
+/* the number of the profile of sym_ptr, which is added if it is new, or -1 */
+static BPLONG table_profile_number(SYM_REC_PTR sym_ptr) {
+    BPLONG i, n;
+    BPULONG h;
+
+    if (2*(num_table_profiles+1) > table_profile_index_size) {
+        BPLONG new_size = (table_profile_index_size == 0) ? 64 : 2*table_profile_index_size;
+        BPLONG *index = (BPLONG *)calloc(new_size, sizeof(BPLONG));
+        TableProfilePtr profiles = (TableProfilePtr)realloc(table_profiles, (new_size/2)*sizeof(TableProfile));
+        if (index == NULL || profiles == NULL) {
+            if (index != NULL) free(index);
+            if (profiles != NULL) table_profiles = profiles;
+            return -1;
+        }
+        table_profiles = profiles;
+        table_profiles_capacity = new_size/2;
+        if (table_profile_index != NULL) free(table_profile_index);
+        table_profile_index = index;
+        table_profile_index_size = new_size;
+        for (n = 0; n < num_table_profiles; n++) {
+            h = (((BPULONG)table_profiles[n].sym_ptr) >> 3) % new_size;
+            while (index[h] != 0) h = (h+1) % new_size;
+            index[h] = n+1;
+        }
+    }
+    h = (((BPULONG)sym_ptr) >> 3) % table_profile_index_size;
+    while ((i = table_profile_index[h]) != 0) {
+        if (table_profiles[i-1].sym_ptr == sym_ptr) return i-1;
+        h = (h+1) % table_profile_index_size;
+    }
+    memset(table_profiles+num_table_profiles, 0, sizeof(TableProfile));
+    table_profiles[num_table_profiles].sym_ptr = sym_ptr;
+    table_profile_index[h] = num_table_profiles+1;
+    return num_table_profiles++;
+}
+
+/* charge the growth of the table area since the last measurement */
+static void table_profile_charge() {
+    BPLONG words;
+
+    if (table_profile_pending < 0) return;
+    if (ta_record_ptr->num_expansions == table_profile_expansions0) {
+        words = ta_record_ptr->top-table_profile_top0;
+    } else {  /* only the part in the new block is known */
+        words = ta_record_ptr->top-(ta_record_ptr->low_addr+1);
+    }
+    if (words > 0) table_profiles[table_profile_pending].bytes += words*(BPLONG)sizeof(BPLONG);
+    table_profile_pending = -1;
+}
+
+/* called before a subgoal of sym_ptr is looked up or given an answer */
+void table_profile_begin(SYM_REC_PTR sym_ptr) {
+    table_profile_charge();
+    table_profile_pending = table_profile_number(sym_ptr);
+    table_profile_top0 = ta_record_ptr->top;
+    table_profile_expansions0 = ta_record_ptr->num_expansions;
+}
+
+static void table_profile_lookup(int found) {
+    if (table_profile_pending < 0) return;
+    if (found) {
+        table_profiles[table_profile_pending].hits++;
+    } else {
+        table_profiles[table_profile_pending].misses++;
+    }
+}
+
+/* called for the malloc'ed parts of answer tables */
+void table_profile_add_bytes(BPLONG bytes) {
+    if (table_profile_pending >= 0) table_profiles[table_profile_pending].bytes += bytes;
+}
+
+/* called when the evaluation of subgoal_entry starts, which may make it a leader */
+void table_profile_start(BPLONG_PTR subgoal_entry) {
+    TableProfileLeader *ptr;
+
+    if (num_table_profile_leaders == table_profile_leaders_capacity) {
+        BPLONG new_capacity = (table_profile_leaders_capacity == 0) ? 64 : 2*table_profile_leaders_capacity;
+        ptr = (TableProfileLeader *)realloc(table_profile_leaders, new_capacity*sizeof(TableProfileLeader));
+        if (ptr == NULL) return;  /* the time of this SCC is not known */
+        table_profile_leaders = ptr;
+        table_profile_leaders_capacity = new_capacity;
+    }
+    table_profile_leaders[num_table_profile_leaders].subgoal_entry = subgoal_entry;
+    table_profile_leaders[num_table_profile_leaders].start_time = cputime_usec();
+    table_profile_leaders[num_table_profile_leaders].nested_time = 0;
+    num_table_profile_leaders++;
+}
+
+/* called when the SCC of the leader subgoal_entry is evaluated again */
+void table_profile_iterate(BPLONG_PTR subgoal_entry) {
+    BPLONG n;
+
+    n = table_profile_number((SYM_REC_PTR)GT_SYM(subgoal_entry));
+    if (n >= 0) table_profiles[n].iterations++;
+}
+
+/* called when the SCC of the leader subgoal_entry is complete. The subgoals whose
+   evaluations started later belong to the SCC or to SCCs that are complete, so their
+   entries are removed too. */
+void table_profile_complete(BPLONG_PTR subgoal_entry) {
+    BPLONG i, j, n, time, nested_time;
+
+    n = table_profile_number((SYM_REC_PTR)GT_SYM(subgoal_entry));
+    if (n < 0) return;
+    table_profiles[n].sccs++;
+    for (i = num_table_profile_leaders-1; i >= 0; i--) {
+        if (table_profile_leaders[i].subgoal_entry == subgoal_entry) {
+            time = cputime_usec()-table_profile_leaders[i].start_time;
+            nested_time = 0;
+            for (j = i; j < num_table_profile_leaders; j++) nested_time += table_profile_leaders[j].nested_time;
+            if (time > nested_time) table_profiles[n].completion_time += time-nested_time;
+            if (i > 0) table_profile_leaders[i-1].nested_time += time;
+            num_table_profile_leaders = i;
+            return;
+        }
+    }
+}
+
+/* called when the subgoal entries are freed */
+static void reset_table_profile() {
+    table_profile_charge();
+    num_table_profile_leaders = 0;
+}
+
+/* called when the subgoal entries have been moved, fwd mapping the old entries to the new
+   ones; the leaders whose entries were not moved are dropped */
+static void forward_table_profile_leaders(TABLE_ADDR_MAP *fwd) {
+    BPLONG i, n;
+    BPLONG_PTR new_entry;
+
+    n = 0;
+    for (i = 0; i < num_table_profile_leaders; i++) {
+        new_entry = table_addr_map_get(fwd, table_profile_leaders[i].subgoal_entry);
+        if (new_entry == NULL) continue;
+        table_profile_leaders[n] = table_profile_leaders[i];
+        table_profile_leaders[n].subgoal_entry = new_entry;
+        n++;
+    }
+    num_table_profile_leaders = n;
+}
+
+static int table_profile_compare(const void *p1, const void *p2) {
+    TableProfilePtr t1 = table_profiles+*(BPLONG *)p1;
+    TableProfilePtr t2 = table_profiles+*(BPLONG *)p2;
+
+    if (t1->bytes != t2->bytes) return (t1->bytes > t2->bytes) ? -1 : 1;
+    return (*(BPLONG *)p1 < *(BPLONG *)p2) ? -1 : 1;
+}
+
+/* count the subgoals and answers, and return the profile numbers ordered by the bytes
+   charged, largest first, or NULL if memory runs out */
+static BPLONG *collect_table_profile() {
+    BPLONG i, n;
+    BPLONG_PTR subgoal_entry, answer_table;
+    BPLONG *order;
+
+    table_profile_charge();
+    for (i = 0; i < num_table_profiles; i++) {
+        table_profiles[i].subgoals = 0;
+        table_profiles[i].answers = 0;
+    }
+    for (i = 0; i < subgoalTableBucketSize; i++) {
+        subgoal_entry = (BPLONG_PTR)FOLLOW(subgoalTable+i);
+        while (subgoal_entry != NULL) {
+            n = table_profile_number((SYM_REC_PTR)GT_SYM(subgoal_entry));
+            if (n < 0) return NULL;
+            table_profiles[n].subgoals++;
+            answer_table = (BPLONG_PTR)GT_ANSWER_TABLE(subgoal_entry);
+            if (answer_table != NULL) {
+                if (((BPLONG)answer_table & 0x1) == 0) {  /* answer table exists only when there are two or more answers */
+                    table_profiles[n].answers += ANSWERTABLE_COUNT(answer_table);
+                } else {
+                    table_profiles[n].answers++;
+                }
+            }
+            subgoal_entry = (BPLONG_PTR)GT_NEXT(subgoal_entry);
+        }
+    }
+    order = (BPLONG *)malloc((num_table_profiles+1)*sizeof(BPLONG));
+    if (order == NULL) return NULL;
+    for (i = 0; i < num_table_profiles; i++) order[i] = i;
+    qsort(order, num_table_profiles, sizeof(BPLONG), table_profile_compare);
+    return order;
+}
+
+/* the name of the tabled predicate or function without the module prefix of its
+   symbol, "e$$module$$" or "e$$module$$f$$", and its arity as it is written */
+static void table_profile_name(SYM_REC_PTR sym_ptr, CHAR_PTR name, BPLONG *arity_ptr) {
+    CHAR_PTR s;
+    CHAR buf[MAX_STR_LEN];
+
+    namestring(sym_ptr, buf);
+    s = buf;
+    *arity_ptr = GET_ARITY(sym_ptr);
+    if (strncmp(s, "e$$", 3) == 0 && strstr(s+3, "$$") != NULL) {
+        s = strstr(s+3, "$$")+2;
+        if (strncmp(s, "f$$", 3) == 0) {
+            s += 3;
+            (*arity_ptr)--;  /* the value of a function is the last argument */
+        }
+    }
+    strcpy(name, s);
+}
+
+static void print_table_profile(FILE *out) {
+    BPLONG i, arity;
+    BPLONG *order;
+    TableProfilePtr t;
+    CHAR name[MAX_STR_LEN];
+
+    order = collect_table_profile();
+    if (order == NULL) return;
+    for (i = 0; i < num_table_profiles; i++) {
+        t = table_profiles+order[i];
+        table_profile_name(t->sym_ptr, name, &arity);
+        fprintf(out, "%s/" BPLONG_FMT_STR ": ", name, arity);
+        fprintf(out, "subgoals=" BPLONG_FMT_STR " answers=" BPLONG_FMT_STR, t->subgoals, t->answers);
+        fprintf(out, " hits=" BPLONG_FMT_STR " misses=" BPLONG_FMT_STR, t->hits, t->misses);
+        fprintf(out, " sccs=" BPLONG_FMT_STR " iterations=" BPLONG_FMT_STR, t->sccs, t->iterations);
+        fprintf(out, " bytes=" BPLONG_FMT_STR " completion_time=" BPLONG_FMT_STR "\n", t->bytes, t->completion_time/1000);
+    }
+    free(order);
+}
+
+static void print_table_profile_at_exit() {
+    if (table_profiling != 2) return;
+    fflush(stdout);  /* the profile follows the output of the program */
+    fprintf(stderr, "%% Table profile:\n");
+    print_table_profile(stderr);
+}
+
+/* c_SET_TABLE_PROFILING_c(Flag): turn profiling off (0), on (1), or on with the profile
+   printed at exit (2). The counters are kept when profiling is turned off. */
+int c_SET_TABLE_PROFILING_c() {
+    BPLONG flag;
+
+    flag = ARG(1, 1); DEREF(flag);
+    if (!ISINT(flag) || INTVAL(flag) < 0 || INTVAL(flag) > 2) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    table_profile_charge();
+    table_profiling = (int)INTVAL(flag);
+    if (table_profiling == 2 && !table_profile_exit_registered) {
+        atexit(print_table_profile_at_exit);
+        table_profile_exit_registered = 1;
+    }
+    return BP_TRUE;
+}
+
+/* c_TABLE_PROFILE_f(Profile): bind Profile to a list of the form
+   [Name/Arity=[subgoals=S,answers=A,hits=H,misses=M,sccs=C,iterations=I,bytes=B,
+   completion_time=T],...], ordered by the bytes charged */
+int c_TABLE_PROFILE_f() {
+    static const char *names[8] = {"subgoals", "answers", "hits", "misses", "sccs", "iterations", "bytes", "completion_time"};
+    BPLONG Profile, list, counters, i, j, arity;
+    BPLONG vals[8];
+    CHAR name[MAX_STR_LEN];
+    BPLONG *order;
+    BPLONG_PTR ptr;
+    SYM_REC_PTR eq_sym_ptr, slash_sym_ptr;
+    TableProfilePtr t;
+
+    Profile = ARG(1, 1);
+    order = collect_table_profile();
+    if (order == NULL) {
+        bp_exception = et_OUT_OF_MEMORY;
+        return BP_ERROR;
+    }
+    if (local_top-heap_top <= 50*num_table_profiles+LARGE_MARGIN) {
+        free(order);
+        bp_exception = et_OUT_OF_MEMORY_STACK;
+        return BP_ERROR;
+    }
+    eq_sym_ptr = insert_sym("=", 1, 2);
+    slash_sym_ptr = insert_sym("/", 1, 2);
+    list = nil_sym;
+    for (i = num_table_profiles-1; i >= 0; i--) {
+        t = table_profiles+order[i];
+        vals[0] = t->subgoals;
+        vals[1] = t->answers;
+        vals[2] = t->hits;
+        vals[3] = t->misses;
+        vals[4] = t->sccs;
+        vals[5] = t->iterations;
+        vals[6] = t->bytes;
+        vals[7] = t->completion_time/1000;  /* in milliseconds */
+        counters = nil_sym;
+        for (j = 7; j >= 0; j--) {
+            ptr = heap_top;
+            heap_top += 5;
+            FOLLOW(ptr) = (BPLONG)eq_sym_ptr;
+            FOLLOW(ptr+1) = ADDTAG(insert_sym(names[j], strlen(names[j]), 0), ATM);
+            FOLLOW(ptr+2) = MAKEINT(vals[j]);
+            FOLLOW(ptr+3) = ADDTAG(ptr, STR);
+            FOLLOW(ptr+4) = counters;
+            counters = ADDTAG(ptr+3, LST);
+        }
+        table_profile_name(t->sym_ptr, name, &arity);
+        ptr = heap_top;
+        heap_top += 8;
+        FOLLOW(ptr) = (BPLONG)slash_sym_ptr;
+        FOLLOW(ptr+1) = ADDTAG(insert_sym(name, strlen(name), 0), ATM);
+        FOLLOW(ptr+2) = MAKEINT(arity);
+        FOLLOW(ptr+3) = (BPLONG)eq_sym_ptr;
+        FOLLOW(ptr+4) = ADDTAG(ptr, STR);
+        FOLLOW(ptr+5) = counters;
+        FOLLOW(ptr+6) = ADDTAG(ptr+3, STR);
+        FOLLOW(ptr+7) = list;
+        list = ADDTAG(ptr+6, LST);
     }
+    free(order);
+    return unify(Profile, list);
+}
+
+/* c_PRINT_TABLE_PROFILE: print the profile, one line for each tabled predicate */
+int c_PRINT_TABLE_PROFILE() {
+    print_table_profile(curr_out);
+    return BP_TRUE;
 }
 
 /********************** ANSWER TABLE *********************/
@@ -1139,6 +2741,7 @@ BPLONG_PTR allocateAnswerTable(BPLONG_PTR first_answer, int arity) {
         return (BPLONG_PTR)BP_ERROR;
     }
     ANSWERTABLE_BUCKET_PTR(answer_table) = (BPLONG)bucket_ptr;
+    if (table_profiling) table_profile_add_bytes((ANSWERTABLE_RECORD_SIZE+InitAnswerTableBucketSize)*(BPLONG)sizeof(BPLONG));
 
     for (i = 0; i < InitAnswerTableBucketSize; i++) {
         FOLLOW(bucket_ptr+i) = (BPLONG)NULL;
@@ -1251,6 +2854,7 @@ void expandAnswerTable(BPLONG_PTR answer_table, int arity) {
     free(old_htable);
     ANSWERTABLE_BUCKET_SIZE(answer_table) = new_htable_size;
     ANSWERTABLE_BUCKET_PTR(answer_table) = (BPLONG)new_htable;
+    if (table_profiling) table_profile_add_bytes((new_htable_size-old_htable_size)*(BPLONG)sizeof(BPLONG));
 }
 
 
@@ -1627,30 +3231,25 @@ int c_SUBGOAL_TABLE_SIZE() {
     return unify(gt_bucket_size, MAKEINT(subgoalTableBucketSize));
 }
 
-BPLONG_PTR lookupSubgoalTableNoCopy(BPLONG_PTR stack_arg_ptr, int arity, SYM_REC_PTR sym_ptr) {
-    BPLONG_PTR entryPtrPtr0, entryPtr, thisEntryPtr;
+/*
+  Look up the subgoal table by comparing the call with the subgoals in place, without
+  copying it. The variables of the call are numbered while it is compared with a subgoal,
+  and unnumbered again if the comparison fails. The last argument is not compared if
+  nt_last_arg is 1. The caller must undo the trailing.
+*/
+static BPLONG_PTR findNumberedSubgoal(BPLONG_PTR stack_arg_ptr, int arity, SYM_REC_PTR sym_ptr, int nt_last_arg) {
+    BPLONG_PTR entryPtr;
     BPLONG_PTR subgoal_arg_ptr;
-    BPLONG term;
-    BPLONG i;
-    BPLONG hcode, this_hcode;
     BPLONG_PTR trail_top0;
     BPLONG initial_diff0;
+    BPLONG i, arity1;
+    BPLONG hcode, this_hcode;
 
-    initial_diff0 = (BPULONG)trail_up_addr-(BPULONG)trail_top;
-
-    /* before numbering the tabled call */
-    PREPARE_NUMBER_TERM(0);
     hcode = ((BPLONG)sym_ptr & HASH_BITS) >> 2;
-    if (arity != 0) {
-        term = FOLLOW(stack_arg_ptr);
-        numberVarTermOpt(term);
-        hcode += bp_hashval(term);
-        //      printf("lookup(ncp) hcode1=%x\n",hcode);
-
+    if (arity != 0) {  /* a variable has the same hash code as a numbered variable */
+        hcode += bp_hashval(FOLLOW(stack_arg_ptr));
         for (i = 1; i < arity; i++) {
-            term = FOLLOW(stack_arg_ptr-i);
-            numberVarTermOpt(term);
-            this_hcode = bp_hashval(term);
+            this_hcode = bp_hashval(FOLLOW(stack_arg_ptr-i));
             if (this_hcode != 0) hcode = MurmurHash3_x86_32_uint32((UW32)this_hcode, (UW32)hcode);
         }
         hcode = (hcode & HASH_BITS);
@@ -1658,25 +3257,39 @@ BPLONG_PTR lookupSubgoalTableNoCopy(BPLONG_PTR stack_arg_ptr, int arity, SYM_REC
 
     //  printf("lookup(ncp) hcode=%x\n",hcode);
 
-    entryPtrPtr0 = subgoalTable + (hcode % subgoalTableBucketSize);
-    entryPtr = (BPLONG_PTR)FOLLOW(entryPtrPtr0);
-
+    initial_diff0 = (BPULONG)trail_up_addr-(BPULONG)trail_top;
+    PREPARE_NUMBER_TERM(0);
+    entryPtr = (BPLONG_PTR)FOLLOW(subgoalTable + (hcode % subgoalTableBucketSize));
+    arity1 = (nt_last_arg == 0) ? arity : arity-1;
     while (entryPtr != NULL) {  /* lookup */
         if ((SYM_REC_PTR)GT_SYM(entryPtr) != sym_ptr) goto lab_fail1;
         subgoal_arg_ptr = GT_ARG_ADDR(entryPtr);
-        for (i = 0; i < arity; i++) {
+        for (i = 0; i < arity1; i++) {
             BPLONG t1, t2;
             t1 = FOLLOW(stack_arg_ptr-i);
             t2 = FOLLOW(subgoal_arg_ptr+i);
             if (t1 != t2 && !unifyNumberedTerms(t1, t2)) goto lab_fail1;
         }
-        thisEntryPtr = entryPtr;
-        goto lookup_end;
+        return entryPtr;
     lab_fail1:
+        if (global_var_num != 0) {
+            trail_top0 = (BPLONG_PTR)((BPULONG)trail_up_addr-initial_diff0);
+            UNDO_TRAILING;
+            PREPARE_NUMBER_TERM(0);
+        }
         entryPtr = (BPLONG_PTR)GT_NEXT(entryPtr);
     }
-    thisEntryPtr = NULL;
-lookup_end:
+    return NULL;
+}
+
+BPLONG_PTR lookupSubgoalTableNoCopy(BPLONG_PTR stack_arg_ptr, int arity, SYM_REC_PTR sym_ptr) {
+    BPLONG_PTR thisEntryPtr;
+    BPLONG_PTR trail_top0;
+    BPLONG initial_diff0;
+
+    initial_diff0 = (BPULONG)trail_up_addr-(BPULONG)trail_top;
+    thisEntryPtr = findNumberedSubgoal(stack_arg_ptr, arity, sym_ptr, 0);
+
     trail_top0 = (BPLONG_PTR)((BPULONG)trail_up_addr-initial_diff0);
     UNDO_TRAILING;
     return thisEntryPtr;
@@ -2112,26 +3725,44 @@ void reset_temp_complete_subgoal_entries() {
 
 */
 
-/*  defined in basic.h, also see global_maps in assert.c
-
-    #define NUM_PICAT_TABLE_MAPS 97
-
-    typedef struct {
-    BPLONG key;
-    BPLONG val;
-    BPLONG_PTR next;
-    } KEY_VAL_PAIR;
-
-    typedef KEY_VAL_PAIR *KEY_VAL_PAIR_PTR;
+/*  KEY_VAL_PAIR, CLOCK_KEY_VAL_PAIR and MAP_RECORD are defined in basic.h,
+    also see global_maps in assert.c
+
+    A table map normally keeps its keys and values in the table area, where they
+    are hash-consed and stay until the table area is initialized. Once a capacity
+    is set for a map, its keys and values are copied into the program area instead,
+    and each entry is a CLOCK_KEY_VAL_PAIR allocated by malloc, so that an entry
+    can be released individually. When a new key is put into a map that holds
+    capacity entries, an entry is evicted by the CLOCK algorithm: the hand sweeps
+    the buckets, clears the reference bit of each entry that has been looked up
+    since the hand last passed it, and evicts the first entry whose bit is clear.
+*/
 
-    typedef struct {
-    BPLONG size;
-    BPLONG count;
-    BPLONG_PTR htable;
-    } MAP_RECORD;
+/* release the bucket tables of the table maps, and the entries of the maps that
+   live in the program area */
+void release_picat_table_maps() {
+    BPLONG i, j;
+    MAP_RECORD_PTR mr_ptr;
+    CLOCK_KEY_VAL_PAIR_PTR kvp_ptr, next_kvp_ptr;
 
-    typedef MAP_RECORD *MAP_RECORD_PTR;
-*/
+    for (i = 0; i < NUM_PICAT_TABLE_MAPS; i++) {
+        mr_ptr = (MAP_RECORD_PTR)picat_table_maps[i];
+        if (mr_ptr == NULL) continue;
+        if (mr_ptr->in_parea) {
+            for (j = 0; j < mr_ptr->size; j++) {
+                kvp_ptr = (CLOCK_KEY_VAL_PAIR_PTR)FOLLOW(mr_ptr->htable+j);
+                while (kvp_ptr != NULL) {
+                    next_kvp_ptr = (CLOCK_KEY_VAL_PAIR_PTR)kvp_ptr->next;
+                    release_term_space(kvp_ptr->key);
+                    release_term_space(kvp_ptr->val);
+                    free(kvp_ptr);
+                    kvp_ptr = next_kvp_ptr;
+                }
+            }
+        }
+        free(mr_ptr->htable);
+    }
+}
 
 void init_picat_table_maps() {
     BPLONG i;
@@ -2180,6 +3811,10 @@ int b_GET_PICAT_TABLE_MAP_cf(BPLONG map_id, BPLONG map_num) {
     map_ptr = (MAP_RECORD_PTR)tmp_ptr;
     map_ptr->count = 0;
     map_ptr->size = 7;  // initial size
+    map_ptr->capacity = 0;
+    map_ptr->in_parea = 0;
+    map_ptr->hand = 0;
+    map_ptr->hits = map_ptr->misses = map_ptr->evictions = 0;
     tmp_ptr = (BPLONG_PTR)malloc(7*sizeof(BPLONG_PTR));
     map_ptr->htable = tmp_ptr;
     for (i = 0; i < 7; i++)
@@ -2237,8 +3872,218 @@ void expand_picat_table_map(MAP_RECORD_PTR mr_ptr) {
     free(old_htable);
     mr_ptr->size = new_htable_size;
     mr_ptr->htable = new_htable;
+    mr_ptr->hand = 0;
+}
+
+/* Move the clock hand until it reaches an entry whose reference bit is clear,
+   clearing the bits it passes, and remove that entry from the map. */
+static void evict_picat_table_map_entry(MAP_RECORD_PTR mr_ptr) {
+    BPLONG_PTR kvp_ptr_ptr;
+    CLOCK_KEY_VAL_PAIR_PTR kvp_ptr;
+
+    if (mr_ptr->count == 0) return;
+    for (;;) {
+        kvp_ptr_ptr = mr_ptr->htable+mr_ptr->hand;
+        while ((kvp_ptr = (CLOCK_KEY_VAL_PAIR_PTR)FOLLOW(kvp_ptr_ptr)) != NULL) {
+            if (kvp_ptr->ref) {
+                kvp_ptr->ref = 0;  /* second chance */
+                kvp_ptr_ptr = (BPLONG_PTR)&kvp_ptr->next;
+            } else {
+                FOLLOW(kvp_ptr_ptr) = (BPLONG)kvp_ptr->next;
+                release_term_space(kvp_ptr->key);
+                release_term_space(kvp_ptr->val);
+                free(kvp_ptr);
+                mr_ptr->count--;
+                mr_ptr->evictions++;
+                return;
+            }
+        }
+        mr_ptr->hand++;
+        if (mr_ptr->hand == mr_ptr->size) mr_ptr->hand = 0;
+    }
+}
+
+/* Copy the entries of a map from the table area into the program area. The
+   entries stay in their buckets because a key has the same hash code in both
+   areas. The old entries are left in the table area. */
+static int move_picat_table_map_to_parea(MAP_RECORD_PTR mr_ptr) {
+    BPLONG i, key, val, key_cp, val_cp, varno, initial_diff0;
+    BPLONG_PTR trail_top0, heap_top0;
+    KEY_VAL_PAIR_PTR kvp_ptr;
+    CLOCK_KEY_VAL_PAIR_PTR new_kvp_ptr, chain;
+
+    for (i = 0; i < mr_ptr->size; i++) {
+        kvp_ptr = (KEY_VAL_PAIR_PTR)FOLLOW(mr_ptr->htable+i);
+        chain = NULL;
+        while (kvp_ptr != NULL) {
+            heap_top0 = heap_top;
+            initial_diff0 = (BPULONG)trail_up_addr-(BPULONG)trail_top;
+            PREPARE_UNNUMBER_TERM(local_top);
+            key = unnumberVarTabledTerm(kvp_ptr->key);
+            PREPARE_UNNUMBER_TERM(local_top);
+            val = unnumberVarTabledTerm(kvp_ptr->val);
+            varno = 0;
+            key_cp = numberVarCopyToParea(key, &varno);
+            if (key_cp == BP_ERROR) return BP_ERROR;
+            varno = 0;
+            val_cp = numberVarCopyToParea(val, &varno);
+            if (val_cp == BP_ERROR) return BP_ERROR;
+            trail_top0 = (BPLONG_PTR)((BPULONG)trail_up_addr-initial_diff0);
+            UNDO_TRAILING;
+            heap_top = heap_top0;
+
+            new_kvp_ptr = (CLOCK_KEY_VAL_PAIR_PTR)malloc(sizeof(CLOCK_KEY_VAL_PAIR));
+            if (new_kvp_ptr == NULL) myquit(OUT_OF_MEMORY, "table_maps");
+            new_kvp_ptr->key = key_cp;
+            new_kvp_ptr->val = val_cp;
+            new_kvp_ptr->ref = 0;
+            new_kvp_ptr->next = (BPLONG_PTR)chain;
+            chain = new_kvp_ptr;
+            kvp_ptr = (KEY_VAL_PAIR_PTR)kvp_ptr->next;
+        }
+        FOLLOW(mr_ptr->htable+i) = (BPLONG)chain;
+    }
+    mr_ptr->in_parea = 1;
+    return BP_TRUE;
+}
+
+/* the number of the table map Map, which is a $thshtb(MapNum,_) term */
+static BPLONG picat_table_map_num(BPLONG map) {
+    BPLONG_PTR ptr;
+    BPLONG map_num;
+
+    DEREF(map);
+    if (!ISSTRUCT(map)) return -1;
+    ptr = (BPLONG_PTR)UNTAGGED_ADDR(map);
+    if ((SYM_REC_PTR)FOLLOW(ptr) != thashtable_psc) return -1;
+    map_num = FOLLOW(ptr+1);
+    DEREF(map_num);
+    if (!ISINT(map_num)) return -1;
+    map_num = INTVAL(map_num);
+    if (map_num < 0 || map_num >= NUM_PICAT_TABLE_MAPS || picat_table_maps[map_num] == NULL) return -1;
+    return map_num;
+}
+
+/* c_PICAT_TABLE_MAP_SET_CAPACITY_cc(Map,Capacity): limit Map to Capacity entries,
+   evicting entries if it holds more. A capacity of 0 removes the limit, but the
+   entries of the map stay in the program area. */
+int c_PICAT_TABLE_MAP_SET_CAPACITY_cc() {
+    BPLONG map, capacity, map_num;
+    MAP_RECORD_PTR mr_ptr;
+
+    map = ARG(1, 2);
+    capacity = ARG(2, 2);
+    map_num = picat_table_map_num(map);
+    DEREF(capacity);
+    if (map_num < 0 || !ISINT(capacity) || INTVAL(capacity) < 0) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    mr_ptr = (MAP_RECORD_PTR)picat_table_maps[map_num];
+    capacity = INTVAL(capacity);
+    if (capacity > 0 && !mr_ptr->in_parea) {
+        if (move_picat_table_map_to_parea(mr_ptr) == BP_ERROR) return BP_ERROR;
+    }
+    mr_ptr->capacity = capacity;
+    if (capacity > 0) {
+        while (mr_ptr->count > capacity) {
+            evict_picat_table_map_entry(mr_ptr);
+        }
+    }
+    return BP_TRUE;
+}
+
+/* c_PICAT_TABLE_MAP_STATISTICS_cf(Map,Stats): Stats is
+   [size=Size,capacity=Capacity,hits=Hits,misses=Misses,evictions=Evictions] */
+int c_PICAT_TABLE_MAP_STATISTICS_cf() {
+    BPLONG map, stats, map_num, lst, pair, i;
+    BPLONG items[5];
+    char *names[5] = {"size", "capacity", "hits", "misses", "evictions"};
+    MAP_RECORD_PTR mr_ptr;
+
+    map = ARG(1, 2);
+    stats = ARG(2, 2);
+    map_num = picat_table_map_num(map);
+    if (map_num < 0) {
+        bp_exception = illegal_arguments;
+        return BP_ERROR;
+    }
+    mr_ptr = (MAP_RECORD_PTR)picat_table_maps[map_num];
+    items[0] = mr_ptr->count;
+    items[1] = mr_ptr->capacity;
+    items[2] = mr_ptr->hits;
+    items[3] = mr_ptr->misses;
+    items[4] = mr_ptr->evictions;
+
+    lst = nil_sym;
+    for (i = 4; i >= 0; i--) {
+        pair = ADDTAG(heap_top, STR);
+        FOLLOW(heap_top++) = (BPLONG)equal_psc;
+        FOLLOW(heap_top++) = ADDTAG(insert_sym(names[i], strlen(names[i]), 0), ATM);
+        FOLLOW(heap_top++) = MAKEINT(items[i]);
+        FOLLOW(heap_top) = pair;
+        FOLLOW(heap_top+1) = lst;
+        lst = ADDTAG(heap_top, LST);
+        heap_top += 2;
+    }
+    LOCAL_OVERFLOW_CHECK("table");
+    return unify(lst, stats);
+}
+
+/* put for a table map whose entries are in the program area; the copying follows
+   b_PICAT_GLOBAL_MAP_PUT_ccc */
+static int picat_table_map_parea_put(MAP_RECORD_PTR mr_ptr, BPLONG key, BPLONG val) {
+    BPLONG key_cp, val_cp, varno, initial_diff0;
+    BPLONG_PTR trail_top0, kvp_ptr_ptr;
+    CLOCK_KEY_VAL_PAIR_PTR kvp_ptr;
+
+    initial_diff0 = (BPULONG)trail_up_addr-(BPULONG)trail_top;
+    varno = 0;
+    val_cp = numberVarCopyToParea(val, &varno);
+    if (val_cp == BP_ERROR) return BP_ERROR;
+
+    kvp_ptr = (CLOCK_KEY_VAL_PAIR_PTR)FOLLOW(mr_ptr->htable + (bp_hashval(key) % mr_ptr->size));
+    while (kvp_ptr != NULL) {  /* lookup */
+        if (!key_identical(kvp_ptr->key, key)) {
+            kvp_ptr = (CLOCK_KEY_VAL_PAIR_PTR)kvp_ptr->next;
+        } else {
+            release_term_space(kvp_ptr->val);
+            kvp_ptr->val = val_cp;  /* update */
+            kvp_ptr->ref = 1;
+            goto lookup_end;
+        }
+    }
+    // come here if lookup failed
+    if (mr_ptr->capacity > 0 && mr_ptr->count >= mr_ptr->capacity)
+        evict_picat_table_map_entry(mr_ptr);
+
+    varno = 0;
+    key_cp = numberVarCopyToParea(key, &varno);
+    if (key_cp == BP_ERROR) return BP_ERROR;
+
+    kvp_ptr = (CLOCK_KEY_VAL_PAIR_PTR)malloc(sizeof(CLOCK_KEY_VAL_PAIR));
+    if (kvp_ptr == NULL) myquit(OUT_OF_MEMORY, "table_maps");
+    kvp_ptr_ptr = (BPLONG_PTR)(mr_ptr->htable + (bp_hashval(key) % mr_ptr->size));
+    kvp_ptr->key = key_cp;
+    kvp_ptr->val = val_cp;
+    kvp_ptr->ref = 0;  /* a new entry is not protected until it is used again */
+    kvp_ptr->next = (BPLONG_PTR)FOLLOW(kvp_ptr_ptr);
+    FOLLOW(kvp_ptr_ptr) = (BPLONG)kvp_ptr;
+
+    mr_ptr->count++;
+    if (2*mr_ptr->count > mr_ptr->size)
+        expand_picat_table_map(mr_ptr);
+
+lookup_end:
+    trail_top0 = (BPLONG_PTR)((BPULONG)trail_up_addr-initial_diff0);
+    UNDO_TRAILING;
+    return BP_TRUE;
 }
 
+/* turn a key or value of a table map into a term on the heap */
+#define UNNUMBER_TABLE_MAP_TERM(mr_ptr, term)                           \
+    ((mr_ptr)->in_parea ? unnumberVarTermOpt(term) : unnumberVarTabledTerm(term))
+
 int b_PICAT_TABLE_MAP_PUT_ccc(BPLONG map_num, BPLONG key, BPLONG val) {
     BPLONG i, key_cp, val_cp, this_hcode, this_ground_flag, dummy_hcode, dummy_ground_flag;
     BPLONG_PTR trail_top0, tmp_ptr, kvp_ptr_ptr;
@@ -2255,6 +4100,7 @@ int b_PICAT_TABLE_MAP_PUT_ccc(BPLONG map_num, BPLONG key, BPLONG val) {
     map_num = INTVAL(map_num);
 
     mr_ptr = (MAP_RECORD_PTR)picat_table_maps[map_num];
+    if (mr_ptr->in_parea) return picat_table_map_parea_put(mr_ptr, key, val);
 
     initial_diff0 = (BPULONG)trail_up_addr-(BPULONG)trail_top;
     PREPARE_NUMBER_TERM(0);
@@ -2319,10 +4165,13 @@ int b_PICAT_TABLE_MAP_GET_ccf(BPLONG map_num, BPLONG key, BPLONG val) {
         if (kvp_ptr->key != key && !key_identical(kvp_ptr->key, key)) {
             kvp_ptr = (KEY_VAL_PAIR_PTR)kvp_ptr->next;
         } else {
+            mr_ptr->hits++;
+            if (mr_ptr->in_parea) ((CLOCK_KEY_VAL_PAIR_PTR)kvp_ptr)->ref = 1;
             PREPARE_UNNUMBER_TERM(local_top);
-            return unify(val, unnumberVarTabledTerm(kvp_ptr->val));
+            return unify(val, UNNUMBER_TABLE_MAP_TERM(mr_ptr, kvp_ptr->val));
         }
     }
+    mr_ptr->misses++;
     return BP_FALSE;
 }
 
@@ -2346,6 +4195,16 @@ int b_PICAT_TABLE_MAP_CLEAR_c(BPLONG map_num) {
     mr_ptr-> count = 0;
     htable = mr_ptr->htable;
     for (i = 0; i < mr_ptr->size; i++) {
+        if (mr_ptr->in_parea) {
+            CLOCK_KEY_VAL_PAIR_PTR kvp_ptr = (CLOCK_KEY_VAL_PAIR_PTR)FOLLOW(htable+i);
+            while (kvp_ptr != NULL) {
+                CLOCK_KEY_VAL_PAIR_PTR next_kvp_ptr = (CLOCK_KEY_VAL_PAIR_PTR)kvp_ptr->next;
+                release_term_space(kvp_ptr->key);
+                release_term_space(kvp_ptr->val);
+                free(kvp_ptr);
+                kvp_ptr = next_kvp_ptr;
+            }
+        }
         FOLLOW(htable+i) = (BPLONG)NULL;
     }
     return BP_TRUE;
@@ -2368,7 +4227,7 @@ int b_PICAT_TABLE_MAP_KEYS_cf(BPLONG map_num, BPLONG keys) {
 
         while (kvp_ptr != NULL) {  /* lookup */
             PREPARE_UNNUMBER_TERM(local_top);
-            key = unnumberVarTabledTerm(kvp_ptr->key);
+            key = UNNUMBER_TABLE_MAP_TERM(mr_ptr, kvp_ptr->key);
             FOLLOW(heap_top) = key;
             FOLLOW(heap_top+1) = lst;
             lst = ADDTAG(heap_top, LST);
@@ -2397,7 +4256,7 @@ int b_PICAT_TABLE_MAP_VALS_cf(BPLONG map_num, BPLONG vals) {
 
         while (kvp_ptr != NULL) {  /* lookup */
             PREPARE_UNNUMBER_TERM(local_top);
-            val = unnumberVarTabledTerm(kvp_ptr->val);
+            val = UNNUMBER_TABLE_MAP_TERM(mr_ptr, kvp_ptr->val);
             FOLLOW(heap_top) = val;
             FOLLOW(heap_top+1) = lst;
             lst = ADDTAG(heap_top, LST);
@@ -2427,9 +4286,9 @@ int b_PICAT_TABLE_MAP_LIST_cf(BPLONG map_num, BPLONG pairs) {
 
         while (kvp_ptr != NULL) {  /* lookup */
             PREPARE_UNNUMBER_TERM(local_top);
-            key = unnumberVarTabledTerm(kvp_ptr->key);
+            key = UNNUMBER_TABLE_MAP_TERM(mr_ptr, kvp_ptr->key);
             PREPARE_UNNUMBER_TERM(local_top);
-            val = unnumberVarTabledTerm(kvp_ptr->val);
+            val = UNNUMBER_TABLE_MAP_TERM(mr_ptr, kvp_ptr->val);
             pair = ADDTAG(heap_top, STR);
             FOLLOW(heap_top++) = (BPLONG)equal_psc;
             FOLLOW(heap_top++) = key;
@@ -2444,3 +4303,498 @@ int b_PICAT_TABLE_MAP_LIST_cf(BPLONG map_num, BPLONG pairs) {
     }
     return unify(lst, pairs);
 }
+
+/****************** TABLE AREA GARBAGE COLLECTION *******************/
+/* Garbage builds up in the table area from three sources:
+   - answers that mode-directed tables replaced with better ones;
+   - values that were overwritten in table maps;
+   - subgoals that abolish_table or incremental tabling removed.
+   The collector copies everything reachable from the subgoal table, the
+   table maps, and the dependents lists of incremental predicates into new
+   blocks, and rebuilds gterms_htable along the way. It then frees the old
+   blocks.
+
+   Frames of tabled calls hold untagged pointers to subgoal entries and
+   answers, so the collector only runs when no table frame is live.
+
+   unnumberVarTabledTerm shares ground terms in the table area with the heap.
+   The heap, the stack, and the trail are therefore scanned for pointers into
+   the table area. An old block is kept, and not freed, when it holds a term
+   that is referenced from there, either directly or as a subterm of a
+   referenced ground term. Such a block is collected again once nothing
+   refers to it.
+
+   The collector is skipped when more than one engine exists, because the
+   areas of the other engines are not scanned.
+
+   The check in table_allocate starts a collection once the area has grown
+   by as many blocks as it had after the last collection, and by at least
+   TABLE_AREA_GC_MIN_BLOCKS. At that point at least half of the area may be
+   garbage. */
+#define TA_GC_WORDS(type) ((sizeof(type)+sizeof(BPLONG)-1)/sizeof(BPLONG))
+#define TA_GC_IS_GROUND_HEADER(w) (((BPULONG)(w) & ~(BPULONG)(TOP_BIT | HASH_BITS)) == 0 && ((w) & TOP_BIT))
+
+static BPLONG num_table_area_gcs = 0;
+
+typedef struct {
+    BPLONG_PTR low_addr;
+    int pinned;
+} TA_GC_BLOCK;
+
+static TA_GC_BLOCK *ta_gc_blocks;  /* the old blocks, sorted by address */
+static BPLONG ta_gc_num_blocks;
+static BPLONG_PTR ta_gc_min_addr, ta_gc_max_addr;
+static TABLE_ADDR_MAP ta_gc_fwd;  /* forwarding addresses of the copied objects */
+static TABLE_ADDR_MAP ta_gc_visited;  /* terms visited while blocks are pinned */
+static TABLE_ADDR_MAP ta_gc_dependents;  /* the dependents lists of the copied subgoal entries */
+static NUMBERED_TERM_AREA_RECORD ta_gc_to_record;  /* the new blocks */
+static GTERMS_HTABLE ta_gc_to_gterms_htable;
+static BPLONG_PTR *ta_gc_worklist;  /* copied subgoal entries whose links are not copied yet */
+static BPLONG ta_gc_worklist_count, ta_gc_worklist_capacity;
+static BPLONG *ta_gc_pin_stack;
+static BPLONG ta_gc_pin_stack_count, ta_gc_pin_stack_capacity;
+
+int table_area_num_gcs() {
+    return num_table_area_gcs;
+}
+
+static int ta_gc_compare_blocks(const void *b1, const void *b2) {
+    BPLONG_PTR p1 = ((TA_GC_BLOCK *)b1)->low_addr, p2 = ((TA_GC_BLOCK *)b2)->low_addr;
+    return (p1 < p2) ? -1 : ((p1 > p2) ? 1 : 0);
+}
+
+/* the old block that contains ptr, or NULL */
+static TA_GC_BLOCK *ta_gc_block_of(BPLONG_PTR ptr) {
+    BPLONG lo, hi, mid;
+
+    if (ptr < ta_gc_min_addr || ptr >= ta_gc_max_addr) return NULL;
+    lo = 0;
+    hi = ta_gc_num_blocks-1;
+    while (lo <= hi) {
+        mid = (lo+hi)/2;
+        if (ptr < ta_gc_blocks[mid].low_addr) {
+            hi = mid-1;
+        } else if (ptr >= ta_gc_blocks[mid].low_addr+NUMBERED_TERM_BLOCK_SIZE) {
+            lo = mid+1;
+        } else {
+            return &ta_gc_blocks[mid];
+        }
+    }
+    return NULL;
+}
+
+static void ta_gc_push_pin(BPLONG term) {
+    if (ta_gc_pin_stack_count == ta_gc_pin_stack_capacity) {
+        BPLONG new_capacity = (ta_gc_pin_stack_capacity == 0) ? 1024 : 2*ta_gc_pin_stack_capacity;
+        BPLONG *ptr = (BPLONG *)realloc(ta_gc_pin_stack, new_capacity*sizeof(BPLONG));
+        if (ptr == NULL) {
+            myquit(OUT_OF_MEMORY, "tg");
+        }
+        ta_gc_pin_stack = ptr;
+        ta_gc_pin_stack_capacity = new_capacity;
+    }
+    ta_gc_pin_stack[ta_gc_pin_stack_count++] = term;
+}
+
+/* Pin the block that word points to. If word is a ground term in the table
+   area, also pin the blocks of its subterms. */
+static void ta_gc_pin(BPLONG word) {
+    BPLONG term;
+    BPLONG_PTR ptr;
+    TA_GC_BLOCK *block_ptr;
+    BPLONG i, arity;
+
+    ta_gc_push_pin(word);
+    while (ta_gc_pin_stack_count > 0) {
+        term = ta_gc_pin_stack[--ta_gc_pin_stack_count];
+        ptr = (BPLONG_PTR)UNTAGGED_ADDR(term);
+        block_ptr = ta_gc_block_of(ptr);
+        if (block_ptr == NULL) continue;
+        block_ptr->pinned = 1;
+        if (!ISLIST(term) && !ISSTRUCT(term)) continue;
+        if (ptr < block_ptr->low_addr+3 || !TA_GC_IS_GROUND_HEADER(FOLLOW(ptr-2))) continue;
+        if (table_addr_map_get(&ta_gc_visited, ptr) != NULL) continue;
+        table_addr_map_put(&ta_gc_visited, ptr, ptr);
+        if (ISLIST(term)) {
+            for (i = 0; i < 2; i++) {
+                if (ISLIST(FOLLOW(ptr+i)) || ISSTRUCT(FOLLOW(ptr+i))) ta_gc_push_pin(FOLLOW(ptr+i));
+            }
+        } else {
+            arity = GET_ARITY((SYM_REC_PTR)FOLLOW(ptr));
+            for (i = 1; i <= arity; i++) {
+                if (ISLIST(FOLLOW(ptr+i)) || ISSTRUCT(FOLLOW(ptr+i))) ta_gc_push_pin(FOLLOW(ptr+i));
+            }
+        }
+    }
+}
+
+static void ta_gc_pin_area(BPLONG_PTR from, BPLONG_PTR to) {
+    BPLONG_PTR ptr, addr;
+    BPLONG word;
+
+    for (ptr = from; ptr < to; ptr++) {
+        word = FOLLOW(ptr);
+        if (TAG(word) == ATM) continue;
+        addr = (BPLONG_PTR)UNTAGGED_ADDR(word);
+        if (addr >= ta_gc_min_addr && addr < ta_gc_max_addr) ta_gc_pin(word);
+    }
+}
+
+static BPLONG_PTR ta_gc_allocate(BPLONG size) {
+    BPLONG_PTR ptr;
+    NUMBERED_TERM_AREA_RECORD_PTR to_record_ptr = &ta_gc_to_record;
+
+    ALLOCATE_FROM_NUMBERED_TERM_AREA(to_record_ptr, ptr, size);
+    if (ptr == NULL) {
+        myquit(OUT_OF_MEMORY, "tg");
+    }
+    return ptr;
+}
+
+/* Every compound term in the table area is preceded by a hash code and a link in
+   gterms_htable. A ground copy goes into the new gterms_htable. The terms in the old
+   table are distinct, and so are their copies, so no comparison is needed. */
+static BPLONG_PTR ta_gc_new_compound(BPLONG_PTR ptr, BPLONG size, BPLONG tag) {
+    BPLONG_PTR new_ptr, slot_addr;
+    GTERMS_HTABLE_PTR htable_ptr = &ta_gc_to_gterms_htable;
+
+    new_ptr = ta_gc_allocate(size+2)+2;
+    FOLLOW(new_ptr-2) = FOLLOW(ptr-2);
+    FOLLOW(new_ptr-1) = (BPLONG)NULL;
+    table_addr_map_put(&ta_gc_fwd, ptr, new_ptr);
+    if (FOLLOW(new_ptr-2) & TOP_BIT) {
+        slot_addr = htable_ptr->htable + (FOLLOW(new_ptr-2) & HASH_BITS)%htable_ptr->size;
+        FOLLOW(new_ptr-1) = FOLLOW(slot_addr);
+        FOLLOW(slot_addr) = ADDTAG(new_ptr, tag);
+        htable_ptr->count++;
+        if (2*htable_ptr->count > htable_ptr->size) {
+            expand_gterms_htable(htable_ptr);
+        }
+    }
+    return new_ptr;
+}
+
+/* copy a term in the table area; lists are copied iteratively */
+static BPLONG ta_gc_copy_term(BPLONG term) {
+    BPLONG_PTR ptr, new_ptr, dest_ptr;
+    BPLONG result, i, arity;
+
+    dest_ptr = &result;
+    while (ISLIST(term)) {
+        ptr = (BPLONG_PTR)UNTAGGED_ADDR(term);
+        if (ta_gc_block_of(ptr) == NULL) {
+            FOLLOW(dest_ptr) = term;
+            return result;
+        }
+        new_ptr = table_addr_map_get(&ta_gc_fwd, ptr);
+        if (new_ptr != NULL) {
+            FOLLOW(dest_ptr) = ADDTAG(new_ptr, LST);
+            return result;
+        }
+        new_ptr = ta_gc_new_compound(ptr, 2, LST);
+        FOLLOW(dest_ptr) = ADDTAG(new_ptr, LST);
+        FOLLOW(new_ptr) = ta_gc_copy_term(FOLLOW(ptr));
+        dest_ptr = new_ptr+1;
+        term = FOLLOW(ptr+1);
+    }
+    if (ISSTRUCT(term)) {
+        ptr = (BPLONG_PTR)UNTAGGED_ADDR(term);
+        if (ta_gc_block_of(ptr) != NULL) {
+            new_ptr = table_addr_map_get(&ta_gc_fwd, ptr);
+            if (new_ptr == NULL) {
+                arity = GET_ARITY((SYM_REC_PTR)FOLLOW(ptr));
+                new_ptr = ta_gc_new_compound(ptr, arity+1, STR);
+                FOLLOW(new_ptr) = FOLLOW(ptr);
+                for (i = 1; i <= arity; i++) {
+                    FOLLOW(new_ptr+i) = ta_gc_copy_term(FOLLOW(ptr+i));
+                }
+            }
+            term = ADDTAG(new_ptr, STR);
+        }
+    }
+    FOLLOW(dest_ptr) = term;
+    return result;
+}
+
+static BPLONG_PTR ta_gc_copy_answer(BPLONG_PTR answer, BPLONG arity) {
+    BPLONG_PTR new_answer;
+    BPLONG i;
+
+    new_answer = ta_gc_allocate(arity+2);
+    table_addr_map_put(&ta_gc_fwd, answer, new_answer);
+    ANSWER_NEXT_IN_TABLE(new_answer) = (BPLONG)NULL;
+    ANSWER_NEXT_IN_CHAIN(new_answer) = (BPLONG)NULL;
+    for (i = 0; i < arity; i++) {
+        FOLLOW(ANSWER_ARG_ADDR(new_answer)+i) = ta_gc_copy_term(FOLLOW(ANSWER_ARG_ADDR(answer)+i));
+    }
+    return new_answer;
+}
+
+/* copy the answers of a subgoal; an answer table is updated in place, keeping the
+   order of the answers and of the hash chains */
+static BPLONG ta_gc_copy_answers(BPLONG answer_table, BPLONG arity) {
+    BPLONG_PTR answer, new_answer, prev_answer, bucket_ptr, entry_addr;
+    BPLONG i;
+
+    if (answer_table == (BPLONG)NULL) return answer_table;
+    if (answer_table & 0x1) {  /* only one answer */
+        return (BPLONG)ta_gc_copy_answer((BPLONG_PTR)UNTAGGED_ADDR(answer_table), arity) | 0x1;
+    }
+    prev_answer = NULL;
+    answer = (BPLONG_PTR)ANSWERTABLE_FIRST(answer_table);
+    while (answer != NULL) {
+        new_answer = ta_gc_copy_answer(answer, arity);
+        if (prev_answer == NULL) {
+            ANSWERTABLE_FIRST(answer_table) = (BPLONG)new_answer;
+        } else {
+            ANSWER_NEXT_IN_TABLE(prev_answer) = (BPLONG)new_answer;
+        }
+        prev_answer = new_answer;
+        answer = (BPLONG_PTR)ANSWER_NEXT_IN_TABLE(answer);
+    }
+    ANSWERTABLE_LAST(answer_table) = (BPLONG)prev_answer;
+    bucket_ptr = (BPLONG_PTR)ANSWERTABLE_BUCKET_PTR(answer_table);
+    for (i = 0; i < ANSWERTABLE_BUCKET_SIZE(answer_table); i++) {
+        entry_addr = bucket_ptr+i;
+        answer = (BPLONG_PTR)FOLLOW(entry_addr);
+        while (answer != NULL) {
+            new_answer = table_addr_map_get(&ta_gc_fwd, answer);
+            if (new_answer == NULL) new_answer = ta_gc_copy_answer(answer, arity);
+            FOLLOW(entry_addr) = (BPLONG)new_answer;
+            entry_addr = ANSWER_NEXT_IN_CHAIN_ADDR(new_answer);
+            answer = (BPLONG_PTR)ANSWER_NEXT_IN_CHAIN(answer);
+        }
+        FOLLOW(entry_addr) = (BPLONG)NULL;
+    }
+    return answer_table;
+}
+
+/* Copy a subgoal entry, but not the entries that its SCC_ROOT and SCC_ELMS
+   slots and its dependents list refer to. The copy is put on the worklist so
+   that those are copied later, without deep recursion. Until then, the copy is
+   mapped to the old dependents list in ta_gc_dependents. */
+static BPLONG_PTR ta_gc_copy_subgoal(BPLONG_PTR subgoal_entry) {
+    BPLONG_PTR new_entry, list_ptr;
+    BPLONG i, arity;
+
+    if (subgoal_entry == NULL) return NULL;
+    new_entry = table_addr_map_get(&ta_gc_fwd, subgoal_entry);
+    if (new_entry != NULL) return new_entry;
+    arity = GET_ARITY((SYM_REC_PTR)GT_SYM(subgoal_entry));
+    new_entry = ta_gc_allocate(GT_RECORD_SIZE+arity);
+    table_addr_map_put(&ta_gc_fwd, subgoal_entry, new_entry);
+    GT_NEXT(new_entry) = (BPLONG)NULL;
+    GT_STATE(new_entry) = GT_STATE(subgoal_entry);
+    GT_TOP_AR(new_entry) = GT_TOP_AR(subgoal_entry);
+    GT_SYM(new_entry) = GT_SYM(subgoal_entry);
+    GT_SCC_ROOT(new_entry) = GT_SCC_ROOT(subgoal_entry);
+    GT_SCC_ELMS(new_entry) = GT_SCC_ELMS(subgoal_entry);
+    list_ptr = SUBGOAL_DEPENDENTS(subgoal_entry);
+    if (list_ptr != NULL) table_addr_map_put(&ta_gc_dependents, new_entry, list_ptr);
+    for (i = 0; i < arity; i++) {
+        FOLLOW(GT_ARG_ADDR(new_entry)+i) = ta_gc_copy_term(FOLLOW(GT_ARG_ADDR(subgoal_entry)+i));
+    }
+    GT_ANSWER_TABLE(new_entry) = ta_gc_copy_answers(GT_ANSWER_TABLE(subgoal_entry), arity);
+
+    if (ta_gc_worklist_count == ta_gc_worklist_capacity) {
+        BPLONG new_capacity = (ta_gc_worklist_capacity == 0) ? 1024 : 2*ta_gc_worklist_capacity;
+        BPLONG_PTR *ptr = (BPLONG_PTR *)realloc(ta_gc_worklist, new_capacity*sizeof(BPLONG_PTR));
+        if (ptr == NULL) {
+            myquit(OUT_OF_MEMORY, "tg");
+        }
+        ta_gc_worklist = ptr;
+        ta_gc_worklist_capacity = new_capacity;
+    }
+    ta_gc_worklist[ta_gc_worklist_count++] = new_entry;
+    return new_entry;
+}
+
+/* copy a list of cells [subgoal,next] */
+static BPLONG_PTR ta_gc_copy_subgoal_list(BPLONG_PTR list_ptr) {
+    BPLONG_PTR new_list, cell_ptr, prev_cell_ptr;
+
+    new_list = prev_cell_ptr = NULL;
+    while (list_ptr != NULL) {
+        cell_ptr = ta_gc_allocate(2);
+        FOLLOW(cell_ptr) = (BPLONG)ta_gc_copy_subgoal((BPLONG_PTR)FOLLOW(list_ptr));
+        FOLLOW(cell_ptr+1) = (BPLONG)NULL;
+        if (prev_cell_ptr == NULL) {
+            new_list = cell_ptr;
+        } else {
+            FOLLOW(prev_cell_ptr+1) = (BPLONG)cell_ptr;
+        }
+        prev_cell_ptr = cell_ptr;
+        list_ptr = (BPLONG_PTR)FOLLOW(list_ptr+1);
+    }
+    return new_list;
+}
+
+static void ta_gc_process_worklist() {
+    BPLONG_PTR new_entry, list_ptr;
+
+    while (ta_gc_worklist_count > 0) {
+        new_entry = ta_gc_worklist[--ta_gc_worklist_count];
+        GT_SCC_ROOT(new_entry) = (BPLONG)ta_gc_copy_subgoal((BPLONG_PTR)GT_SCC_ROOT(new_entry));
+        if (GT_TOP_AR(new_entry) == SUBGOAL_COMPLETE) {
+            GT_SCC_ELMS(new_entry) = (BPLONG)NULL;  /* the cells were freed on completion */
+        } else {
+            GT_SCC_ELMS(new_entry) = (BPLONG)ta_gc_copy_subgoal_list((BPLONG_PTR)GT_SCC_ELMS(new_entry));
+        }
+        list_ptr = table_addr_map_get(&ta_gc_dependents, new_entry);
+        if (list_ptr != NULL) {
+            list_ptr = ta_gc_copy_subgoal_list(list_ptr);
+            table_addr_map_put(&ta_gc_dependents, new_entry, list_ptr);
+        }
+    }
+}
+
+static void ta_gc_copy_table_maps() {
+    BPLONG i, j;
+    MAP_RECORD_PTR mr_ptr, new_mr_ptr;
+    KEY_VAL_PAIR_PTR kvp_ptr, new_kvp_ptr;
+    BPLONG_PTR entry_addr;
+
+    for (i = 0; i < NUM_PICAT_TABLE_MAPS; i++) {
+        mr_ptr = (MAP_RECORD_PTR)picat_table_maps[i];
+        if (mr_ptr == NULL) continue;
+        new_mr_ptr = (MAP_RECORD_PTR)ta_gc_allocate(TA_GC_WORDS(MAP_RECORD));
+        *new_mr_ptr = *mr_ptr;
+        picat_table_maps[i] = (BPLONG_PTR)new_mr_ptr;
+        picat_table_map_ids[i] = ta_gc_copy_term(picat_table_map_ids[i]);
+        if (mr_ptr->in_parea) continue;  /* the entries are not in the table area */
+        for (j = 0; j < mr_ptr->size; j++) {
+            entry_addr = mr_ptr->htable+j;
+            kvp_ptr = (KEY_VAL_PAIR_PTR)FOLLOW(entry_addr);
+            while (kvp_ptr != NULL) {
+                new_kvp_ptr = (KEY_VAL_PAIR_PTR)ta_gc_allocate(TA_GC_WORDS(KEY_VAL_PAIR));
+                new_kvp_ptr->key = ta_gc_copy_term(kvp_ptr->key);
+                new_kvp_ptr->val = ta_gc_copy_term(kvp_ptr->val);
+                new_kvp_ptr->next = NULL;
+                FOLLOW(entry_addr) = (BPLONG)new_kvp_ptr;
+                entry_addr = (BPLONG_PTR)&new_kvp_ptr->next;
+                kvp_ptr = (KEY_VAL_PAIR_PTR)kvp_ptr->next;
+            }
+        }
+    }
+}
+
+/* Collect the table area unless a table frame can be reached from the frame ar
+   or the choice point b. Return 1 if the area was collected. */
+int table_area_gc(BPLONG_PTR ar, BPLONG_PTR b) {
+    BPLONG_PTR block_ptr, new_entry, *entry_addr, last_block_ptr;
+    BPLONG i, num_blocks, num_pinned;
+    NUMBERED_TERM_AREA_RECORD_PTR to_record_ptr = &ta_gc_to_record;
+    int success;
+
+    if (bp_num_engines() != 1 || table_frame_is_live(ar, b, NULL)) return 0;
+
+    free_retired_subgoals(1);  /* no frame references them */
+    table_profile_charge();  /* before the area is moved */
+
+    /* sort the old blocks by address */
+    ta_gc_num_blocks = 0;
+    for (block_ptr = ta_record_ptr->low_addr; block_ptr != NULL; block_ptr = (BPLONG_PTR)FOLLOW(block_ptr)) {
+        ta_gc_num_blocks++;
+    }
+    ta_gc_blocks = (TA_GC_BLOCK *)malloc(ta_gc_num_blocks*sizeof(TA_GC_BLOCK));
+    if (ta_gc_blocks == NULL) return 0;
+    i = 0;
+    for (block_ptr = ta_record_ptr->low_addr; block_ptr != NULL; block_ptr = (BPLONG_PTR)FOLLOW(block_ptr)) {
+        ta_gc_blocks[i].low_addr = block_ptr;
+        ta_gc_blocks[i].pinned = 0;
+        i++;
+    }
+    qsort(ta_gc_blocks, ta_gc_num_blocks, sizeof(TA_GC_BLOCK), ta_gc_compare_blocks);
+    ta_gc_min_addr = ta_gc_blocks[0].low_addr;
+    ta_gc_max_addr = ta_gc_blocks[ta_gc_num_blocks-1].low_addr+NUMBERED_TERM_BLOCK_SIZE;
+
+    /* pin the blocks that the heap, the stack, and the trail refer to */
+    table_addr_map_init(&ta_gc_visited, 1024);
+    ta_gc_pin_area(stack_low_addr, heap_top);
+    ta_gc_pin_area(local_top, stack_up_addr+1);
+    ta_gc_pin_area(trail_top+1, trail_up_addr+1);
+    table_addr_map_free(&ta_gc_visited);
+
+    /* copy the live data into new blocks */
+    ta_gc_to_record.low_addr = NULL;
+    ta_gc_to_record.gterms_htable_ptr = &ta_gc_to_gterms_htable;
+    ta_gc_to_record.num_expansions = 0;
+    ADD_NEW_NUMBERED_TERM_AREA_BLOCK(to_record_ptr, success);
+    if (!success) {
+        myquit(OUT_OF_MEMORY, "tg");
+    }
+    allocate_gterms_htable(&ta_gc_to_gterms_htable, 7919);
+    table_addr_map_init(&ta_gc_fwd, 1024);
+    ta_gc_dependents.keys = NULL;
+    ta_gc_worklist_count = 0;
+
+    for (i = 0; i < subgoalTableBucketSize; i++) {
+        new_entry = (BPLONG_PTR)FOLLOW(subgoalTable+i);
+        entry_addr = (BPLONG_PTR *)(subgoalTable+i);
+        while (new_entry != NULL) {
+            BPLONG_PTR next_entry = (BPLONG_PTR)GT_NEXT(new_entry);
+            *entry_addr = ta_gc_copy_subgoal(new_entry);
+            entry_addr = (BPLONG_PTR *)GT_NEXT_ADDR(*entry_addr);
+            new_entry = next_entry;
+        }
+        *entry_addr = NULL;
+        ta_gc_process_worklist();
+    }
+    for (i = 0; i < num_incremental_preds; i++) {
+        incremental_preds[i]->table_dependents = ta_gc_copy_subgoal_list(incremental_preds[i]->table_dependents);
+        ta_gc_process_worklist();
+    }
+    ta_gc_copy_table_maps();
+    forward_table_profile_leaders(&ta_gc_fwd);
+    table_addr_map_free(&ta_gc_fwd);
+    table_addr_map_free(&subgoal_dependents);
+    subgoal_dependents = ta_gc_dependents;
+    reset_semi_naive_tabling();
+
+    /* free the old blocks that are not pinned, and put the pinned ones after the new blocks */
+    num_blocks = 0;
+    last_block_ptr = NULL;
+    for (block_ptr = ta_gc_to_record.low_addr; block_ptr != NULL; block_ptr = (BPLONG_PTR)FOLLOW(block_ptr)) {
+        num_blocks++;
+        last_block_ptr = block_ptr;
+    }
+    num_pinned = 0;
+    for (i = 0; i < ta_gc_num_blocks; i++) {
+        block_ptr = ta_gc_blocks[i].low_addr;
+        if (ta_gc_blocks[i].pinned) {
+            FOLLOW(last_block_ptr) = (BPLONG)block_ptr;
+            FOLLOW(block_ptr) = (BPLONG)NULL;
+            last_block_ptr = block_ptr;
+            num_pinned++;
+        } else {
+            free(block_ptr);
+        }
+    }
+    free(ta_gc_blocks);
+    ta_gc_blocks = NULL;
+
+    ta_record_ptr->low_addr = ta_gc_to_record.low_addr;
+    ta_record_ptr->up_addr = ta_gc_to_record.up_addr;
+    ta_record_ptr->top = ta_gc_to_record.top;
+    free(ta_gterms_htable_ptr->htable);
+    *ta_gterms_htable_ptr = ta_gc_to_gterms_htable;
+    table_free_cells_ptr = NULL;
+
+    num_blocks += num_pinned;
+    table_area_gc_limit = ta_record_ptr->num_expansions + ((num_blocks > TABLE_AREA_GC_MIN_BLOCKS) ? num_blocks : TABLE_AREA_GC_MIN_BLOCKS);
+    num_table_area_gcs++;
+    return 1;
+}
+
+/* called by table_allocate, for the new frame ar, when the table area has grown enough */
+void table_area_gc_at_call(BPLONG_PTR ar) {
+    if (!table_area_gc((BPLONG_PTR)AR_AR(ar), (BPLONG_PTR)AR_B(ar))) {
+        table_area_gc_limit = ta_record_ptr->num_expansions+1;  /* try again after the next expansion */
+    }
+}
+
+/* c_TABLE_AREA_GC: collect the table area now, if no table frame is live */
+int c_TABLE_AREA_GC() {
+    table_area_gc(arreg, breg);
+    return BP_TRUE;
+}
@@ -170,7 +170,8 @@
 
 /*****************************************************************************/
 #define GET_ETYPE(ptr) ((ptr)->etype)
-#define GET_SPY(ptr) ((ptr)->spy)
+#define GET_FLAGS(ptr) ((ptr)->flags)
+#define GET_SPY(ptr) (GET_FLAGS(ptr) & SYM_SPY)
 #define GET_ARITY(ptr) ((ptr)->arity)
 #define GET_LENGTH(ptr) ((ptr)->length)
 #define GET_EP(ptr) ((ptr)->ep)
@@ -789,6 +789,14 @@ extern BPLONG no_gcs;
         toam_LOCAL_OVERFLOW_CHECK(5);                                   \
     }
 
+/* collect the table area when it has grown enough since the last collection */
+#define INVOKE_TABLE_GC {                                               \
+        if (ta_record_ptr->num_expansions >= table_area_gc_limit) {     \
+            SAVE_AR; SAVE_TOP;                                          \
+            table_area_gc_at_call(AR);                                  \
+        }                                                               \
+    }
+
 #define REAL_INITIALIZE_STACK_VARS(N) {         \
         top = AR-N;                             \
         while (top > LOCAL_TOP) {               \
@@ -311,7 +311,7 @@ int next_token_index = 0;
     }
 
 #define BP_GETC(card, c) {                      \
-        c = getc(card);                         \
+        c = GETC_UNLOCKED(card);                \
     }
 
 #define BP_UNGETC(c, card) {                    \
@@ -336,7 +336,7 @@ int next_token_index = 0;
   }
 
 #define BP_GETC(card, c) {                                              \
-	c = getc(card);														\
+	c = GETC_UNLOCKED(card);											\
 	if (c >= 0) {														\
 	  if (chars_pool_index >= MAX_CHARS_IN_POOL){						\
 		c_init_chars_pool();											\
@@ -466,16 +466,16 @@ int utf8_getc(FILE *curr_in, int c) {
     int b2, b3, b4;
 
     if ((c & 0xe0) == 0xc0) {  /* 110xxxxx */
-        b2 = getc(curr_in);
+        b2 = GETC_UNLOCKED(curr_in);
         if ((b2 & 0xc0) == 0x80) {  /* 110xxxxx 10xxxxxx */
             return (((c & 0x1f) << 6) | (b2 & 0x3f));
         } else {  /* not utf8 char */
             if (b2 > 0) {ungetc((char)b2, curr_in);} /* don't unget EOF */
         }
     } else if ((c & 0xf0) == 0xe0) {  /* 1110xxxx */
-        b2 = getc(curr_in);
+        b2 = GETC_UNLOCKED(curr_in);
         if ((b2 & 0xc0) == 0x80) {  /* 1110xxxx 10xxxxxx */
-            b3 = getc(curr_in);
+            b3 = GETC_UNLOCKED(curr_in);
             if ((b3 & 0xc0) == 0x80) {  /* 1110xxxx 10xxxxxx 10xxxxxx */
                 return (((c & 0xf) << 12) | ((b2 & 0x3f) << 6) | (b3 & 0x3f));
             } else {
@@ -486,11 +486,11 @@ int utf8_getc(FILE *curr_in, int c) {
             if (b2 > 0) {ungetc((char)b2, curr_in);}
         }
     } else if ((c & 0xf8) == 0xf0) {  /* 11110xxx */
-        b2 = getc(curr_in);
+        b2 = GETC_UNLOCKED(curr_in);
         if ((b2 & 0xc0) == 0x80) {  /* 11110xxx 10xxxxxx */
-            b3 = getc(curr_in);
+            b3 = GETC_UNLOCKED(curr_in);
             if ((b3 & 0xc0) == 0x80) {  /* 11110xxx 10xxxxxx 10xxxxxx */
-                b4 = getc(curr_in);
+                b4 = GETC_UNLOCKED(curr_in);
                 if ((b4 & 0xc0) == 0x80) {  /* 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx */
                     return (((c & 0xf) << 18) | ((b2 & 0x3f) << 12) | ((b3 & 0x3f) << 6) | (b4 & 0x3f));
                 } else {
@@ -1449,6 +1449,8 @@ START:
             heap_top += 2;
             if (double_quotes_flag == 0)  /* codes */
                 *newpair++ = MAKEINT(d);
+            else if (d < 0x80)  /* ASCII chars need no encoding or lookup */
+                *newpair++ = char_sym_table[d];
             else {  /* chars */
                 s = AtomStr; n = MAX_STR_LEN;
                 UTF8_CODEPOINT_TO_STR(d, s, n);
@@ -1864,6 +1866,8 @@ START:
             heap_top += 2;
             if (double_quotes_flag == 0)  /* codes */
                 *newpair++ = MAKEINT(d);
+            else if (d < 0x80)  /* ASCII chars need no encoding or lookup */
+                *newpair++ = char_sym_table[d];
             else {  /* chars */
                 s = AtomStr; n = MAX_STR_LEN;
                 UTF8_CODEPOINT_TO_STR(d, s, n);
@@ -0,0 +1,55 @@
+#!/bin/sh
+# Run the regression programs and compare their output with the expected one.
+#
+#   sh run.sh [Program ...]
+#
+# Each Program.pi is copied to an empty temporary directory and run there,
+# so the files it writes do not end up in the source tree, and its standard
+# output and standard error are compared with Program.out. A Program.c
+# embeds the engine: it is compiled, linked with the object files next to the
+# picat executable (all but main.o), and run in the same way. Without
+# arguments, all of the programs are run. Set PICAT to the picat executable
+# to use (default ../../emu/picat), and EMBED_CC and EMBED_LD to the compiler
+# and linker commands for Program.c (default: the 64-bit Linux ones of
+# emu/Makefile.linux64). The exit status is the number of programs that
+# failed.
+
+cd "$(dirname "$0")"
+dir=$(pwd)
+PICAT=$(cd "$(dirname "${PICAT:-../../emu/picat}")" && pwd)/$(basename "${PICAT:-../../emu/picat}")
+emu=$(dirname "$PICAT")
+EMBED_CC=${EMBED_CC:-"gcc -DGC -DGCC -DPICAT -DSAT -DM64BITS -Dunix -DLINUX -DPOSIX"}
+EMBED_LD=${EMBED_LD:-"g++"}
+if [ $# -eq 0 ]; then
+    set -- $(ls *.pi *.c | sed 's/\.\(pi\|c\)$//')
+fi
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+failed=0
+for p in "$@"; do
+    p=${p%.pi}
+    p=${p%.c}
+    mkdir "$work/$p"
+    if [ -f "$dir/$p.c" ]; then
+        if [ ! -f "$emu/main.o" ]; then
+            echo "skip $p (no object files next to $PICAT)"
+            continue
+        fi
+        cp "$dir/$p.c" "$work/$p/"
+        (cd "$work/$p" &&
+         $EMBED_CC -c -I"$emu" "$p.c" &&
+         $EMBED_LD -o "$p" "$p.o" $(ls "$emu"/*.o | grep -v '/main\.o$') -lm -lpthread "$emu/espresso/libespresso.a" &&
+         rm -f "$p.o" && "./$p") > "$work/$p.actual" 2>&1
+    else
+        cp "$dir/$p.pi" "$work/$p/"
+        (cd "$work/$p" && "$PICAT" "$p.pi") > "$work/$p.actual" 2>&1
+    fi
+    if cmp -s "$work/$p.actual" "$dir/$p.out"; then
+        echo "ok   $p"
+    else
+        echo "FAIL $p"
+        diff "$dir/$p.out" "$work/$p.actual" | head -20
+        failed=$((failed+1))
+    fi
+done
+exit $failed
@@ -0,0 +1,54 @@
+/* Threads that take turns running the engine read the same file. */
+#include <stdio.h>
+#include <pthread.h>
+#include "picat.h"
+
+#define N_THREADS 4
+#define N_READS 5
+
+extern int streams_locked;
+
+static BP_ENGINE_POOL_PTR pool;
+static long n_lines[N_THREADS];
+
+static void *reader(void *arg)
+{
+    long id = (long)arg;
+    int k;
+    for (k = 0; k < N_READS; k++) {
+        BP_ENGINE_PTR e = PacquireEngine(pool);
+        BPLONG goal, lines, n;
+        PlockEngine(e);
+        goal = bp_build_structure("picat_read_file_lines", 2);
+        bp_unify(bp_get_arg(1, goal), bp_build_atom("lines.txt"));
+        lines = bp_get_arg(2, goal);
+        n = bp_build_structure("length", 2);
+        bp_unify(bp_get_arg(1, n), lines);
+        if (bp_call_term(goal) == PICAT_TRUE && bp_call_term(n) == PICAT_TRUE)
+            n_lines[id] += bp_get_integer(bp_get_arg(2, n));
+        PunlockEngine();
+        PreleaseEngine(pool, e);
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    pthread_t threads[N_THREADS];
+    FILE *f;
+    long i;
+
+    if ((f = fopen("lines.txt", "w")) == NULL) return 1;
+    for (i = 0; i < 10000; i++) fprintf(f, "line %ld\n", i);
+    fclose(f);
+
+    printf("before PinitP: streams_locked = %d\n", streams_locked);
+    PinitP(argc, argv);
+    printf("after PinitP: streams_locked = %d\n", streams_locked);
+    pool = PnewEnginePool(2, 1000000, 1000000);
+    for (i = 0; i < N_THREADS; i++) pthread_create(&threads[i], NULL, reader, (void *)i);
+    for (i = 0; i < N_THREADS; i++) pthread_join(threads[i], NULL);
+    for (i = 0; i < N_THREADS; i++) printf("thread %ld: %ld lines\n", i, n_lines[i]);
+    printf("free pool: %d\n", PfreeEnginePool(pool));
+    return 0;
+}